@@ -0,0 +1,69 @@
+// generate_market.cpp
+// Writes a deterministic synthetic market (see synthetic_market.hpp) as the stock CSV,
+// a binary bar file, and a portfolio dated near the end of it, so the analyzer and the
+// benchmarks can run on universes of any size.
+//
+// Usage: generate_market --tickers 2000 --years 10 --csv data/stock_data.csv
+//                        [--binary data/stock_data.bin] [--portfolio data/portfolio.json]
+#include "synthetic_market.hpp"
+#include "writer.hpp"
+#include <CLI/CLI.hpp>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+
+int main(int argc, char** argv) {
+    CLI::App app{"Generate a synthetic stock universe"};
+    MarketSpec spec;
+    std::string csv_path;
+    std::string binary_path;
+    std::string portfolio_path;
+    int holdings = 30;
+    double cash = 100000.0;
+    app.add_option("--tickers", spec.tickers, "Number of tickers");
+    app.add_option("--years", spec.years, "Years of 252 trading days");
+    app.add_option("--sectors", spec.sectors, "Number of sectors");
+    app.add_option("--gap-rate", spec.gap_rate, "Chance a listed ticker has no bar on a given day");
+    app.add_option("--delist-rate", spec.delist_rate, "Share of tickers delisted before the last date");
+    app.add_option("--listing-rate", spec.listing_rate, "Share of tickers listed after the first date");
+    app.add_option("--seed", spec.seed, "Random seed");
+    app.add_option("--start-date", spec.start_date, "First trading date (YYYY-MM-DD)");
+    app.add_option("--csv", csv_path, "Where the stock CSV is written");
+    app.add_option("--binary", binary_path, "Where the binary bar file is written");
+    app.add_option("--portfolio", portfolio_path, "Where a portfolio dated 20 trading days before the end is written");
+    app.add_option("--holdings", holdings, "Holdings in that portfolio");
+    app.add_option("--cash", cash, "Cash in that portfolio");
+    CLI11_PARSE(app, argc, argv);
+
+    try {
+        SyntheticMarket market(spec);
+        for (const auto& path : {csv_path, binary_path, portfolio_path}) {
+            auto parent = std::filesystem::path(path).parent_path();
+            if (!parent.empty()) std::filesystem::create_directories(parent);
+        }
+
+        auto timed = [](const char* what, const std::string& path, auto&& write) {
+            auto start = std::chrono::steady_clock::now();
+            size_t bars = write(path);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Wrote " << bars << " bars to " << what << " " << path << " in " << seconds << "s\n";
+        };
+
+        if (!csv_path.empty()) {
+            timed("CSV", csv_path, [&](const std::string& path) { return market.write_csv(path); });
+        }
+        if (!binary_path.empty()) {
+            timed("binary", binary_path, [&](const std::string& path) { return market.write_binary(path); });
+        }
+        if (!portfolio_path.empty()) {
+            uint32_t date = static_cast<uint32_t>(market.get_dates().size() > 20 ? market.get_dates().size() - 21 : 0);
+            Writer::make_portfolio(market.make_portfolio(date, holdings, cash), portfolio_path);
+            std::cout << "Wrote portfolio for " << market.get_dates()[date] << " to " << portfolio_path << "\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "\nError: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
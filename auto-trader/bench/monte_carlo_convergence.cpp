@@ -0,0 +1,109 @@
+// monte_carlo_convergence.cpp
+// Accuracy and throughput of MonteCarloStrategy as the path count grows.
+//
+// A synthetic universe of GBM price histories is scored at increasing path counts.
+// For both path models the exact expectation given the fitted inputs is known in
+// closed form, so the error below is pure Monte Carlo error:
+//   GBM:       E[ROI] = exp(h * (mu + sigma^2 / 2)) - 1
+//   Bootstrap: E[ROI] = mean(exp(r))^h - 1
+//
+// Usage: monte_carlo_convergence [tickers=500] [holding_window=10] [history=500]
+#include "strategies.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+    struct Universe {
+        std::vector<std::string> tickers;
+        std::vector<std::vector<double>> histories;
+    };
+
+    Universe make_universe(int num_tickers, int history_length) {
+        Universe universe;
+        for (int t = 0; t < num_tickers; ++t) {
+            std::string ticker = "SYN" + std::to_string(t);
+            PhiloxRng rng(42, ticker, "history");
+            double drift = 0.0004 * (rng.uniform(0) - 0.5);
+            double sigma = 0.005 + 0.03 * rng.uniform(1);
+
+            std::vector<double> prices{50.0 + 100.0 * rng.uniform(2)};
+            for (int d = 1; d < history_length; ++d) {
+                prices.push_back(prices.back() * std::exp(drift + sigma * rng.normal(10 + d)));
+            }
+            universe.tickers.push_back(std::move(ticker));
+            universe.histories.push_back(std::move(prices));
+        }
+        return universe;
+    }
+
+    double exact_roi(const std::vector<double>& prices, int lookback, int holding_window, PathModel model) {
+        size_t first = prices.size() > static_cast<size_t>(lookback) + 1 ? prices.size() - lookback - 1 : 0;
+        std::vector<double> log_returns;
+        for (size_t i = first + 1; i < prices.size(); ++i) {
+            log_returns.push_back(std::log(prices[i] / prices[i - 1]));
+        }
+
+        if (model == PathModel::Bootstrap) {
+            double mean_growth = 0.0;
+            for (double r : log_returns) mean_growth += std::exp(r);
+            mean_growth /= log_returns.size();
+            return std::pow(mean_growth, holding_window) - 1.0;
+        }
+
+        double mean = 0.0;
+        for (double r : log_returns) mean += r;
+        mean /= log_returns.size();
+        double sq_sum = 0.0;
+        for (double r : log_returns) sq_sum += (r - mean) * (r - mean);
+        double variance = sq_sum / (log_returns.size() - 1);
+        return std::exp(holding_window * (mean + variance / 2)) - 1.0;
+    }
+}
+
+int main(int argc, char** argv) {
+    int num_tickers = argc > 1 ? std::atoi(argv[1]) : 500;
+    int holding_window = argc > 2 ? std::atoi(argv[2]) : 10;
+    int history_length = argc > 3 ? std::atoi(argv[3]) : 500;
+    const int lookback = 250;
+
+    Universe universe = make_universe(num_tickers, history_length);
+    std::printf("tickers=%d holding_window=%d history=%d\n", num_tickers, holding_window, history_length);
+    std::printf("%-10s %8s %12s %14s %14s %14s\n",
+                "model", "paths", "seconds", "tickers/sec", "rmse", "max_abs_err");
+
+    for (PathModel model : {PathModel::GBM, PathModel::Bootstrap}) {
+        std::vector<double> exact;
+        for (const auto& history : universe.histories) {
+            exact.push_back(exact_roi(history, lookback, holding_window, model));
+        }
+
+        for (int paths : {256, 1024, 4096, 16384, 65536}) {
+            MonteCarloStrategy strategy(paths, model, lookback);
+
+            auto start = std::chrono::steady_clock::now();
+            auto rois = strategy.speculate_batch(universe.tickers, universe.histories, "2024-01-02", holding_window);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            double sq_error = 0.0;
+            double max_error = 0.0;
+            for (size_t i = 0; i < rois.size(); ++i) {
+                double error = std::abs(rois[i] - exact[i]);
+                sq_error += error * error;
+                max_error = std::max(max_error, error);
+            }
+
+            std::printf("%-10s %8d %12.4f %14.1f %14.3e %14.3e\n",
+                        model == PathModel::GBM ? "gbm" : "bootstrap",
+                        paths,
+                        seconds,
+                        num_tickers / seconds,
+                        std::sqrt(sq_error / rois.size()),
+                        max_error);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,409 @@
+// rebalance_benchmark.cpp
+// Throughput of each rebalance phase as the universe grows.
+//
+// For every size a synthetic market (see synthetic_market.hpp) is generated under
+// <dir>/<tickers>x<years>/data as stock_data.csv, stock_data.bin and portfolio.json,
+// then timed through:
+//   generate_csv, generate_binary   writing the universe
+//   ingest_csv, ingest_binary       MarketData::load of each file
+//   index_csv                       building the CSV's sparse index (a trading_window call)
+//   query_csv, query_binary         MarketData::load of a year before the portfolio's date
+//   cold_sequential                 load_stock_data of the CSV, then ranking the portfolio's date
+//   cold_pipelined                  the same with load_and_score, which scores while it parses
+//   first_score                     how far into cold_pipelined the first scores came back
+//   ranking_cold, ranking_warm      build_ranking_snapshot, then again from the score cache
+//   returns                         load_returns for the risk report
+//   selection, allocation           select_candidates / allocate_portfolio, --repeats times
+//   end_to_end                      rebalance_portfolio on a fresh rebalancer
+// A table goes to stdout and, with --output, the same numbers as JSON. Each size also
+// reports the heap its market data, caches and rebalance temporaries took (see
+// memory.hpp), bytes per cached price and the process's peak RSS so far.
+//
+// With --iterations N the whole set runs N times and each phase reports the median
+// and the median absolute deviation (MAD) of its times. With --baseline, the medians
+// are compared with a JSON file written earlier by --output; a phase regresses when its
+// median is more than --threshold slower than the baseline's and the slowdown is also
+// beyond three MADs of noise. Phases faster than --min-seconds in the baseline are
+// shown but never fail. Any regression prints a diff table and exits with status 2.
+//
+// Usage: rebalance_benchmark [--sizes 100x2,500x5,2000x5] [--dir bench_data]
+//                            [--repeats 100] [--seed 42] [--output results.json]
+//                            [--iterations 5] [--baseline baseline.json]
+//                            [--threshold 0.10] [--min-seconds 0.001]
+#include "memory.hpp"
+#include "portfolio_rebalancer.hpp"
+#include "synthetic_market.hpp"
+#include "writer.hpp"
+#include <CLI/CLI.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+    constexpr double NOISE_MADS = 3.0;
+
+    struct Phase {
+        std::string name;
+        std::vector<double> samples;    // seconds, one per iteration
+        size_t items = 0;
+    };
+
+    // Bytes, from the rebalancer the ranking, selection and allocation phases use
+    struct MemoryFootprint {
+        int64_t market_data = 0;            // after loading
+        int64_t market_data_peak = 0;       // while loading, with the parse staging
+        int64_t caches = 0;                 // after allocation
+        int64_t rebalance_peak = 0;         // ranking through allocation
+        size_t peak_rss = 0;
+    };
+
+    struct Run {
+        MarketSpec spec;
+        size_t rows = 0;
+        std::vector<Phase> phases;
+        MemoryFootprint memory;
+    };
+
+    template <typename F>
+    Phase time_phase(const std::string& name, F&& body) {
+        auto start = std::chrono::steady_clock::now();
+        size_t items = body();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return Phase{name, {seconds}, items};
+    }
+
+    double median(std::vector<double> values) {
+        if (values.empty()) return 0.0;
+        size_t mid = values.size() / 2;
+        std::nth_element(values.begin(), values.begin() + mid, values.end());
+        double upper = values[mid];
+        if (values.size() % 2 == 1) return upper;
+        return (*std::max_element(values.begin(), values.begin() + mid) + upper) / 2;
+    }
+
+    double median_absolute_deviation(const std::vector<double>& values) {
+        double center = median(values);
+        std::vector<double> deviations;
+        deviations.reserve(values.size());
+        for (double v : values) {
+            deviations.push_back(std::abs(v - center));
+        }
+        return median(deviations);
+    }
+
+    // Prints how each phase's median moved against the baseline; returns the number
+    // of phases that regressed
+    int compare_with_baseline(const std::vector<Run>& runs, const json& baseline,
+                              double threshold, double min_seconds) {
+        std::printf("Compared with baseline (threshold %+.0f%%, noise %.0f MADs, floor %.3f ms)\n",
+                    threshold * 100, NOISE_MADS, min_seconds * 1e3);
+        std::printf("%-12s %-16s %14s %14s %10s %12s  %s\n",
+                    "size", "phase", "baseline ms", "current ms", "change", "noise ms", "status");
+
+        int regressions = 0;
+        for (const auto& run : runs) {
+            std::string size = std::to_string(run.spec.tickers) + "x" + std::to_string(run.spec.years);
+            const json* baseline_run = nullptr;
+            for (const auto& candidate : baseline.at("runs")) {
+                if (candidate.at("tickers") == run.spec.tickers && candidate.at("years") == run.spec.years) {
+                    baseline_run = &candidate;
+                }
+            }
+
+            for (const auto& phase : run.phases) {
+                double current = median(phase.samples);
+                const json* baseline_phase = nullptr;
+                if (baseline_run) {
+                    for (const auto& candidate : baseline_run->at("phases")) {
+                        if (candidate.at("name") == phase.name) baseline_phase = &candidate;
+                    }
+                }
+                if (!baseline_phase) {
+                    std::printf("%-12s %-16s %14s %14.3f %10s %12s  new\n",
+                                size.c_str(), phase.name.c_str(), "-", current * 1e3, "-", "-");
+                    continue;
+                }
+
+                double before = baseline_phase->at("seconds").get<double>();
+                double noise = NOISE_MADS * std::max(median_absolute_deviation(phase.samples),
+                                                     baseline_phase->value("mad_seconds", 0.0));
+                double change = before > 0 ? current / before - 1.0 : 0.0;
+                const char* status = "ok";
+                if (before < min_seconds) {
+                    status = "below floor";
+                } else if (change > threshold && current - before > noise) {
+                    status = "REGRESSED";
+                    ++regressions;
+                } else if (change > threshold) {
+                    status = "within noise";
+                } else if (change < -threshold && before - current > noise) {
+                    status = "faster";
+                }
+                std::printf("%-12s %-16s %14.3f %14.3f %+9.1f%% %12.3f  %s\n",
+                            size.c_str(), phase.name.c_str(), before * 1e3, current * 1e3,
+                            change * 100, noise * 1e3, status);
+            }
+        }
+        return regressions;
+    }
+
+    // "500x5,2000x10" -> (tickers, years) pairs
+    std::vector<std::pair<int, int>> parse_sizes(const std::string& sizes) {
+        std::vector<std::pair<int, int>> parsed;
+        std::stringstream ss(sizes);
+        std::string size;
+        while (std::getline(ss, size, ',')) {
+            int tickers = 0;
+            int years = 0;
+            if (std::sscanf(size.c_str(), "%dx%d", &tickers, &years) != 2 || tickers <= 0 || years <= 0) {
+                throw std::runtime_error("Sizes must look like 500x5,2000x10: " + sizes);
+            }
+            parsed.emplace_back(tickers, years);
+        }
+        return parsed;
+    }
+
+    Run run_size(const MarketSpec& spec, const std::filesystem::path& root, int repeats) {
+        constexpr int holding_window = 10;
+        constexpr int max_holdings = 50;
+        constexpr int max_sector_lead = 5;
+        constexpr double adjust_by = 1.0;
+
+        Run run{spec, 0, {}, {}};
+        auto dir = root / (std::to_string(spec.tickers) + "x" + std::to_string(spec.years));
+        auto data = dir / "data";
+        std::filesystem::create_directories(data);
+        std::string csv_path = (data / "stock_data.csv").string();
+        std::string binary_path = (data / "stock_data.bin").string();
+
+        SyntheticMarket market(spec);
+        run.phases.push_back(time_phase("generate_csv", [&] { return run.rows = market.write_csv(csv_path); }));
+        run.phases.push_back(time_phase("generate_binary", [&] { return market.write_binary(binary_path); }));
+
+        uint32_t date = static_cast<uint32_t>(market.get_dates().size() > 20 ? market.get_dates().size() - 21 : 0);
+        Portfolio portfolio = market.make_portfolio(date, 30, 100000.0);
+        Writer::make_portfolio(portfolio, (data / "portfolio.json").string());
+
+        run.phases.push_back(time_phase("ingest_csv", [&] {
+            return MarketData::load(csv_path).get_tickers().size();
+        }));
+        run.phases.back().items = run.rows;
+        run.phases.push_back(time_phase("ingest_binary", [&] {
+            return MarketData::load(binary_path).get_tickers().size();
+        }));
+        run.phases.back().items = run.rows;
+
+        // A year of history before the portfolio's date and the holding window after
+        LoadQuery window;
+        run.phases.push_back(time_phase("index_csv", [&] {
+            window = MarketData::trading_window(csv_path, portfolio.date, 252, holding_window);
+            return run.rows;
+        }));
+        run.phases.push_back(time_phase("query_csv", [&] {
+            return MarketData::load(csv_path, window).row_count();
+        }));
+        run.phases.push_back(time_phase("query_binary", [&] {
+            return MarketData::load(binary_path, window).row_count();
+        }));
+
+        run.phases.push_back(time_phase("cold_sequential", [&] {
+            PortfolioRebalancer cold;
+            MovingAverageStrategy cold_strategy(20, 50);
+            cold.load_stock_data(csv_path);
+            return cold.build_ranking_snapshot(cold_strategy, portfolio, holding_window).speculated_rois.size();
+        }));
+        IngestStats ingest;
+        run.phases.push_back(time_phase("cold_pipelined", [&] {
+            PortfolioRebalancer cold;
+            MovingAverageStrategy cold_strategy(20, 50);
+            ingest = cold.load_and_score(csv_path, cold_strategy, {portfolio.date}, holding_window);
+            return cold.build_ranking_snapshot(cold_strategy, portfolio, holding_window).speculated_rois.size();
+        }));
+        run.phases.push_back(Phase{"first_score", {ingest.first_score_seconds}, 1});
+
+        RebalanceOptions options;
+        MovingAverageStrategy strategy(20, 50);
+        PortfolioRebalancer rebalancer;
+        MemoryStats::reset_peaks();
+        rebalancer.load_stock_data(csv_path);
+        run.memory.market_data = MemoryStats::usage(Subsystem::MarketData).bytes;
+        run.memory.market_data_peak = MemoryStats::usage(Subsystem::MarketData).peak_bytes;
+        MemoryStats::reset_peaks();
+        int64_t rebalance_base = MemoryStats::usage(Subsystem::Rebalance).bytes;
+
+        RankingSnapshot snapshot;
+        run.phases.push_back(time_phase("ranking_cold", [&] {
+            snapshot = rebalancer.build_ranking_snapshot(strategy, portfolio, holding_window, options.universe);
+            return snapshot.speculated_rois.size();
+        }));
+        run.phases.push_back(time_phase("ranking_warm", [&] {
+            snapshot = rebalancer.build_ranking_snapshot(strategy, portfolio, holding_window, options.universe);
+            return snapshot.speculated_rois.size();
+        }));
+        run.phases.push_back(time_phase("returns", [&] {
+            rebalancer.load_returns(snapshot, options.return_lookback());
+            return snapshot.daily_returns.size();
+        }));
+
+        CandidateList candidates;
+        run.phases.push_back(time_phase("selection", [&] {
+            for (int i = 0; i < repeats; ++i) {
+                candidates = rebalancer.select_candidates(snapshot, max_holdings, max_sector_lead, options.max_correlation);
+            }
+            return static_cast<size_t>(repeats);
+        }));
+        run.phases.push_back(time_phase("allocation", [&] {
+            for (int i = 0; i < repeats; ++i) {
+                rebalancer.allocate_portfolio(snapshot, candidates, portfolio, adjust_by, options);
+            }
+            return static_cast<size_t>(repeats);
+        }));
+
+        // rebalance_portfolio reads ./data, so run it from the size's directory
+        run.memory.caches = MemoryStats::usage(Subsystem::Caches).bytes;
+        run.memory.rebalance_peak = MemoryStats::usage(Subsystem::Rebalance).peak_bytes - rebalance_base;
+
+        auto previous = std::filesystem::current_path();
+        std::filesystem::current_path(dir);
+        try {
+            run.phases.push_back(time_phase("end_to_end", [&] {
+                PortfolioRebalancer fresh;
+                MovingAverageStrategy fresh_strategy(20, 50);
+                fresh.rebalance_portfolio(fresh_strategy, holding_window, max_holdings, max_sector_lead, adjust_by, options);
+                return size_t{1};
+            }));
+        } catch (...) {
+            std::filesystem::current_path(previous);
+            throw;
+        }
+        std::filesystem::current_path(previous);
+        run.memory.peak_rss = MemoryStats::peak_rss_bytes();
+        return run;
+    }
+}
+
+int main(int argc, char** argv) {
+    CLI::App app{"Time each rebalance phase on synthetic universes of increasing size"};
+    std::string sizes = "100x2,500x5,2000x5";
+    std::string dir = "bench_data";
+    std::string output_path;
+    int repeats = 100;
+    int iterations = 1;
+    std::string baseline_path;
+    double threshold = 0.10;
+    double min_seconds = 0.001;
+    MarketSpec base;
+    app.add_option("--sizes", sizes, "Comma-separated <tickers>x<years> universes to run");
+    app.add_option("--dir", dir, "Where the generated universes are written");
+    app.add_option("--repeats", repeats, "Times selection and allocation are repeated");
+    app.add_option("--seed", base.seed, "Random seed for the synthetic market");
+    app.add_option("--output", output_path, "Where the results are written as JSON");
+    app.add_option("--iterations", iterations, "Times the whole benchmark set is run; phases report the median");
+    app.add_option("--baseline", baseline_path, "Results JSON from an earlier --output to check for regressions against");
+    app.add_option("--threshold", threshold, "Slowdown of a phase's median, as a fraction, that counts as a regression");
+    app.add_option("--min-seconds", min_seconds, "Baseline phases faster than this are never flagged");
+    CLI11_PARSE(app, argc, argv);
+
+    MemoryStats::enable();
+    try {
+        // Read the baseline first so a bad path fails before the benchmarks run
+        json baseline;
+        if (!baseline_path.empty()) {
+            std::ifstream baseline_file(baseline_path);
+            if (!baseline_file.is_open()) {
+                throw std::runtime_error("Could not open baseline file: " + baseline_path);
+            }
+            baseline = json::parse(baseline_file);
+            if (baseline.at("config").at("repeats") != repeats) {
+                throw std::runtime_error("Baseline was run with --repeats " +
+                                         baseline.at("config").at("repeats").dump() +
+                                         "; selection and allocation times are not comparable");
+            }
+        }
+
+        std::vector<Run> runs;
+        for (auto [tickers, years] : parse_sizes(sizes)) {
+            MarketSpec spec = base;
+            spec.tickers = tickers;
+            spec.years = years;
+            runs.push_back(run_size(spec, dir, repeats));
+            Run& run = runs.back();
+            for (int i = 1; i < iterations; ++i) {
+                Run again = run_size(spec, dir, repeats);
+                for (size_t p = 0; p < run.phases.size(); ++p) {
+                    run.phases[p].samples.push_back(again.phases[p].samples.front());
+                }
+            }
+
+            std::printf("tickers=%d years=%d rows=%zu iterations=%d\n", tickers, years, run.rows, iterations);
+            std::printf("%-16s %12s %12s %12s %16s\n", "phase", "median s", "mad s", "items", "items/sec");
+            for (const auto& phase : run.phases) {
+                double seconds = median(phase.samples);
+                std::printf("%-16s %12.4f %12.4f %12zu %16.1f\n", phase.name.c_str(), seconds,
+                            median_absolute_deviation(phase.samples), phase.items,
+                            seconds > 0 ? phase.items / seconds : 0.0);
+            }
+            const auto& memory = run.memory;
+            std::printf("memory: market data %.1f MB (%.1f bytes/price, %.1f MB while loading), caches %.1f MB, "
+                        "rebalance peak %.1f MB, peak RSS %.1f MB\n\n",
+                        memory.market_data / 1048576.0,
+                        run.rows > 0 ? static_cast<double>(memory.market_data) / run.rows : 0.0,
+                        memory.market_data_peak / 1048576.0, memory.caches / 1048576.0,
+                        memory.rebalance_peak / 1048576.0, memory.peak_rss / 1048576.0);
+        }
+
+        if (!output_path.empty()) {
+            json results;
+            results["benchmark"] = "rebalance";
+            results["config"] = {{"sizes", sizes}, {"repeats", repeats}, {"iterations", iterations}, {"seed", base.seed},
+                                 {"sectors", base.sectors}, {"gap_rate", base.gap_rate},
+                                 {"delist_rate", base.delist_rate}, {"listing_rate", base.listing_rate}};
+            results["runs"] = json::array();
+            for (const auto& run : runs) {
+                json phases = json::array();
+                for (const auto& phase : run.phases) {
+                    double seconds = median(phase.samples);
+                    phases.push_back({{"name", phase.name}, {"seconds", seconds},
+                                      {"mad_seconds", median_absolute_deviation(phase.samples)},
+                                      {"samples", phase.samples}, {"items", phase.items},
+                                      {"items_per_second", seconds > 0 ? phase.items / seconds : 0.0}});
+                }
+                results["runs"].push_back({{"tickers", run.spec.tickers}, {"years", run.spec.years},
+                                           {"rows", run.rows}, {"phases", phases},
+                                           {"memory", {{"market_data_bytes", run.memory.market_data},
+                                                       {"market_data_peak_bytes", run.memory.market_data_peak},
+                                                       {"bytes_per_price", run.rows > 0
+                                                           ? static_cast<double>(run.memory.market_data) / run.rows
+                                                           : 0.0},
+                                                       {"cache_bytes", run.memory.caches},
+                                                       {"rebalance_peak_bytes", run.memory.rebalance_peak},
+                                                       {"peak_rss_bytes", run.memory.peak_rss}}}});
+            }
+
+            std::ofstream out(output_path);
+            if (!out.is_open()) {
+                throw std::runtime_error("Could not open output file for writing");
+            }
+            out << results.dump(2) << "\n";
+        }
+
+        if (!baseline_path.empty()) {
+            int regressions = compare_with_baseline(runs, baseline, threshold, min_seconds);
+            if (regressions > 0) {
+                std::printf("\n%d phase(s) regressed against %s\n", regressions, baseline_path.c_str());
+                return 2;
+            }
+            std::printf("\nNo regressions against %s\n", baseline_path.c_str());
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "\nError: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,217 @@
+// rebalance_scalability.cpp
+// Throughput of concurrent rebalances on one shared PortfolioRebalancer as the thread
+// count grows.
+//
+// A synthetic market (see synthetic_market.hpp) is written as a binary bar file under
+// <dir>/<tickers>x<years>/data and loaded once. --portfolios portfolios spread over
+// --dates rebalance dates (consecutive portfolios fall on different dates) are then
+// rebalanced with PortfolioRebalancer::rebalance from each thread count in --threads:
+//   cold   a freshly loaded rebalancer, so the first portfolio on each date scores the
+//          universe and fills the shared score cache while other threads read it
+//   warm   the same rebalancer again, with every score cached
+// Each pass reports rebalances per second and its speedup and efficiency over one
+// thread. Every pass must also produce the same results as the single-threaded one;
+// if any differs the benchmark says so and exits with status 1. Speedup is bounded by
+// the cores the machine actually has, which is printed alongside.
+//
+// Usage: rebalance_scalability [--tickers 500] [--years 5] [--dates 16] [--portfolios 256]
+//                              [--threads 1,2,4,8,16,32,64] [--dir bench_data] [--seed 42]
+//                              [--output results.json]
+#include "parallel.hpp"
+#include "portfolio_rebalancer.hpp"
+#include "synthetic_market.hpp"
+#include "writer.hpp"
+#include <CLI/CLI.hpp>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace {
+    constexpr int holding_window = 10;
+    constexpr int max_holdings = 50;
+    constexpr int max_sector_lead = 5;
+    constexpr double adjust_by = 1.0;
+
+    struct Pass {
+        double seconds = 0.0;
+        size_t failed = 0;
+        std::vector<size_t> fingerprints;   // of each portfolio's result line
+    };
+
+    struct Run {
+        unsigned threads = 0;
+        Pass cold;
+        Pass warm;
+    };
+
+    // "1,2,4" -> {1, 2, 4}
+    std::vector<unsigned> parse_threads(const std::string& list) {
+        std::vector<unsigned> parsed;
+        std::stringstream ss(list);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            int threads = 0;
+            if (std::sscanf(item.c_str(), "%d", &threads) != 1 || threads <= 0) {
+                throw std::runtime_error("Threads must look like 1,2,4,8: " + list);
+            }
+            parsed.push_back(static_cast<unsigned>(threads));
+        }
+        return parsed;
+    }
+
+    Pass rebalance_all(PortfolioRebalancer& rebalancer, Strategy& strategy,
+                       const std::vector<Portfolio>& portfolios, unsigned threads) {
+        Pass pass;
+        pass.fingerprints.assign(portfolios.size(), 0);
+        std::vector<char> failed(portfolios.size(), 0);
+
+        auto start = std::chrono::steady_clock::now();
+        parallel_for(portfolios.size(), [&](size_t i) {
+            std::ostringstream line;
+            try {
+                auto result = rebalancer.rebalance(strategy, portfolios[i], holding_window, max_holdings,
+                                                   max_sector_lead, adjust_by);
+                Writer::write_rebalance_line(line, portfolios[i].id, result);
+            } catch (const std::exception& e) {
+                Writer::write_rebalance_error_line(line, portfolios[i].id, e.what());
+                failed[i] = 1;
+            }
+            pass.fingerprints[i] = std::hash<std::string>{}(line.str());
+        }, threads, 1);
+        pass.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        for (char f : failed) {
+            pass.failed += f;
+        }
+        return pass;
+    }
+}
+
+int main(int argc, char** argv) {
+    CLI::App app{"Time concurrent rebalances on one shared rebalancer at increasing thread counts"};
+    MarketSpec spec;
+    int dates = 16;
+    int portfolios_count = 256;
+    std::string thread_list = "1,2,4,8,16,32,64";
+    std::string dir = "bench_data";
+    std::string output_path;
+    app.add_option("--tickers", spec.tickers, "Tickers in the synthetic universe");
+    app.add_option("--years", spec.years, "Years of daily bars");
+    app.add_option("--dates", dates, "Distinct rebalance dates the portfolios are spread over");
+    app.add_option("--portfolios", portfolios_count, "Portfolios rebalanced per pass");
+    app.add_option("--threads", thread_list, "Comma-separated thread counts to run");
+    app.add_option("--dir", dir, "Where the generated universe is written");
+    app.add_option("--seed", spec.seed, "Random seed for the synthetic market");
+    app.add_option("--output", output_path, "Where the results are written as JSON");
+    CLI11_PARSE(app, argc, argv);
+
+    try {
+        auto thread_counts = parse_threads(thread_list);
+        if (dates <= 0 || portfolios_count <= 0) {
+            throw std::runtime_error("--dates and --portfolios must be positive");
+        }
+
+        auto data = std::filesystem::path(dir) / (std::to_string(spec.tickers) + "x" + std::to_string(spec.years)) / "data";
+        std::filesystem::create_directories(data);
+        std::string binary_path = (data / "stock_data.bin").string();
+        SyntheticMarket market(spec);
+        size_t rows = market.write_binary(binary_path);
+
+        // Dates a week apart, ending a month before the last bar so every one has a
+        // holding window of future prices
+        size_t n_dates = market.get_dates().size();
+        if (n_dates < static_cast<size_t>(21 + 5 * dates + 250)) {
+            throw std::runtime_error("Not enough history for " + std::to_string(dates) + " rebalance dates");
+        }
+        std::vector<Portfolio> portfolios;
+        portfolios.reserve(portfolios_count);
+        for (int i = 0; i < portfolios_count; ++i) {
+            uint32_t date = static_cast<uint32_t>(n_dates - 21 - 5 * (i % dates));
+            Portfolio portfolio = market.make_portfolio(date, 10 + (i / dates) % 30, 100000.0 + 1000.0 * i);
+            portfolio.id = "p" + std::to_string(i);
+            portfolios.push_back(std::move(portfolio));
+        }
+
+        std::printf("tickers=%d years=%d rows=%zu dates=%d portfolios=%d hardware threads=%u\n",
+                    spec.tickers, spec.years, rows, dates, portfolios_count, std::thread::hardware_concurrency());
+        std::printf("%8s %12s %12s %9s %7s %12s %12s %9s %7s\n", "threads", "cold s", "cold /s", "speedup", "eff",
+                    "warm s", "warm /s", "speedup", "eff");
+
+        // Stateless, so one instance can be shared by every thread
+        MovingAverageStrategy strategy(20, 50);
+        std::vector<Run> runs;
+        bool mismatch = false;
+        for (unsigned threads : thread_counts) {
+            PortfolioRebalancer rebalancer;
+            rebalancer.load_stock_data(binary_path);
+
+            Run run{threads, {}, {}};
+            run.cold = rebalance_all(rebalancer, strategy, portfolios, threads);
+            run.warm = rebalance_all(rebalancer, strategy, portfolios, threads);
+            runs.push_back(std::move(run));
+
+            // The first pass is the reference: one thread when --threads starts with 1
+            const Pass& reference = runs.front().cold;
+            const Run& last = runs.back();
+            bool same = last.cold.fingerprints == reference.fingerprints &&
+                        last.warm.fingerprints == reference.fingerprints;
+            mismatch |= !same;
+
+            const Pass& base_cold = runs.front().cold;
+            const Pass& base_warm = runs.front().warm;
+            double cold_speedup = base_cold.seconds / last.cold.seconds;
+            double warm_speedup = base_warm.seconds / last.warm.seconds;
+            double base_threads = runs.front().threads;
+            std::printf("%8u %12.4f %12.1f %9.2f %6.0f%% %12.4f %12.1f %9.2f %6.0f%%%s\n", threads,
+                        last.cold.seconds, portfolios.size() / last.cold.seconds, cold_speedup,
+                        100.0 * cold_speedup * base_threads / threads,
+                        last.warm.seconds, portfolios.size() / last.warm.seconds, warm_speedup,
+                        100.0 * warm_speedup * base_threads / threads,
+                        same ? "" : "  RESULTS DIFFER");
+        }
+        if (runs.front().cold.failed > 0) {
+            std::printf("%zu of %zu portfolios could not be rebalanced\n", runs.front().cold.failed, portfolios.size());
+        }
+
+        if (!output_path.empty()) {
+            json results;
+            results["benchmark"] = "rebalance_scalability";
+            results["config"] = {{"tickers", spec.tickers}, {"years", spec.years}, {"rows", rows},
+                                 {"dates", dates}, {"portfolios", portfolios_count}, {"seed", spec.seed},
+                                 {"hardware_threads", std::thread::hardware_concurrency()}};
+            results["runs"] = json::array();
+            for (const auto& run : runs) {
+                auto pass_json = [&](const Pass& pass, const Pass& base) {
+                    return json{{"seconds", pass.seconds},
+                                {"rebalances_per_second", portfolios.size() / pass.seconds},
+                                {"speedup", base.seconds / pass.seconds},
+                                {"failed", pass.failed}};
+                };
+                results["runs"].push_back({{"threads", run.threads},
+                                           {"cold", pass_json(run.cold, runs.front().cold)},
+                                           {"warm", pass_json(run.warm, runs.front().warm)}});
+            }
+
+            std::ofstream out(output_path);
+            if (!out.is_open()) {
+                throw std::runtime_error("Could not open output file for writing");
+            }
+            out << results.dump(2) << "\n";
+        }
+
+        if (mismatch) {
+            std::printf("\nConcurrent results differ from the first pass\n");
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "\nError: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,219 @@
+// synthetic_market.cpp
+#include "synthetic_market.hpp"
+#include "market_data.hpp"
+#include "rng.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fmt/format.h>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+
+namespace {
+    // Random streams besides the per-ticker parameter stream (which is the ticker index)
+    constexpr uint64_t MARKET_STREAM = 1ull << 40;
+    constexpr uint64_t SECTOR_STREAM = 1ull << 41;
+    constexpr uint64_t GAP_STREAM = 1ull << 42;
+    constexpr uint64_t BAR_STREAM = 1ull << 43;
+
+    constexpr double MARKET_VOLATILITY = 0.01;
+    constexpr double SECTOR_VOLATILITY = 0.008;
+
+    const char* const SECTOR_NAMES[] = {
+        "Communication", "ConsumerDiscretionary", "ConsumerStaples", "Energy", "Financials",
+        "HealthCare", "Industrials", "Materials", "RealEstate", "Technology", "Utilities"
+    };
+
+    std::vector<std::string> business_days(const std::string& start, size_t count) {
+        int year = 0;
+        unsigned month = 0;
+        unsigned day = 0;
+        if (std::sscanf(start.c_str(), "%d-%u-%u", &year, &month, &day) != 3) {
+            throw std::runtime_error("Start date must be YYYY-MM-DD: " + start);
+        }
+
+        using namespace std::chrono;
+        sys_days current{std::chrono::year{year} / std::chrono::month{month} / std::chrono::day{day}};
+        std::vector<std::string> dates;
+        dates.reserve(count);
+        while (dates.size() < count) {
+            weekday weekday_of{current};
+            if (weekday_of != Saturday && weekday_of != Sunday) {
+                year_month_day ymd{current};
+                dates.push_back(fmt::format("{:04d}-{:02d}-{:02d}", static_cast<int>(ymd.year()),
+                                            static_cast<unsigned>(ymd.month()), static_cast<unsigned>(ymd.day())));
+            }
+            current += days{1};
+        }
+        return dates;
+    }
+
+    // Prices are quoted to four decimals, the precision the CSV is written at, so the
+    // CSV and binary files hold the same bars
+    double to_tick(double price) {
+        return std::round(price * 1e4) / 1e4;
+    }
+
+    struct TickerParams {
+        double volatility;
+        double beta;
+        double sector_loading;
+        double price;
+        double volume;
+    };
+}
+
+SyntheticMarket::SyntheticMarket(const MarketSpec& spec) : spec(spec) {
+    if (spec.tickers <= 0 || spec.years <= 0 || spec.sectors <= 0) {
+        throw std::runtime_error("Synthetic market needs at least one ticker, year and sector");
+    }
+
+    dates = business_days(spec.start_date, static_cast<size_t>(spec.years) * 252);
+    for (int s = 0; s < spec.sectors; ++s) {
+        sector_names.push_back(s < static_cast<int>(std::size(SECTOR_NAMES)) ? SECTOR_NAMES[s]
+                                                                            : fmt::format("Sector{:02d}", s));
+    }
+
+    const auto n_dates = static_cast<uint32_t>(dates.size());
+    for (int t = 0; t < spec.tickers; ++t) {
+        PhiloxRng rng(spec.seed, static_cast<uint64_t>(t));
+        tickers.push_back(fmt::format("SYN{:05d}", t));
+        ticker_sectors.push_back(std::min<uint32_t>(static_cast<uint32_t>(rng.uniform(0) * spec.sectors),
+                                                    spec.sectors - 1));
+
+        // Late listings start somewhere in the first 80% of the calendar; delistings end
+        // somewhere after the listing
+        uint32_t first = rng.uniform(1) < spec.listing_rate ? static_cast<uint32_t>(rng.uniform(2) * n_dates * 0.8) : 0;
+        uint32_t end = n_dates;
+        if (rng.uniform(3) < spec.delist_rate) {
+            end = first + 1 + static_cast<uint32_t>(rng.uniform(4) * (n_dates - first - 1));
+        }
+        first_dates.push_back(first);
+        end_dates.push_back(end);
+    }
+}
+
+bool SyntheticMarket::has_bar(uint32_t ticker, uint32_t date) const {
+    if (date < first_dates[ticker] || date >= end_dates[ticker]) {
+        return false;
+    }
+    PhiloxRng gaps(spec.seed, GAP_STREAM + ticker);
+    return gaps.uniform(date) >= spec.gap_rate;
+}
+
+size_t SyntheticMarket::generate(const BarSink& sink) const {
+    const size_t n_dates = dates.size();
+    const size_t n_sectors = sector_names.size();
+
+    // Factor returns are shared by every ticker, so draw them once
+    std::vector<double> market(n_dates);
+    PhiloxRng(spec.seed, MARKET_STREAM).fill_normal(market.data(), n_dates);
+    std::vector<double> sectors(n_sectors * n_dates);
+    for (size_t s = 0; s < n_sectors; ++s) {
+        PhiloxRng(spec.seed, SECTOR_STREAM + s).fill_normal(sectors.data() + s * n_dates, n_dates);
+    }
+
+    size_t bars = 0;
+    std::vector<double> draws(4 * n_dates);
+    for (uint32_t t = 0; t < tickers.size(); ++t) {
+        PhiloxRng rng(spec.seed, static_cast<uint64_t>(t));
+        TickerParams params{
+            0.008 + 0.025 * rng.uniform(5),
+            0.5 + rng.uniform(6),
+            0.5 + 0.5 * rng.uniform(7),
+            5.0 * std::exp(rng.uniform(8) * std::log(100.0)),
+            std::pow(10.0, 4.0 + 3.0 * rng.uniform(9))
+        };
+
+        // Four normals per day: idiosyncratic return, open gap, high and low extension
+        PhiloxRng(spec.seed, BAR_STREAM + t).fill_normal(draws.data(), draws.size());
+        const double* sector = sectors.data() + ticker_sectors[t] * n_dates;
+        double close = params.price;
+
+        for (uint32_t d = first_dates[t]; d < end_dates[t]; ++d) {
+            const double* z = draws.data() + 4 * d;
+            double previous = close;
+            double log_return = 0.0002 +
+                                params.beta * MARKET_VOLATILITY * market[d] +
+                                params.sector_loading * SECTOR_VOLATILITY * sector[d] +
+                                params.volatility * z[0];
+            close = previous * std::exp(log_return);
+            if (!has_bar(t, d)) {
+                continue;
+            }
+
+            double open = previous * std::exp(0.3 * params.volatility * z[1]);
+            double high = std::max(open, close) * (1.0 + 0.5 * params.volatility * std::abs(z[2]));
+            double low = std::min(open, close) * (1.0 - 0.5 * params.volatility * std::min(std::abs(z[3]), 3.0));
+            double volume = std::round(params.volume * std::exp(0.4 * z[1] * z[2]));
+            sink(t, d, to_tick(close), to_tick(open), to_tick(low), to_tick(high), volume);
+            ++bars;
+        }
+    }
+    return bars;
+}
+
+size_t SyntheticMarket::write_csv(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file for writing: " + path);
+    }
+
+    fmt::memory_buffer buffer;
+    fmt::format_to(std::back_inserter(buffer), "ticker,sector,date,close,open,low,high,volume\n");
+    size_t bars = generate([&](uint32_t t, uint32_t d, double close, double open,
+                               double low, double high, double volume) {
+        fmt::format_to(std::back_inserter(buffer), "{},{},{},{:.4f},{:.4f},{:.4f},{:.4f},{:.0f}\n",
+                       tickers[t], sector_names[ticker_sectors[t]], dates[d], close, open, low, high, volume);
+        if (buffer.size() > (1 << 20)) {
+            file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            buffer.clear();
+        }
+    });
+    file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    if (!file) {
+        throw std::runtime_error("Could not write " + path);
+    }
+    return bars;
+}
+
+size_t SyntheticMarket::write_binary(const std::string& path) const {
+    std::vector<std::pair<std::string, uint32_t>> ticker_table;
+    for (size_t t = 0; t < tickers.size(); ++t) {
+        ticker_table.emplace_back(tickers[t], ticker_sectors[t]);
+    }
+
+    BarFileWriter writer(path, sector_names, ticker_table, dates);
+    size_t bars = generate([&](uint32_t t, uint32_t d, double close, double open,
+                               double low, double high, double volume) {
+        writer.add(t, d, close, open, low, high, volume);
+    });
+    writer.finish();
+    return bars;
+}
+
+Portfolio SyntheticMarket::make_portfolio(uint32_t date, int holdings, double cash) const {
+    Portfolio portfolio{"synthetic", dates.at(date), cash, {}};
+    PhiloxRng rng(spec.seed, MARKET_STREAM - 1);
+
+    // Walk the universe from a seeded offset, keeping tickers quoted on the date. The
+    // step is coprime to the universe size, so the walk visits each ticker once.
+    size_t n = tickers.size();
+    size_t offset = static_cast<size_t>(rng.uniform(0) * n);
+    size_t step = 7919;
+    while (n > 0 && std::gcd(step, n) != 1) {
+        ++step;
+    }
+    for (size_t i = 0; i < n && static_cast<int>(portfolio.holdings.size()) < holdings; ++i) {
+        uint32_t t = static_cast<uint32_t>((offset + i * step) % n);
+        if (!has_bar(t, date)) continue;
+        std::map<std::string, std::variant<std::string, int>> holding;
+        holding["ticker"] = tickers[t];
+        holding["quantity"] = 1 + static_cast<int>(rng.uniform(1 + i) * 200);
+        portfolio.holdings.push_back(holding);
+    }
+    return portfolio;
+}
@@ -0,0 +1,56 @@
+// synthetic_market.hpp
+#pragma once
+#include "models.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct MarketSpec {
+    int tickers = 500;
+    int years = 5;                      // of 252 trading days
+    int sectors = 11;
+    double gap_rate = 0.01;             // chance a listed ticker has no bar on a given day
+    double delist_rate = 0.05;          // share of tickers delisted before the last date
+    double listing_rate = 0.10;         // share of tickers listed after the first date
+    uint64_t seed = 42;
+    std::string start_date = "2015-01-02";
+};
+
+// Deterministic synthetic universe of daily bars. Returns are a market factor, a
+// sector factor and an idiosyncratic term (so sectors are correlated), with per-ticker
+// volatility, beta, price level and volume level. Every draw comes from PhiloxRng keyed
+// by (seed, ticker or factor, day), so the same spec always gives the same bars, and
+// any ticker can be generated without the others.
+class SyntheticMarket {
+public:
+    using BarSink = std::function<void(uint32_t ticker, uint32_t date, double close, double open,
+                                       double low, double high, double volume)>;
+
+private:
+    MarketSpec spec;
+    std::vector<std::string> dates;
+    std::vector<std::string> sector_names;
+    std::vector<std::string> tickers;
+    std::vector<uint32_t> ticker_sectors;
+    std::vector<uint32_t> first_dates;      // listing
+    std::vector<uint32_t> end_dates;        // one past the last listed date
+
+public:
+    explicit SyntheticMarket(const MarketSpec& spec);
+
+    const std::vector<std::string>& get_dates() const { return dates; }
+    const std::vector<std::string>& get_tickers() const { return tickers; }
+
+    bool has_bar(uint32_t ticker, uint32_t date) const;
+
+    // Every bar, ticker by ticker in date order; returns the number of bars
+    size_t generate(const BarSink& sink) const;
+
+    size_t write_csv(const std::string& path) const;
+    size_t write_binary(const std::string& path) const;
+
+    // A portfolio on `date` holding `holdings` tickers that have a bar that day
+    Portfolio make_portfolio(uint32_t date, int holdings, double cash) const;
+};
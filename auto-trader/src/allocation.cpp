@@ -0,0 +1,66 @@
+// allocation.cpp
+#include "allocation.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <queue>
+#include <utility>
+
+namespace {
+    // Reduction in the target's own squared error from one more share
+    double improvement(const ShareTarget& target) {
+        double deficit = target.target_value - target.shares * target.price;
+        return target.price * (2.0 * deficit - target.price);
+    }
+
+    // Whether one more share still lowers the total error once the cash term is included
+    bool worth_buying(const ShareTarget& target, double cash, double cash_target) {
+        return target.price <= cash &&
+               improvement(target) + target.price * (2.0 * (cash - cash_target) - target.price) > 0.0;
+    }
+}
+
+double allocate_cash(std::vector<ShareTarget>& targets, double cash, double cash_target) {
+    // (improvement, index); ties go to the lower index so results are deterministic
+    auto worse = [](const std::pair<double, size_t>& a, const std::pair<double, size_t>& b) {
+        return a.first != b.first ? a.first < b.first : a.second > b.second;
+    };
+    std::vector<std::pair<double, size_t>> heap;
+    heap.reserve(targets.size());
+    for (size_t i = 0; i < targets.size(); ++i) {
+        if (worth_buying(targets[i], cash, cash_target)) {
+            heap.emplace_back(improvement(targets[i]), i);
+        }
+    }
+    std::priority_queue<std::pair<double, size_t>, std::vector<std::pair<double, size_t>>, decltype(worse)>
+        queue(worse, std::move(heap));
+
+    while (!queue.empty()) {
+        size_t i = queue.top().second;
+        queue.pop();
+
+        // Cash only goes down, so a share that is not worth buying now never will be
+        ShareTarget& target = targets[i];
+        if (!worth_buying(target, cash, cash_target)) continue;
+
+        // Each share lowers this target's key by 2 * price^2. Buy the whole run that
+        // keeps it ahead of the next target and still lowers the total error, rather
+        // than popping once per share when cash is large next to the price.
+        const double price = target.price;
+        const double deficit = target.target_value - target.shares * price;
+        double count = std::floor(cash / price);
+        count = std::min(count, std::ceil((deficit + cash - cash_target - price) / (2.0 * price)));
+        if (!queue.empty()) {
+            count = std::min(count, 1.0 + std::floor((improvement(target) - queue.top().first) / (2.0 * price * price)));
+        }
+        count = std::max(count, 1.0);
+
+        target.shares += static_cast<int>(count);
+        cash -= count * price;
+
+        if (worth_buying(target, cash, cash_target)) {
+            queue.emplace(improvement(target), i);
+        }
+    }
+    return cash;
+}
@@ -0,0 +1,35 @@
+// allocation.hpp
+#pragma once
+#include <vector>
+
+struct ShareTarget {
+    double price;
+    double target_value;
+    int shares;     // whole shares held after truncating to the target; raised in place
+};
+
+// Spends up to `cash` on whole extra shares to bring down the tracking error
+//
+//   sum((target_value - shares * price)^2) + (cash_left - cash_target)^2
+//
+// and returns the cash left. Idle cash counts against the result like any other
+// missed target. The rebalancer sets cash_target to what position caps hold back,
+// plus the share of the portfolio capped optimizer weights leave unallocated; the
+// rank-ramp targets add up to at least the portfolio value.
+//
+// This is a greedy heuristic, not an exact minimiser. One more share of a target with
+// deficit d = target_value - shares * price changes its own squared error by
+// price * (price - 2 * d) and the cash term by price * (price - 2 * e), where
+// e = cash_left - cash_target. Shares are bought in order of their own improvement,
+// largest first, from a max-heap. A share is bought only while the two changes
+// together still reduce the error and it fits the cash. Cash only goes down, so a
+// target that fails either test is dropped for good. The order ignores that the cash
+// term rewards dearer shares more, so the error can end above the best whole-share
+// purchase, most often when cash is large next to the deficits; it never ends above
+// the error of buying nothing. bench/allocation_check.cpp measures the gap against
+// brute force. A target buys in one step for as long as it would stay on top of the
+// heap, so heap operations follow changes of lead between targets rather than
+// shares bought. For the leftover from truncating to whole shares (under one share
+// per target) that is O(n log n). Apart from exact ties, the result does not depend
+// on the order targets are given in.
+double allocate_cash(std::vector<ShareTarget>& targets, double cash, double cash_target = 0.0);
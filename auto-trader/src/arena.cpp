@@ -0,0 +1,74 @@
+// arena.cpp
+#include "arena.hpp"
+#include "memory.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <optional>
+
+namespace {
+    constexpr size_t FIRST_BLOCK = 64 * 1024;
+    constexpr size_t MAX_BLOCK = 64 * 1024 * 1024;
+
+    // Upstream of the monotonic resource once the block runs out; remembers how much
+    // it handed out so the next block can be big enough
+    class OverflowResource : public std::pmr::memory_resource {
+    public:
+        size_t bytes = 0;
+
+    private:
+        void* do_allocate(size_t size, size_t alignment) override {
+            MemoryScope memory(Subsystem::Rebalance);
+            bytes += size;
+            return std::pmr::new_delete_resource()->allocate(size, alignment);
+        }
+
+        void do_deallocate(void* block, size_t size, size_t alignment) override {
+            std::pmr::new_delete_resource()->deallocate(block, size, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+    struct ThreadArena {
+        std::unique_ptr<std::byte[]> block;
+        size_t block_size = FIRST_BLOCK;
+        OverflowResource overflow;
+        std::optional<std::pmr::monotonic_buffer_resource> resource;
+        int depth = 0;
+
+        std::pmr::memory_resource* open() {
+            if (depth++ == 0) {
+                if (!block) {
+                    MemoryScope memory(Subsystem::Rebalance);
+                    block = std::make_unique_for_overwrite<std::byte[]>(block_size);
+                }
+                resource.emplace(block.get(), block_size, &overflow);
+            }
+            return &*resource;
+        }
+
+        void close() {
+            if (--depth > 0) {
+                return;
+            }
+            resource.reset();   // hands the overflow chunks back
+            if (overflow.bytes > 0 && block_size < MAX_BLOCK) {
+                block_size = std::min(MAX_BLOCK, std::bit_ceil(block_size + overflow.bytes));
+                block.reset();
+            }
+            overflow.bytes = 0;
+        }
+    };
+
+    thread_local ThreadArena thread_arena;
+}
+
+ArenaScope::ArenaScope() : arena(thread_arena.open()) {}
+
+ArenaScope::~ArenaScope() {
+    thread_arena.close();
+}
@@ -0,0 +1,29 @@
+// arena.hpp
+#pragma once
+#include <memory_resource>
+
+// Scratch memory for one rebalance.
+//
+// Every thread has one monotonic arena. The outermost ArenaScope on a thread opens it
+// and frees everything allocated from it at once when it closes; scopes nested inside
+// (an allocation within a whole rebalance_portfolio) share it. Containers built on
+// resource() must not outlive the outermost scope, so only temporaries that never
+// reach a result belong in it.
+//
+// The arena keeps its first block between scopes and grows it to the most one scope
+// has needed, so once a thread has warmed up its rebalances do not call malloc for
+// these temporaries and parallel batch workers stop contending for the heap. The
+// blocks are charged to Subsystem::Rebalance (memory.hpp).
+class ArenaScope {
+private:
+    std::pmr::memory_resource* arena;
+
+public:
+    ArenaScope();
+    ~ArenaScope();
+
+    std::pmr::memory_resource* resource() const { return arena; }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+};
@@ -0,0 +1,140 @@
+// bounded_queue.hpp
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Fixed-capacity multi-producer multi-consumer queue without locks (Vyukov's bounded
+// queue). Each cell carries a sequence number that tells producers and consumers
+// whether it is free or full for their lap of the ring, so a push or pop is one CAS
+// on the shared position plus one release store on the cell.
+//
+// push() and pop() wait by spinning briefly and then parking on a counter the other
+// side bumps after each pop or push (std::atomic::wait), so a stage stalled behind a
+// slow one sleeps instead of burning a core. close() ends the stream: pushes fail
+// from then on, and pops drain what is left and then fail. Pipelines close a queue
+// once every producer is done, or early to unblock everyone after an error.
+template <typename T>
+class BoundedQueue {
+private:
+    struct alignas(64) Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> push_position{0};
+    alignas(64) std::atomic<size_t> pop_position{0};
+    alignas(64) std::atomic<bool> closed{false};
+    // Bumped after every push / pop and on close; waiting consumers / producers park
+    // on them. 32 bits so the wait is a plain futex.
+    alignas(64) std::atomic<uint32_t> pushes{0};
+    alignas(64) std::atomic<uint32_t> pops{0};
+
+    static constexpr int SPINS = 64;
+
+    static void wake(std::atomic<uint32_t>& counter) {
+        counter.fetch_add(1, std::memory_order_release);
+        counter.notify_all();
+    }
+
+public:
+    // Capacity is rounded up to a power of two
+    explicit BoundedQueue(size_t capacity)
+        : cells(std::make_unique<Cell[]>(std::bit_ceil(std::max<size_t>(capacity, 2)))),
+          mask(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1) {
+        for (size_t i = 0; i <= mask; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Moves from `value` only if it succeeds
+    bool try_push(T&& value) {
+        size_t position = push_position.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto lap = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (lap == 0) {
+                if (push_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lap < 0) {
+                return false;   // full
+            } else {
+                position = push_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T& value) {
+        size_t position = pop_position.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto lap = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+            if (lap == 0) {
+                if (pop_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lap < 0) {
+                return false;   // empty
+            } else {
+                position = pop_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Waits for room; false if the queue is closed first
+    bool push(T value) {
+        for (int spins = 0;; ++spins) {
+            // Read before trying, so a pop or close after a failed try still wakes us
+            uint32_t seen = pops.load(std::memory_order_acquire);
+            if (closed.load(std::memory_order_acquire)) {
+                return false;
+            }
+            if (try_push(std::move(value))) {
+                wake(pushes);
+                return true;
+            }
+            if (spins >= SPINS) {
+                pops.wait(seen, std::memory_order_acquire);
+            }
+        }
+    }
+
+    // Waits for a value; false once the queue is closed and empty
+    bool pop(T& value) {
+        for (int spins = 0;; ++spins) {
+            uint32_t seen = pushes.load(std::memory_order_acquire);
+            if (try_pop(value)) {
+                wake(pops);
+                return true;
+            }
+            if (closed.load(std::memory_order_acquire)) {
+                return try_pop(value);
+            }
+            if (spins >= SPINS) {
+                pushes.wait(seen, std::memory_order_acquire);
+            }
+        }
+    }
+
+    void close() {
+        closed.store(true, std::memory_order_release);
+        wake(pushes);
+        wake(pops);
+    }
+};
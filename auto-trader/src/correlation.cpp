@@ -0,0 +1,117 @@
+// correlation.cpp
+#include "correlation.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+CorrelationCache::CorrelationCache(size_t window) : window(window) {
+    if (window < 2) {
+        throw std::runtime_error("Correlation window must be at least 2 days");
+    }
+}
+
+CorrelationCache::CorrelationCache(const CorrelationCache& other)
+    : window(other.window),
+      days(other.days),
+      head(other.head),
+      last_date(other.last_date),
+      ids(other.ids),
+      last_close(other.last_close),
+      returns(other.returns),
+      sums(other.sums),
+      sum_squares(other.sum_squares) {
+    std::lock_guard<std::mutex> lock(other.pairs_mutex);
+    cross_products = other.cross_products;
+}
+
+void CorrelationCache::advance(const std::string& date, const std::vector<std::pair<std::string, double>>& closes) {
+    for (const auto& [ticker, _] : closes) {
+        if (ids.emplace(ticker, static_cast<uint32_t>(ids.size())).second) {
+            last_close.push_back(0.0);
+            returns.resize(returns.size() + window, 0.0f);
+            sums.push_back(0.0);
+            sum_squares.push_back(0.0);
+        }
+    }
+
+    // Day's return and the one it pushes out of the window, per ticker
+    const size_t n = ids.size();
+    std::vector<float> incoming(n, 0.0f);
+    std::vector<float> outgoing(n, 0.0f);
+    for (const auto& [ticker, close] : closes) {
+        uint32_t i = ids.at(ticker);
+        if (last_close[i] > 0.0) {
+            incoming[i] = static_cast<float>(close / last_close[i] - 1.0);
+        }
+        last_close[i] = close;
+    }
+    if (days == window) {
+        for (size_t i = 0; i < n; ++i) {
+            outgoing[i] = returns[i * window + head];
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        sums[i] += static_cast<double>(incoming[i]) - outgoing[i];
+        sum_squares[i] += static_cast<double>(incoming[i]) * incoming[i] -
+                          static_cast<double>(outgoing[i]) * outgoing[i];
+        returns[i * window + head] = incoming[i];
+    }
+    for (auto& [key, cross] : cross_products) {
+        uint32_t a = static_cast<uint32_t>(key >> 32);
+        uint32_t b = static_cast<uint32_t>(key);
+        cross += static_cast<double>(incoming[a]) * incoming[b] -
+                 static_cast<double>(outgoing[a]) * outgoing[b];
+    }
+
+    head = (head + 1) % window;
+    days = std::min(days + 1, window);
+    last_date = date;
+}
+
+size_t CorrelationCache::cached_pairs() const {
+    std::lock_guard<std::mutex> lock(pairs_mutex);
+    return cross_products.size();
+}
+
+uint32_t CorrelationCache::id(const std::string& ticker) const {
+    auto it = ids.find(ticker);
+    return it == ids.end() ? npos : it->second;
+}
+
+double CorrelationCache::correlation(uint32_t a, uint32_t b) const {
+    if (a == npos || b == npos || days < 2) {
+        return 0.0;
+    }
+    if (a == b) {
+        return 1.0;
+    }
+
+    double cross;
+    {
+        std::lock_guard<std::mutex> lock(pairs_mutex);
+        auto [it, inserted] = cross_products.try_emplace(pair_key(a, b), 0.0);
+        if (inserted) {
+            // Slots not yet written are zero, so the whole ring can be summed
+            const float* x = returns.data() + static_cast<size_t>(a) * window;
+            const float* y = returns.data() + static_cast<size_t>(b) * window;
+            double sum = 0.0;
+            for (size_t k = 0; k < window; ++k) {
+                sum += static_cast<double>(x[k]) * y[k];
+            }
+            it->second = sum;
+        }
+        cross = it->second;
+    }
+
+    const double count = static_cast<double>(days);
+    double mean_a = sums[a] / count;
+    double mean_b = sums[b] / count;
+    double var_a = sum_squares[a] / count - mean_a * mean_a;
+    double var_b = sum_squares[b] / count - mean_b * mean_b;
+    if (var_a <= 1e-14 || var_b <= 1e-14) {
+        return 0.0;
+    }
+    double corr = (cross / count - mean_a * mean_b) / std::sqrt(var_a * var_b);
+    return std::clamp(corr, -1.0, 1.0);
+}
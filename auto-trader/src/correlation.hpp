@@ -0,0 +1,63 @@
+// correlation.hpp
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Rolling correlations of daily returns over the last `window` trading days.
+//
+// advance() takes one day of closes and updates every ticker's running sum and sum of
+// squares in O(1): the new return is added and the one leaving the window subtracted.
+// Pair cross-products are only computed the first time a pair is asked for (O(window)
+// from the stored returns) and from then on are rolled forward the same way, so a
+// walk-forward backtest that keeps asking about the same shortlist pays O(pairs) per
+// day rather than O(pairs * window).
+//
+// correlation() may be called from several threads at once (the pair cache is behind
+// a mutex); advance() may not run concurrently with anything else.
+class CorrelationCache {
+public:
+    static constexpr uint32_t npos = UINT32_MAX;
+
+private:
+    size_t window;
+    size_t days = 0;    // returns held, at most window
+    size_t head = 0;    // ring slot the next return is written to
+    std::string last_date;
+
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<double> last_close;     // per ticker, 0 until first seen
+    std::vector<float> returns;         // ticker-major ring, window floats per ticker
+    std::vector<double> sums;
+    std::vector<double> sum_squares;
+
+    mutable std::mutex pairs_mutex;
+    mutable std::unordered_map<uint64_t, double> cross_products;
+
+    static uint64_t pair_key(uint32_t a, uint32_t b) {
+        return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+    }
+
+public:
+    explicit CorrelationCache(size_t window);
+    CorrelationCache(const CorrelationCache& other);
+
+    // Appends the returns from the previous closes to these (one ticker, close pair per
+    // ticker quoted on `date`). A ticker missing from `closes` keeps its last close and
+    // gets a zero return for the day.
+    void advance(const std::string& date, const std::vector<std::pair<std::string, double>>& closes);
+
+    size_t get_window() const { return window; }
+    size_t get_days() const { return days; }
+    const std::string& get_date() const { return last_date; }
+    size_t cached_pairs() const;
+
+    uint32_t id(const std::string& ticker) const;
+
+    // Pearson correlation over the returns held; 0 when either series is flat
+    double correlation(uint32_t a, uint32_t b) const;
+};
@@ -0,0 +1,197 @@
+// forest.cpp
+#include "forest.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+    template <typename T>
+    void read_array(std::ifstream& file, std::vector<T>& out, size_t count) {
+        out.resize(count);
+        file.read(reinterpret_cast<char*>(out.data()), static_cast<std::streamsize>(count * sizeof(T)));
+    }
+
+    uint32_t read_u32(std::ifstream& file) {
+        uint32_t value = 0;
+        file.read(reinterpret_cast<char*>(&value), sizeof(value));
+        return value;
+    }
+
+    constexpr uint32_t MAX_FEATURE_NAME = 256;
+}
+
+FlatForest FlatForest::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open forest file: " + path);
+    }
+
+    char magic[4];
+    file.read(magic, sizeof(magic));
+    if (!file || std::memcmp(magic, "RFST", 4) != 0) {
+        throw std::runtime_error("Not a flat forest file: " + path);
+    }
+    if (read_u32(file) != 1) {
+        throw std::runtime_error("Unsupported flat forest version: " + path);
+    }
+
+    uint32_t n_features = read_u32(file);
+    uint32_t n_trees = read_u32(file);
+    uint32_t n_nodes = read_u32(file);
+    if (!file || n_trees == 0) {
+        throw std::runtime_error("Flat forest file has no trees: " + path);
+    }
+
+    // Every count is checked against the bytes left before anything is allocated, so
+    // a corrupt header fails here instead of asking for gigabytes
+    std::streamoff header_end = file.tellg();
+    file.seekg(0, std::ios::end);
+    auto remaining = static_cast<uint64_t>(file.tellg() - header_end);
+    file.seekg(header_end);
+    uint64_t arrays = uint64_t{n_trees} * sizeof(uint32_t) +
+                      uint64_t{n_nodes} * (sizeof(int32_t) + sizeof(float) + sizeof(int32_t));
+    if (uint64_t{n_features} * sizeof(uint32_t) + arrays > remaining) {
+        throw std::runtime_error("Truncated flat forest file: " + path);
+    }
+
+    FlatForest forest;
+    for (uint32_t i = 0; i < n_features; ++i) {
+        uint32_t length = read_u32(file);
+        if (!file || length > MAX_FEATURE_NAME) {
+            throw std::runtime_error("Corrupt flat forest file: " + path);
+        }
+        std::string name(length, '\0');
+        file.read(name.data(), static_cast<std::streamsize>(name.size()));
+        forest.feature_names.push_back(std::move(name));
+    }
+    read_array(file, forest.roots, n_trees);
+    read_array(file, forest.feature, n_nodes);
+    read_array(file, forest.threshold, n_nodes);
+    read_array(file, forest.left, n_nodes);
+
+    if (!file) {
+        throw std::runtime_error("Truncated flat forest file: " + path);
+    }
+
+    // Validate once here so traversal can run without bounds checks; children
+    // always come after their parent, which also rules out cycles
+    for (uint32_t root : forest.roots) {
+        if (root >= n_nodes) {
+            throw std::runtime_error("Corrupt flat forest file: " + path);
+        }
+    }
+    for (uint32_t node = 0; node < n_nodes; ++node) {
+        if (forest.feature[node] >= static_cast<int32_t>(n_features) ||
+            (forest.feature[node] >= 0 &&
+             (forest.left[node] <= static_cast<int32_t>(node) ||
+              static_cast<uint32_t>(forest.left[node]) + 1 >= n_nodes))) {
+            throw std::runtime_error("Corrupt flat forest file: " + path);
+        }
+    }
+
+    return forest;
+}
+
+void FlatForest::predict_batch(const float* rows, size_t num_rows, size_t stride, double* out) const {
+    std::fill(out, out + num_rows, 0.0);
+
+    const int32_t* features = feature.data();
+    const float* thresholds = threshold.data();
+    const int32_t* lefts = left.data();
+
+    for (uint32_t root : roots) {
+        for (size_t r = 0; r < num_rows; ++r) {
+            const float* x = rows + r * stride;
+            int32_t node = static_cast<int32_t>(root);
+            while (features[node] >= 0) {
+                node = lefts[node] + (x[features[node]] > thresholds[node]);
+            }
+            out[r] += thresholds[node];
+        }
+    }
+
+    double scale = 1.0 / static_cast<double>(roots.size());
+    for (size_t r = 0; r < num_rows; ++r) {
+        out[r] *= scale;
+    }
+}
+
+PriceFeature PriceFeature::parse(const std::string& name) {
+    auto suffix = [&](const std::string& prefix) {
+        int n = std::stoi(name.substr(prefix.size()));
+        if (n < 1) {
+            throw std::runtime_error("Invalid forest feature window: " + name);
+        }
+        return n;
+    };
+
+    if (name == "daily_return") {
+        return PriceFeature{Kind::DailyReturn, 1};
+    }
+    if (name.rfind("close_lag_", 0) == 0) {
+        return PriceFeature{Kind::CloseLag, suffix("close_lag_")};
+    }
+    if (name.rfind("ma_", 0) == 0) {
+        return PriceFeature{Kind::MovingAverage, suffix("ma_")};
+    }
+    if (name.rfind("volatility_", 0) == 0) {
+        return PriceFeature{Kind::Volatility, suffix("volatility_")};
+    }
+    throw std::runtime_error("Unsupported forest feature: " + name);
+}
+
+size_t PriceFeature::required_history() const {
+    switch (kind) {
+        case Kind::CloseLag:
+            return static_cast<size_t>(n) + 1;
+        case Kind::MovingAverage:
+        case Kind::Volatility:
+            return static_cast<size_t>(n);
+        case Kind::DailyReturn:
+            return 2;
+    }
+    return 0;
+}
+
+bool compute_price_features(std::span<const double> prices,
+                            const std::vector<PriceFeature>& features,
+                            float* out) {
+    size_t last = prices.size() - 1;
+
+    for (size_t f = 0; f < features.size(); ++f) {
+        const auto& feature = features[f];
+        if (prices.size() < feature.required_history()) {
+            return false;
+        }
+
+        switch (feature.kind) {
+            case PriceFeature::Kind::CloseLag:
+                out[f] = static_cast<float>(prices[last - feature.n]);
+                break;
+            case PriceFeature::Kind::MovingAverage:
+            case PriceFeature::Kind::Volatility: {
+                double sum = 0.0;
+                for (size_t i = prices.size() - feature.n; i < prices.size(); ++i) {
+                    sum += prices[i];
+                }
+                double mean = sum / feature.n;
+                if (feature.kind == PriceFeature::Kind::MovingAverage) {
+                    out[f] = static_cast<float>(mean);
+                    break;
+                }
+                double sq_sum = 0.0;
+                for (size_t i = prices.size() - feature.n; i < prices.size(); ++i) {
+                    sq_sum += (prices[i] - mean) * (prices[i] - mean);
+                }
+                out[f] = static_cast<float>(feature.n > 1 ? std::sqrt(sq_sum / (feature.n - 1)) : 0.0);
+                break;
+            }
+            case PriceFeature::Kind::DailyReturn:
+                out[f] = static_cast<float>((prices[last] - prices[last - 1]) / prices[last - 1]);
+                break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+// forest.hpp
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// Random forest in the flat tree-array format written by
+// time-series-forecast/export_forest.py. Little-endian layout:
+//
+//   char     magic[4] = "RFST"
+//   uint32   version = 1
+//   uint32   n_features, n_trees, n_nodes
+//   n_features x { uint32 length, char name[length] }
+//   uint32   roots[n_trees]
+//   int32    feature[n_nodes]     split feature, -1 for a leaf
+//   float32  threshold[n_nodes]   split threshold on the raw feature, leaf value for a leaf
+//   int32    left[n_nodes]        left child; the right child is always left + 1
+//
+// Trees are stored breadth-first with siblings adjacent, so a step down the tree is
+// `node = left[node] + (x > threshold)` with no branch on the comparison.
+// The exporter folds the training StandardScaler into the thresholds.
+class FlatForest {
+private:
+    std::vector<std::string> feature_names;
+    std::vector<uint32_t> roots;
+    std::vector<int32_t> feature;
+    std::vector<float> threshold;
+    std::vector<int32_t> left;
+
+public:
+    static FlatForest load(const std::string& path);
+
+    const std::vector<std::string>& get_feature_names() const { return feature_names; }
+    size_t num_features() const { return feature_names.size(); }
+    size_t num_trees() const { return roots.size(); }
+
+    // Mean prediction for `rows` feature rows laid out `stride` floats apart.
+    // Trees are the outer loop so each tree stays in cache while the whole batch
+    // walks it.
+    void predict_batch(const float* rows, size_t num_rows, size_t stride, double* out) const;
+};
+
+// The close-price features the forecaster trains on (see create_features in
+// stockpricepredictor.py), evaluated at the last date of a history.
+struct PriceFeature {
+    enum class Kind {
+        CloseLag,       // close_lag_N:  close N days before
+        MovingAverage,  // ma_N:         mean of the last N closes
+        Volatility,     // volatility_N: sample std of the last N closes
+        DailyReturn     // daily_return: last close over previous close, minus one
+    };
+
+    Kind kind;
+    int n;
+
+    static PriceFeature parse(const std::string& name);
+
+    // Closes needed before this feature is defined
+    size_t required_history() const;
+};
+
+// Writes one feature row for the last date of `prices`; false if the history is too short
+bool compute_price_features(std::span<const double> prices,
+                            const std::vector<PriceFeature>& features,
+                            float* out);
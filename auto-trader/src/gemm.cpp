@@ -0,0 +1,151 @@
+// gemm.cpp
+#include "gemm.hpp"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+    // One vector is as wide as the target's SIMD registers so the 4 x 2 accumulator
+    // tile stays in registers (8 of 16 on SSE2/AVX2)
+#if defined(__AVX__)
+    constexpr size_t VL = 8;
+#else
+    constexpr size_t VL = 4;
+#endif
+    typedef float vec __attribute__((vector_size(VL * sizeof(float))));
+
+    constexpr size_t MR = 4;
+    constexpr size_t NR = 2 * VL;
+    constexpr size_t KC = 256;
+    constexpr size_t MC = 128;
+    constexpr size_t NC = 1024;
+
+    inline vec load_vec(const float* p) {
+        vec v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline void store_vec(float* p, vec v) {
+        std::memcpy(p, &v, sizeof(v));
+    }
+
+    // A block as MR-row panels, k-major inside a panel; short panels are zero padded
+    void pack_a(const float* a, size_t lda, size_t mc, size_t kc, float* packed) {
+        for (size_t i0 = 0; i0 < mc; i0 += MR) {
+            for (size_t k = 0; k < kc; ++k) {
+                for (size_t r = 0; r < MR; ++r) {
+                    *packed++ = i0 + r < mc ? a[(i0 + r) * lda + k] : 0.0f;
+                }
+            }
+        }
+    }
+
+    // B block as NR-column panels, k-major inside a panel; short panels are zero padded
+    template <typename LoadB>
+    void pack_b(LoadB load, size_t kc, size_t nc, float* packed) {
+        for (size_t j0 = 0; j0 < nc; j0 += NR) {
+            size_t width = std::min(NR, nc - j0);
+            for (size_t k = 0; k < kc; ++k) {
+                for (size_t j = 0; j < width; ++j) {
+                    packed[j] = load(k, j0 + j);
+                }
+                std::fill(packed + width, packed + NR, 0.0f);
+                packed += NR;
+            }
+        }
+    }
+
+    // C tile (mr x nr, at most MR x NR) += A panel * B panel
+    void micro_kernel(size_t kc, const float* ap, const float* bp,
+                      float* c, size_t ldc, size_t mr, size_t nr) {
+        vec acc[MR][2] = {};
+        for (size_t k = 0; k < kc; ++k) {
+            vec b0 = load_vec(bp);
+            vec b1 = load_vec(bp + VL);
+            for (size_t r = 0; r < MR; ++r) {
+                float a = ap[r];
+                acc[r][0] += a * b0;
+                acc[r][1] += a * b1;
+            }
+            ap += MR;
+            bp += NR;
+        }
+
+        if (mr == MR && nr == NR) {
+            for (size_t r = 0; r < MR; ++r) {
+                float* row = c + r * ldc;
+                store_vec(row, load_vec(row) + acc[r][0]);
+                store_vec(row + VL, load_vec(row + VL) + acc[r][1]);
+            }
+            return;
+        }
+
+        float tile[MR][NR];
+        for (size_t r = 0; r < MR; ++r) {
+            store_vec(tile[r], acc[r][0]);
+            store_vec(tile[r] + VL, acc[r][1]);
+        }
+        for (size_t r = 0; r < mr; ++r) {
+            for (size_t j = 0; j < nr; ++j) {
+                c[r * ldc + j] += tile[r][j];
+            }
+        }
+    }
+
+    template <typename LoadB>
+    void blocked_gemm(size_t m, size_t n, size_t k,
+                      const float* a, size_t lda,
+                      LoadB load_b,
+                      float* c, size_t ldc) {
+        for (size_t i = 0; i < m; ++i) {
+            std::fill(c + i * ldc, c + i * ldc + n, 0.0f);
+        }
+
+        std::vector<float> packed_a(MC * KC);
+        std::vector<float> packed_b(KC * ((std::min(NC, n) + NR - 1) / NR) * NR);
+
+        for (size_t jc = 0; jc < n; jc += NC) {
+            size_t nc = std::min(NC, n - jc);
+            for (size_t pc = 0; pc < k; pc += KC) {
+                size_t kc = std::min(KC, k - pc);
+                pack_b([&](size_t kk, size_t j) { return load_b(pc + kk, jc + j); },
+                       kc, nc, packed_b.data());
+
+                for (size_t ic = 0; ic < m; ic += MC) {
+                    size_t mc = std::min(MC, m - ic);
+                    pack_a(a + ic * lda + pc, lda, mc, kc, packed_a.data());
+
+                    for (size_t jr = 0; jr < nc; jr += NR) {
+                        for (size_t ir = 0; ir < mc; ir += MR) {
+                            micro_kernel(kc,
+                                         packed_a.data() + ir * kc,
+                                         packed_b.data() + jr * kc,
+                                         c + (ic + ir) * ldc + jc + jr, ldc,
+                                         std::min(MR, mc - ir),
+                                         std::min(NR, nc - jr));
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void sgemm(size_t m, size_t n, size_t k,
+           const float* a, size_t lda,
+           const float* b, size_t ldb,
+           float* c, size_t ldc) {
+    blocked_gemm(m, n, k, a, lda,
+                 [=](size_t i, size_t j) { return b[i * ldb + j]; },
+                 c, ldc);
+}
+
+void sgemm_i8(size_t m, size_t n, size_t k,
+              const float* a, size_t lda,
+              const int8_t* b, size_t ldb, const float* b_scales,
+              float* c, size_t ldc) {
+    blocked_gemm(m, n, k, a, lda,
+                 [=](size_t i, size_t j) { return static_cast<float>(b[i * ldb + j]) * b_scales[j]; },
+                 c, ldc);
+}
@@ -0,0 +1,21 @@
+// gemm.hpp
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Row-major single precision matrix multiply, C[m x n] = A[m x k] * B[k x n].
+// Blocked for cache (KC x NC panels of B, MC x KC panels of A, both packed) with a
+// register-tiled micro-kernel written with GCC/Clang vector extensions, so it
+// compiles to SIMD on any target without intrinsics.
+void sgemm(size_t m, size_t n, size_t k,
+           const float* a, size_t lda,
+           const float* b, size_t ldb,
+           float* c, size_t ldc);
+
+// Same product with int8 B and a float scale per column of B (B[i][j] * scales[j]).
+// B is dequantised while it is packed, so each weight is read from memory as one
+// byte and widened once per panel rather than once per row of A.
+void sgemm_i8(size_t m, size_t n, size_t k,
+              const float* a, size_t lda,
+              const int8_t* b, size_t ldb, const float* b_scales,
+              float* c, size_t ldc);
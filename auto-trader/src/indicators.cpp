@@ -0,0 +1,172 @@
+// indicators.cpp
+#include "indicators.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+    constexpr double NaN = std::numeric_limits<double>::quiet_NaN();
+
+    bool uses_ring(const IndicatorNode& node) {
+        return (node.kind == IndicatorKind::SMA || node.kind == IndicatorKind::StdDev) &&
+               node.window > 0;
+    }
+}
+
+Indicator Indicator::close() {
+    return Indicator{IndicatorKind::Close, 0, nullptr};
+}
+
+Indicator Indicator::returns(const Indicator& source) {
+    return Indicator{IndicatorKind::Returns, 0, std::make_shared<const Indicator>(source)};
+}
+
+Indicator Indicator::sma(const Indicator& source, int window) {
+    return Indicator{IndicatorKind::SMA, window, std::make_shared<const Indicator>(source)};
+}
+
+Indicator Indicator::std_dev(const Indicator& source, int window) {
+    return Indicator{IndicatorKind::StdDev, window, std::make_shared<const Indicator>(source)};
+}
+
+Indicator Indicator::ema(const Indicator& source, int window) {
+    if (window <= 0) {
+        throw std::runtime_error("EMA requires a positive window");
+    }
+    return Indicator{IndicatorKind::EMA, window, std::make_shared<const Indicator>(source)};
+}
+
+std::string Indicator::key() const {
+    std::string window_str = window > 0 ? std::to_string(window) : "all";
+    switch (kind) {
+        case IndicatorKind::Close:
+            return "close";
+        case IndicatorKind::Returns:
+            return source->kind == IndicatorKind::Close ? "returns" : "Returns(" + source->key() + ")";
+        case IndicatorKind::SMA:
+            return "SMA(" + source->key() + "," + window_str + ")";
+        case IndicatorKind::StdDev:
+            return "StdDev(" + source->key() + "," + window_str + ")";
+        case IndicatorKind::EMA:
+            return "EMA(" + source->key() + "," + window_str + ")";
+    }
+    throw std::runtime_error("Unknown indicator kind");
+}
+
+int Indicator::required_history() const {
+    int input = source ? source->required_history() : 1;
+    if (input == 0) {
+        return 0;
+    }
+    switch (kind) {
+        case IndicatorKind::Close:
+            return 1;
+        case IndicatorKind::Returns:
+            return input + 1;
+        case IndicatorKind::SMA:
+        case IndicatorKind::StdDev:
+            return window > 0 ? input + window - 1 : 0;
+        case IndicatorKind::EMA:
+            return 0;
+    }
+    throw std::runtime_error("Unknown indicator kind");
+}
+
+int IndicatorGraph::add(const Indicator& indicator) {
+    std::string indicator_key = indicator.key();
+    auto it = key_to_node.find(indicator_key);
+    if (it != key_to_node.end()) {
+        return it->second;
+    }
+
+    // Inputs are interned first so every node comes after its dependencies
+    int input = indicator.source ? add(*indicator.source) : -1;
+
+    int node = static_cast<int>(nodes.size());
+    nodes.push_back(IndicatorNode{indicator.kind, indicator.window, input});
+    keys.push_back(indicator_key);
+    key_to_node.emplace(std::move(indicator_key), node);
+    return node;
+}
+
+IndicatorEvaluator::IndicatorEvaluator(const IndicatorGraph& graph) : graph(graph) {}
+
+const std::vector<double>& IndicatorEvaluator::evaluate(std::span<const double> prices) {
+    const auto& nodes = graph.get_nodes();
+    ring_offsets.assign(nodes.size() + 1, 0);
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        ring_offsets[i + 1] = ring_offsets[i] + (uses_ring(nodes[i]) ? nodes[i].window : 0);
+    }
+    rings.resize(ring_offsets.back());
+    values.assign(nodes.size(), NaN);
+    previous.assign(nodes.size(), NaN);
+    sums.assign(nodes.size(), 0.0);
+    sq_sums.assign(nodes.size(), 0.0);
+    counts.assign(nodes.size(), 0);
+
+    // One pass over time; at each date every node is advanced in topological order
+    // so a node reads its input's value for the same date straight from `values`.
+    for (double price : prices) {
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const auto& node = nodes[i];
+            double x = node.input < 0 ? price : values[node.input];
+
+            if (node.kind == IndicatorKind::Close) {
+                values[i] = x;
+                continue;
+            }
+            if (std::isnan(x)) {
+                values[i] = NaN;
+                continue;
+            }
+
+            switch (node.kind) {
+                case IndicatorKind::Returns: {
+                    values[i] = std::isnan(previous[i]) ? NaN : (x - previous[i]) / previous[i];
+                    previous[i] = x;
+                    break;
+                }
+                case IndicatorKind::EMA: {
+                    double alpha = 2.0 / (node.window + 1);
+                    previous[i] = std::isnan(previous[i]) ? x : previous[i] + alpha * (x - previous[i]);
+                    ++counts[i];
+                    values[i] = counts[i] >= node.window ? previous[i] : NaN;
+                    break;
+                }
+                case IndicatorKind::SMA:
+                case IndicatorKind::StdDev: {
+                    if (uses_ring(node)) {
+                        double* ring = rings.data() + ring_offsets[i];
+                        int slot = counts[i] % node.window;
+                        if (counts[i] >= node.window) {
+                            double old = ring[slot];
+                            sums[i] -= old;
+                            sq_sums[i] -= old * old;
+                        }
+                        ring[slot] = x;
+                    }
+                    sums[i] += x;
+                    sq_sums[i] += x * x;
+                    ++counts[i];
+
+                    int n = node.window > 0 ? std::min(counts[i], node.window) : counts[i];
+                    bool warm = node.window > 0 ? counts[i] >= node.window : true;
+                    if (node.kind == IndicatorKind::SMA) {
+                        values[i] = warm ? sums[i] / n : NaN;
+                    } else if (warm && n > 1) {
+                        double variance = (sq_sums[i] - sums[i] * sums[i] / n) / (n - 1);
+                        values[i] = std::sqrt(std::max(variance, 0.0));
+                    } else {
+                        values[i] = NaN;
+                    }
+                    break;
+                }
+                case IndicatorKind::Close:
+                    break;
+            }
+        }
+    }
+
+    return values;
+}
@@ -0,0 +1,77 @@
+// indicators.hpp
+#pragma once
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class IndicatorKind {
+    Close,
+    Returns,
+    SMA,
+    StdDev,
+    EMA
+};
+
+// Declarative description of an indicator, e.g. Indicator::sma(Indicator::close(), 20).
+// A window <= 0 means an expanding window over the whole history.
+struct Indicator {
+    IndicatorKind kind;
+    int window;
+    std::shared_ptr<const Indicator> source;
+
+    static Indicator close();
+    static Indicator returns(const Indicator& source = close());
+    static Indicator sma(const Indicator& source, int window);
+    static Indicator std_dev(const Indicator& source, int window);
+    static Indicator ema(const Indicator& source, int window);
+
+    // Canonical form such as "SMA(close,20)", used to deduplicate nodes
+    std::string key() const;
+
+    // Closes up to the last date that its last value depends on, or 0 when that is
+    // the whole history (an expanding window, or an EMA, which never forgets its seed)
+    int required_history() const;
+};
+
+struct IndicatorNode {
+    IndicatorKind kind;
+    int window;
+    int input;  // node id of the source, -1 for close
+};
+
+// Deduplicated indicator DAG. Nodes are interned by key and always appended after
+// their inputs, so node order is already a topological order.
+class IndicatorGraph {
+private:
+    std::vector<IndicatorNode> nodes;
+    std::vector<std::string> keys;
+    std::unordered_map<std::string, int> key_to_node;
+
+public:
+    int add(const Indicator& indicator);
+    const std::vector<IndicatorNode>& get_nodes() const { return nodes; }
+    const std::string& key(int node) const { return keys[node]; }
+    size_t size() const { return nodes.size(); }
+};
+
+// Evaluates every node of a graph over one ticker's close history in a single pass
+// over time, keeping only rolling state per node. Returns the value of each node
+// at the last date (NaN while a node is still warming up).
+class IndicatorEvaluator {
+private:
+    const IndicatorGraph& graph;
+    std::vector<double> values;
+    std::vector<double> previous;
+    std::vector<double> sums;
+    std::vector<double> sq_sums;
+    std::vector<int> counts;
+    std::vector<size_t> ring_offsets;
+    std::vector<double> rings;
+
+public:
+    explicit IndicatorEvaluator(const IndicatorGraph& graph);
+
+    const std::vector<double>& evaluate(std::span<const double> prices);
+};
@@ -0,0 +1,290 @@
+// ingest.cpp
+#include "ingest.hpp"
+#include "bounded_queue.hpp"
+#include "memory.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+
+namespace {
+    constexpr size_t QUEUE_CAPACITY = 256;
+    constexpr size_t SCORE_BATCH = 64;
+
+    using Clock = std::chrono::steady_clock;
+
+    // Consecutive lines with the same first field, each ending in '\n'
+    struct Chunk {
+        size_t sequence = 0;
+        std::string ticker;
+        std::string lines;
+    };
+
+    struct ParsedRun {
+        size_t sequence = 0;
+        std::vector<StockData> rows;    // in file order, for the indexer
+        TickerRun run;                  // for the scorers
+    };
+    using ParsedPtr = std::shared_ptr<const ParsedRun>;
+
+    ParsedPtr parse_chunk(Chunk& chunk, size_t adv_window) {
+        TRACE_SCOPE("parse_run");
+        auto parsed = std::make_shared<ParsedRun>();
+        parsed->sequence = chunk.sequence;
+
+        std::istringstream in(std::move(chunk.lines));
+        std::string line;
+        std::vector<std::string> tokens;
+        StockData row;
+        while (std::getline(in, line)) {
+            if (MarketData::parse_csv_line(line, tokens, row)) {
+                parsed->rows.push_back(row);
+            }
+        }
+
+        // Date order keeping the last row of each date, as MarketData::Builder does
+        const auto& rows = parsed->rows;
+        std::vector<uint32_t> order(rows.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return rows[a].date < rows[b].date; });
+
+        TickerRun& run = parsed->run;
+        run.ticker = std::move(chunk.ticker);
+        std::vector<double> volumes;
+        for (size_t k = 0; k < order.size(); ++k) {
+            if (k + 1 < order.size() && rows[order[k + 1]].date == rows[order[k]].date) {
+                continue;
+            }
+            run.dates.push_back(rows[order[k]].date);
+            run.closes.push_back(rows[order[k]].close);
+            volumes.push_back(rows[order[k]].volume);
+        }
+
+        // Same running sum as MarketData, so the filter sees the same figures
+        adv_window = std::max<size_t>(adv_window, 1);
+        run.average_dollar_volumes.resize(run.closes.size());
+        double sum = 0.0;
+        for (size_t r = 0; r < run.closes.size(); ++r) {
+            sum += run.closes[r] * volumes[r];
+            size_t count = r + 1;
+            if (count > adv_window) {
+                size_t leaving = r - adv_window;
+                sum -= run.closes[leaving] * volumes[leaving];
+                count = adv_window;
+            }
+            run.average_dollar_volumes[r] = sum / count;
+        }
+        return parsed;
+    }
+
+    // The first exception from any stage; recording it closes every queue so the
+    // other stages stop waiting
+    class Failure {
+    private:
+        std::mutex mutex;
+        std::exception_ptr error;
+        std::function<void()> close_all;
+
+    public:
+        explicit Failure(std::function<void()> close_all) : close_all(std::move(close_all)) {}
+
+        void record(std::exception_ptr exception) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) {
+                    error = exception;
+                }
+            }
+            close_all();
+        }
+
+        bool failed() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return error != nullptr;
+        }
+
+        void rethrow() {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    };
+}
+
+IngestResult IngestPipeline::load_csv(const std::string& csv_path,
+                                      const ScoreBatch& score,
+                                      unsigned threads,
+                                      size_t adv_window) {
+    TRACE_SCOPE("ingest_pipeline");
+    std::ifstream file(csv_path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open stock data file: " + csv_path);
+    }
+
+    unsigned total = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    unsigned parsers = std::max(1u, total / 2);
+    unsigned scorers = !score ? 0 : total > parsers + 2 ? total - parsers - 2 : 1;
+
+    auto start = Clock::now();
+    auto since_start = [&] { return std::chrono::duration<double>(Clock::now() - start).count(); };
+
+    BoundedQueue<Chunk> chunks(QUEUE_CAPACITY);
+    BoundedQueue<ParsedPtr> to_index(QUEUE_CAPACITY);
+    BoundedQueue<ParsedPtr> to_score(QUEUE_CAPACITY);
+    Failure failure([&] {
+        chunks.close();
+        to_index.close();
+        to_score.close();
+    });
+
+    IngestResult result;
+    MarketData::Builder builder;
+    std::once_flag first_score;
+    // Cleared once a ticker turns up in a second run: the file is not grouped by
+    // ticker, so later runs are likely fragments too and are not worth scoring
+    std::atomic<bool> grouped{true};
+
+    std::vector<std::thread> parser_threads;
+    for (unsigned p = 0; p < parsers; ++p) {
+        parser_threads.emplace_back([&] {
+            try {
+                MemoryScope memory(Subsystem::MarketData);
+                Chunk chunk;
+                while (chunks.pop(chunk)) {
+                    ParsedPtr parsed = parse_chunk(chunk, adv_window);
+                    if (scorers > 0 && !to_score.push(parsed)) break;
+                    if (!to_index.push(std::move(parsed))) break;
+                }
+            } catch (...) {
+                failure.record(std::current_exception());
+            }
+        });
+    }
+
+    // Runs arrive in whatever order the parsers finish them; they are added in file
+    // order so repeated rows resolve as they would in a sequential load
+    std::thread indexer([&] {
+        try {
+            MemoryScope memory(Subsystem::MarketData);
+            std::map<size_t, ParsedPtr> waiting;
+            std::unordered_set<std::string> seen;
+            size_t next = 0;
+            ParsedPtr parsed;
+            while (to_index.pop(parsed)) {
+                waiting.emplace(parsed->sequence, std::move(parsed));
+                for (auto it = waiting.begin(); it != waiting.end() && it->first == next; it = waiting.erase(it), ++next) {
+                    TRACE_SCOPE("index_run");
+                    const ParsedRun& run = *it->second;
+                    if (!seen.insert(run.run.ticker).second) {
+                        result.split_tickers.insert(run.run.ticker);
+                        grouped.store(false, std::memory_order_relaxed);
+                    }
+                    for (const auto& row : run.rows) {
+                        builder.add(row);
+                    }
+                    result.stats.rows += run.rows.size();
+                }
+            }
+        } catch (...) {
+            failure.record(std::current_exception());
+        }
+    });
+
+    std::vector<std::thread> scorer_threads;
+    for (unsigned s = 0; s < scorers; ++s) {
+        scorer_threads.emplace_back([&] {
+            try {
+                std::vector<ParsedPtr> held;
+                std::vector<const TickerRun*> batch;
+                ParsedPtr parsed;
+                while (to_score.pop(parsed)) {
+                    if (!grouped.load(std::memory_order_relaxed)) {
+                        continue;   // keep draining so the parsers never block
+                    }
+                    // Whatever else is already parsed goes in the same batch
+                    held.clear();
+                    held.push_back(std::move(parsed));
+                    while (held.size() < SCORE_BATCH && to_score.try_pop(parsed)) {
+                        held.push_back(std::move(parsed));
+                    }
+                    batch.clear();
+                    for (const auto& run : held) {
+                        batch.push_back(&run->run);
+                    }
+
+                    TRACE_SCOPE("score_runs");
+                    score(batch);
+                    std::call_once(first_score, [&] { result.stats.first_score_seconds = since_start(); });
+                }
+            } catch (...) {
+                failure.record(std::current_exception());
+            }
+        });
+    }
+
+    try {
+        TRACE_SCOPE("read_runs");
+        MemoryScope memory(Subsystem::MarketData);
+        std::string line;
+        std::getline(file, line); // Skip header
+
+        Chunk chunk;
+        size_t sequence = 0;
+        while (std::getline(file, line)) {
+            std::string_view ticker(line.data(), std::min(line.find(','), line.size()));
+            if (ticker != chunk.ticker && !chunk.lines.empty()) {
+                chunk.sequence = sequence++;
+                if (!chunks.push(std::move(chunk))) break;
+                chunk = Chunk{};
+            }
+            if (chunk.lines.empty()) {
+                chunk.ticker = ticker;
+            }
+            chunk.lines += line;
+            chunk.lines += '\n';
+        }
+        if (!chunk.lines.empty()) {
+            chunk.sequence = sequence++;
+            chunks.push(std::move(chunk));
+        }
+        result.stats.runs = sequence;
+    } catch (...) {
+        failure.record(std::current_exception());
+    }
+
+    chunks.close();
+    for (auto& thread : parser_threads) {
+        thread.join();
+    }
+    result.stats.parse_seconds = since_start();
+    to_index.close();
+    to_score.close();
+    indexer.join();
+
+    // Scorers may still be working through the last runs while the data is indexed
+    if (!failure.failed()) {
+        try {
+            MemoryScope memory(Subsystem::MarketData);
+            result.data = builder.finish(adv_window);
+        } catch (...) {
+            failure.record(std::current_exception());
+        }
+    }
+    for (auto& thread : scorer_threads) {
+        thread.join();
+    }
+    failure.rethrow();
+
+    result.stats.total_seconds = since_start();
+    return result;
+}
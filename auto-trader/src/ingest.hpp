@@ -0,0 +1,59 @@
+// ingest.hpp
+#pragma once
+#include "market_data.hpp"
+#include <functional>
+#include <span>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// One run of consecutive CSV rows for the same ticker, as the scoring stage of a
+// pipelined load sees it: sorted by date with repeated dates dropped (the later row
+// wins), and with the rolling average dollar volume MarketData would compute. When the
+// file is grouped by ticker, a run is the ticker's whole history.
+struct TickerRun {
+    std::string ticker;
+    std::vector<std::string> dates;
+    std::vector<double> closes;
+    std::vector<double> average_dollar_volumes;
+};
+
+struct IngestStats {
+    size_t runs = 0;
+    size_t rows = 0;
+    double parse_seconds = 0.0;         // until the last run was parsed
+    double first_score_seconds = 0.0;   // until the first batch of runs had been scored
+    double total_seconds = 0.0;         // until the data was indexed and every run scored
+};
+
+struct IngestResult {
+    MarketData data;
+    // Tickers whose rows were split over several runs; their runs were only part of
+    // their history, so whatever was scored from them should be thrown away
+    std::unordered_set<std::string> split_tickers;
+    IngestStats stats;
+};
+
+// Loads a stock CSV in overlapping stages connected by bounded lock-free queues
+// (bounded_queue.hpp):
+//   reader    the calling thread; reads the file in blocks and cuts it into runs of
+//             lines with the same ticker
+//   parsers   parse runs into rows and sort each into a TickerRun
+//   indexer   adds the rows to a MarketData::Builder in file order
+//   scorers   hand TickerRuns to `score` in batches, as soon as they are parsed
+// so scoring a date starts while later tickers are still being read, and the data
+// comes out exactly as MarketData::load would build it. Scoring stops early if the
+// file turns out not to be grouped by ticker. `score` is called from several
+// threads at once. A full queue makes the stage before it wait, so memory stays
+// bounded however far the reader gets ahead. The first exception from any stage stops
+// the pipeline and is rethrown.
+class IngestPipeline {
+public:
+    using ScoreBatch = std::function<void(std::span<const TickerRun* const>)>;
+
+    // threads = 0 sizes the stages to the machine; `score` may be empty
+    static IngestResult load_csv(const std::string& csv_path,
+                                 const ScoreBatch& score,
+                                 unsigned threads = 0,
+                                 size_t adv_window = MarketData::DEFAULT_ADV_WINDOW);
+};
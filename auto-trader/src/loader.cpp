@@ -1,28 +1,72 @@
 // loader.cpp
 #include "loader.hpp"
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
 #include <sstream>
 
+Portfolio Loader::parse_portfolio(const json& data) {
+    return Portfolio{
+        data.at("id"),
+        data.at("date"),
+        data.at("cash"),
+        data.at("holdings")
+    };
+}
+
 Portfolio Loader::load_portfolio(const std::string& portfolio_path) {
     std::ifstream f(portfolio_path);
     if (!f.is_open()) {
         throw std::runtime_error("Could not open portfolio file");
     }
     
-    json data = json::parse(f);
-    return Portfolio{
-        data["id"],
-        data["date"],
-        data["cash"],
-        data["holdings"]
-    };
+    return parse_portfolio(json::parse(f));
+}
+
+std::vector<Portfolio> Loader::load_portfolios(const std::string& path) {
+    std::vector<Portfolio> portfolios;
+
+    if (std::filesystem::is_directory(path)) {
+        std::vector<std::filesystem::path> files;
+        for (const auto& entry : std::filesystem::directory_iterator(path)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".json") {
+                files.push_back(entry.path());
+            }
+        }
+        std::sort(files.begin(), files.end());
+
+        portfolios.reserve(files.size());
+        for (const auto& file : files) {
+            portfolios.push_back(load_portfolio(file.string()));
+        }
+        return portfolios;
+    }
+
+    std::ifstream f(path);
+    if (!f.is_open()) {
+        throw std::runtime_error("Could not open portfolio file: " + path);
+    }
+
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(f, line)) {
+        ++line_number;
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+        try {
+            portfolios.push_back(parse_portfolio(json::parse(line)));
+        } catch (const json::exception& e) {
+            throw std::runtime_error("Invalid portfolio on line " + std::to_string(line_number) +
+                                     " of " + path + ": " + e.what());
+        }
+    }
+    return portfolios;
 }
 
 std::vector<StockData> Loader::load_stock_data(const std::string& csv_path) {
     std::vector<StockData> result;
     std::ifstream file(csv_path);
     if (!file.is_open()) {
-        throw std::runtime_error("Could not open stock data file");
+        throw std::runtime_error("Could not open stock data file: " + csv_path);
     }
     
     std::string line;
@@ -47,7 +91,7 @@ std::vector<StockData> Loader::load_stock_data(const std::string& csv_path) {
         data.open = std::stod(tokens[4]);
         data.low = std::stod(tokens[5]);
         data.high = std::stod(tokens[6]);
-        data.volume = std::stoi(tokens[7]);
+        data.volume = std::stod(tokens[7]);
         
         result.push_back(data);
     }
@@ -12,11 +12,15 @@ struct StockData {
     double open;
     double low;
     double high;
-    int volume;
+    double volume;
 };
 
 class Loader {
 public:
+    static Portfolio parse_portfolio(const json& data);
     static Portfolio load_portfolio(const std::string& portfolio_path);
+    // A directory of portfolio JSON files (read in filename order) or a JSONL file
+    // with one portfolio per line
+    static std::vector<Portfolio> load_portfolios(const std::string& path);
     static std::vector<StockData> load_stock_data(const std::string& csv_path);
 };
\ No newline at end of file
@@ -1,9 +1,67 @@
 // main.cpp
+#include "memory.hpp"
+#include "perf_counters.hpp"
 #include "portfolio_rebalancer.hpp"
+#include "trace.hpp"
+#include "writer.hpp"
+#include <CLI/CLI.hpp>
+#include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <optional>
+
+int main(int argc, char** argv) {
+    CLI::App app{"Speculate on the stock universe and rebalance portfolios"};
+    std::string batch_path;
+    std::string output_path = "./data/rebalanced.jsonl";
+    std::string netting_path;
+    unsigned threads = 0;
+    std::string allocation = "rank";
+    std::string trace_path;
+    bool counters = false;
+    bool memory = false;
+    app.add_option("--batch", batch_path,
+                   "Directory of portfolio JSON files, or a JSONL file, to rebalance instead of ./data/portfolio.json");
+    app.add_option("--output", output_path, "Where batch results are written, one JSON line per portfolio");
+    app.add_option("--netting", netting_path,
+                   "Net batch trades across accounts and write block orders with per-account allocations here");
+    app.add_option("--threads", threads, "Allocation threads for batch mode (0 = all cores)");
+    app.add_option("--allocation", allocation,
+                   "How target weights are set: rank (default), mean-variance or risk-parity");
+    app.add_option("--trace", trace_path,
+                   "Record phase timings, write them here as a Chrome trace (chrome://tracing, Perfetto) and print a summary");
+    app.add_flag("--counters", counters,
+                 "Count cycles, instructions, cache and branch misses per phase with perf_event_open and print them");
+    app.add_flag("--memory", memory, "Count heap use per subsystem and print it with the peak RSS");
+    CLI11_PARSE(app, argc, argv);
+
+    if (!trace_path.empty()) {
+        Tracer::enable();
+    }
+    if (counters) {
+        Profiler::enable();
+    }
+    if (memory) {
+        MemoryStats::enable();
+    }
+
+    PortfolioRebalancer rebalancer;
+    auto write_reports = [&] {
+        if (!trace_path.empty()) {
+            Tracer::write_chrome_trace(trace_path);
+            std::cout << "\nTrace written to " << trace_path << "\n";
+            Tracer::write_summary(std::cout);
+        }
+        if (counters) {
+            std::cout << "\n";
+            Profiler::write_report(std::cout);
+        }
+        if (memory) {
+            std::cout << "\n";
+            MemoryStats::write_report(std::cout, rebalancer.cached_prices());
+        }
+    };
 
-int main() {
     // CUSTOMIZE THESE THESE
     const int lookback_period = 50; // this is the period of historical data (in trading days) we look backwards
     const int holding_window = 10; // this is the number of trading days ahead we are speculating on
@@ -11,12 +69,76 @@ int main() {
     const int max_sector_lead = 5; // the max allowed difference between the most and least represesnted sector in our portfolio
     const double adjust_by = 1.0; // as we get from 0 to 1, we perscribe more and more adjustment to our portfolio
 
+    RebalanceOptions options;
+    options.optimizer.risk_aversion = 4.0; // mean-variance penalty on holding-window variance against speculated ROI
+    options.optimizer.max_weight = 0.10; // largest share of the portfolio any one stock may take
+    options.optimizer.max_sector_weight = 0.35; // largest share of the portfolio any one sector may take
+    options.optimizer.lookback_period = 120; // trading days of returns the covariance is estimated from
+    options.max_correlation = 1.0; // below 1, new picks this correlated with an earlier pick are skipped
+    options.correlation_window = 60; // trading days of returns those correlations are measured over
+    options.risk.lookback_period = 250; // trading days of history the risk report simulates (0 skips it)
+    options.risk.confidence = 0.95; // VaR / CVaR confidence level
+    options.universe.min_adv = 0.0; // tickers trading less than this many dollars a day (20 day average) are not scored
+    options.universe.min_price = 0.0; // nor are tickers priced below this
+    options.universe.max_position_pct_adv = 0.0; // positions aren't built past this percentage of a day's dollar volume (0 = no cap)
+    options.history_days = 0; // trading days of bars loaded before the rebalance date (0 = the whole file); at least the strategy's required_history(), and the whole file for a strategy that needs all of it, like MovingAverageStrategy
+    if (allocation == "mean-variance") {
+        options.optimizer.mode = AllocationMode::MeanVariance;
+    } else if (allocation == "risk-parity") {
+        options.optimizer.mode = AllocationMode::RiskParity;
+    } else if (allocation != "rank") {
+        std::cerr << "Unknown allocation mode: " << allocation << std::endl;
+        return 1;
+    }
+
     auto speculation_strategy = std::make_unique<MovingAverageStrategy>(
         std::min(lookback_period, 20),
         std::min(lookback_period, 50)
     );
 
-    PortfolioRebalancer rebalancer;
+    if (!batch_path.empty()) {
+        try {
+            // Built by rebalance_batch over the tickers it loads
+            std::optional<TradeNetter> netter;
+
+            auto stats = rebalancer.rebalance_batch(
+                *speculation_strategy,
+                batch_path,
+                output_path,
+                holding_window,
+                max_holdings,
+                max_sector_lead,
+                adjust_by,
+                options,
+                threads,
+                netting_path.empty() ? nullptr : &netter
+            );
+
+            std::cout << "Rebalanced " << stats.portfolios - stats.failed << " of " << stats.portfolios
+                      << " portfolios across " << stats.dates << " date(s) into " << output_path << "\n";
+            std::cout << std::fixed << std::setprecision(3)
+                      << "Ranking: " << stats.ranking_seconds << "s, allocation: "
+                      << stats.allocation_seconds << "s\n";
+
+            if (netter) {
+                auto netting = netter->net();
+                std::ofstream netting_file(netting_path);
+                if (!netting_file.is_open()) {
+                    throw std::runtime_error("Could not open netting output file for writing");
+                }
+                Writer::write_block_orders(netting_file, netting);
+
+                std::cout << "Netted " << netting.actions << " trades into " << netting.block_orders.size()
+                          << " block orders: " << netting.market_shares << " of " << netting.gross_shares
+                          << " shares go to market\n";
+            }
+            write_reports();
+        } catch (const std::exception& e) {
+            std::cerr << "\nError: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
 
     try {
         auto [actions, rebalance_summary, new_portfolio] = rebalancer.rebalance_portfolio(
@@ -24,7 +146,8 @@ int main() {
             holding_window,
             max_holdings,
             max_sector_lead,
-            adjust_by
+            adjust_by,
+            options
         );
 
         // Print results
@@ -54,6 +177,19 @@ int main() {
             std::cout << "Total actual net capital: $" << *rebalance_summary.total_actual_net_capital << "\n";
         }
 
+        if (rebalance_summary.old_risk && rebalance_summary.new_risk) {
+            const auto& before = *rebalance_summary.old_risk;
+            const auto& after = *rebalance_summary.new_risk;
+            std::cout << "Risk (" << options.risk.lookback_period << " day history, "
+                      << options.risk.confidence * 100 << "% confidence), before -> after:\n";
+            std::cout << "  Daily volatility: " << before.volatility * 100 << "% -> " << after.volatility * 100 << "%\n";
+            std::cout << "  One-day VaR: $" << before.value_at_risk << " -> $" << after.value_at_risk << "\n";
+            std::cout << "  One-day CVaR: $" << before.conditional_value_at_risk
+                      << " -> $" << after.conditional_value_at_risk << "\n";
+            std::cout << "  Max drawdown: " << before.max_drawdown * 100 << "% -> " << after.max_drawdown * 100 << "%\n";
+        }
+        write_reports();
+
     } catch (const std::exception& e) {
         std::cerr << "\nError: " << e.what() << std::endl;
         return 1;
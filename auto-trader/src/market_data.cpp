@@ -0,0 +1,1013 @@
+// market_data.cpp
+#include "market_data.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
+
+// Rows as they arrive, with dates and tickers interned in first-seen order
+struct MarketData::Builder::Staging {
+    std::unordered_map<std::string, uint32_t> date_ids;
+    std::unordered_map<std::string, uint32_t> ticker_ids;
+    std::vector<std::string> sectors;                           // per ticker
+    std::vector<std::set<std::string>> date_sectors;
+    std::vector<uint32_t> dates;
+    std::vector<uint32_t> tickers;
+    std::vector<double> closes, opens, lows, highs, volumes;
+
+    void add(const std::string& ticker, const std::string& sector, const std::string& date,
+             double close, double open, double low, double high, double volume) {
+        auto [date_it, new_date] = date_ids.try_emplace(date, static_cast<uint32_t>(date_ids.size()));
+        if (new_date) {
+            date_sectors.emplace_back();
+        }
+        auto [ticker_it, new_ticker] = ticker_ids.try_emplace(ticker, static_cast<uint32_t>(ticker_ids.size()));
+        if (new_ticker) {
+            sectors.emplace_back();
+        }
+        sectors[ticker_it->second] = sector;
+        date_sectors[date_it->second].insert(sector);
+
+        dates.push_back(date_it->second);
+        tickers.push_back(ticker_it->second);
+        closes.push_back(close);
+        opens.push_back(open);
+        lows.push_back(low);
+        highs.push_back(high);
+        volumes.push_back(volume);
+    }
+};
+
+namespace {
+    // Sorts interned names and returns old id -> sorted id
+    std::vector<uint32_t> sort_names(const std::unordered_map<std::string, uint32_t>& ids,
+                                     std::vector<std::string>& names) {
+        names.resize(ids.size());
+        for (const auto& [name, id] : ids) {
+            names[id] = name;
+        }
+        std::vector<uint32_t> order(names.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return names[a] < names[b]; });
+
+        std::vector<uint32_t> remap(names.size());
+        std::vector<std::string> sorted(names.size());
+        for (uint32_t i = 0; i < order.size(); ++i) {
+            remap[order[i]] = i;
+            sorted[i] = std::move(names[order[i]]);
+        }
+        names = std::move(sorted);
+        return remap;
+    }
+
+    // Gathers `column` into `rows` order, releasing the staged copy
+    template <typename T>
+    std::vector<T> gather(std::vector<T>& column, const std::vector<uint32_t>& rows) {
+        std::vector<T> result(rows.size());
+        for (size_t i = 0; i < rows.size(); ++i) {
+            result[i] = column[rows[i]];
+        }
+        std::vector<T>().swap(column);
+        return result;
+    }
+}
+
+MarketData::Builder::Builder() : staging(std::make_unique<Staging>()) {}
+MarketData::Builder::~Builder() = default;
+MarketData::Builder::Builder(Builder&&) noexcept = default;
+MarketData::Builder& MarketData::Builder::operator=(Builder&&) noexcept = default;
+
+void MarketData::Builder::add(const std::string& ticker, const std::string& sector, const std::string& date,
+                              double close, double open, double low, double high, double volume) {
+    staging->add(ticker, sector, date, close, open, low, high, volume);
+}
+
+MarketData MarketData::Builder::finish(size_t adv_window) {
+    TRACE_SCOPE("index_market_data");
+    Staging staging = std::move(*this->staging);
+    *this->staging = Staging();
+    MarketData data;
+    data.adv_window = std::max<size_t>(adv_window, 1);
+
+    auto date_remap = sort_names(staging.date_ids, data.dates);
+    auto ticker_remap = sort_names(staging.ticker_ids, data.tickers);
+    const size_t n_dates = data.dates.size();
+    const size_t n_tickers = data.tickers.size();
+
+    data.ticker_ids.reserve(n_tickers);
+    data.sectors.resize(n_tickers);
+    for (uint32_t t = 0; t < n_tickers; ++t) {
+        data.ticker_ids.emplace(data.tickers[t], t);
+    }
+    for (size_t old = 0; old < n_tickers; ++old) {
+        data.sectors[ticker_remap[old]] = std::move(staging.sectors[old]);
+    }
+    data.date_sectors.resize(n_dates);
+    for (size_t old = 0; old < n_dates; ++old) {
+        data.date_sectors[date_remap[old]] = std::move(staging.date_sectors[old]);
+    }
+
+    for (auto& date : staging.dates) date = date_remap[date];
+    for (auto& ticker : staging.tickers) ticker = ticker_remap[ticker];
+
+    // Order rows by (ticker, date), keeping file order so the last duplicate wins
+    std::vector<uint32_t> order(staging.dates.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return staging.tickers[a] != staging.tickers[b] ? staging.tickers[a] < staging.tickers[b]
+                                                        : staging.dates[a] < staging.dates[b];
+    });
+    std::vector<uint32_t> rows;
+    rows.reserve(order.size());
+    for (size_t k = 0; k < order.size(); ++k) {
+        if (k + 1 < order.size() && staging.tickers[order[k + 1]] == staging.tickers[order[k]] &&
+            staging.dates[order[k + 1]] == staging.dates[order[k]]) {
+            continue;
+        }
+        rows.push_back(order[k]);
+    }
+    std::vector<uint32_t>().swap(order);
+
+    data.row_tickers = gather(staging.tickers, rows);
+    data.row_dates = gather(staging.dates, rows);
+    data.closes = gather(staging.closes, rows);
+    data.opens = gather(staging.opens, rows);
+    data.lows = gather(staging.lows, rows);
+    data.highs = gather(staging.highs, rows);
+    data.volumes = gather(staging.volumes, rows);
+    const size_t n_rows = rows.size();
+
+    data.row_offsets.assign(n_tickers + 1, 0);
+    for (uint32_t ticker : data.row_tickers) {
+        ++data.row_offsets[ticker + 1];
+    }
+    std::partial_sum(data.row_offsets.begin(), data.row_offsets.end(), data.row_offsets.begin());
+
+    // Rolling average dollar volume per ticker
+    data.average_dollar_volumes.resize(n_rows);
+    for (size_t t = 0; t < n_tickers; ++t) {
+        double sum = 0.0;
+        for (uint32_t r = data.row_offsets[t]; r < data.row_offsets[t + 1]; ++r) {
+            sum += data.closes[r] * data.volumes[r];
+            size_t count = r - data.row_offsets[t] + 1;
+            if (count > data.adv_window) {
+                uint32_t leaving = r - static_cast<uint32_t>(data.adv_window);
+                sum -= data.closes[leaving] * data.volumes[leaving];
+                count = data.adv_window;
+            }
+            data.average_dollar_volumes[r] = sum / count;
+        }
+    }
+
+    // Rows by date; rows are already in ticker order, so each date's list is too
+    data.date_offsets.assign(n_dates + 1, 0);
+    for (uint32_t date : data.row_dates) {
+        ++data.date_offsets[date + 1];
+    }
+    std::partial_sum(data.date_offsets.begin(), data.date_offsets.end(), data.date_offsets.begin());
+    data.date_rows.resize(n_rows);
+    std::vector<uint32_t> next(data.date_offsets.begin(), data.date_offsets.end() - 1);
+    for (uint32_t r = 0; r < n_rows; ++r) {
+        data.date_rows[next[data.row_dates[r]]++] = r;
+    }
+
+    return data;
+}
+
+namespace {
+    constexpr char BAR_FILE_MAGIC[4] = {'M', 'K', 'T', 'B'};
+    constexpr uint32_t BAR_FILE_VERSION = 1;
+
+    uint32_t read_u32(std::ifstream& file) {
+        uint32_t value = 0;
+        file.read(reinterpret_cast<char*>(&value), sizeof(value));
+        return value;
+    }
+
+    std::string read_string(std::ifstream& file) {
+        std::string value(read_u32(file), '\0');
+        file.read(value.data(), static_cast<std::streamsize>(value.size()));
+        return value;
+    }
+
+    // Bytes from the read position to the end of the file
+    uint64_t bytes_left(std::ifstream& file) {
+        std::streamoff position = file.tellg();
+        file.seekg(0, std::ios::end);
+        std::streamoff end = file.tellg();
+        file.seekg(position);
+        return position < 0 || end < position ? 0 : static_cast<uint64_t>(end - position);
+    }
+
+    // Counts down the bytes left in a file, so every count and length read from it
+    // is checked against what the file can still hold before anything is allocated
+    // for it. A corrupt header then fails instead of asking for gigabytes.
+    struct ByteBudget {
+        uint64_t remaining;
+        const char* error;
+        const std::string& path;
+
+        void take(uint64_t bytes) {
+            if (bytes > remaining) {
+                throw std::runtime_error(error + path);
+            }
+            remaining -= bytes;
+        }
+
+        uint32_t read_count(std::ifstream& file, uint64_t bytes_each) {
+            take(sizeof(uint32_t));
+            uint32_t count = read_u32(file);
+            if (count > remaining / bytes_each) {
+                throw std::runtime_error(error + path);
+            }
+            return count;
+        }
+
+        std::string read_string(std::ifstream& file) {
+            std::string value(read_count(file, 1), '\0');
+            take(value.size());
+            file.read(value.data(), static_cast<std::streamsize>(value.size()));
+            return value;
+        }
+    };
+
+    template <typename T>
+    void read_append(std::ifstream& file, std::vector<T>& out, size_t count) {
+        size_t size = out.size();
+        out.resize(size + count);
+        file.read(reinterpret_cast<char*>(out.data() + size), static_cast<std::streamsize>(count * sizeof(T)));
+    }
+
+    void write_u32(std::ofstream& file, uint32_t value) {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void write_string(std::ofstream& file, const std::string& value) {
+        write_u32(file, static_cast<uint32_t>(value.size()));
+        file.write(value.data(), static_cast<std::streamsize>(value.size()));
+    }
+
+    template <typename T>
+    void write_array(std::ofstream& file, const std::vector<T>& values) {
+        file.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+    }
+}
+
+namespace {
+    // Everything before the first row group
+    struct BarFileHeader {
+        std::vector<std::string> sector_names;
+        std::vector<std::string> ticker_names;
+        std::vector<uint32_t> ticker_sectors;
+        std::vector<std::string> date_names;
+    };
+
+    // Reads from just after the magic
+    BarFileHeader read_bar_header(std::ifstream& file, const std::string& path) {
+        if (read_u32(file) != BAR_FILE_VERSION) {
+            throw std::runtime_error("Unsupported bar file version: " + path);
+        }
+
+        // Each string takes at least its length, each ticker that and its sector id
+        BarFileHeader header;
+        ByteBudget budget{bytes_left(file), "Bad bar file header: ", path};
+        header.sector_names.resize(budget.read_count(file, sizeof(uint32_t)));
+        for (auto& name : header.sector_names) {
+            name = budget.read_string(file);
+        }
+        uint32_t n_tickers = budget.read_count(file, 2 * sizeof(uint32_t));
+        for (uint32_t t = 0; t < n_tickers && file; ++t) {
+            header.ticker_names.push_back(budget.read_string(file));
+            budget.take(sizeof(uint32_t));
+            header.ticker_sectors.push_back(read_u32(file));
+            if (header.ticker_sectors.back() >= header.sector_names.size()) {
+                throw std::runtime_error("Bad sector id in bar file: " + path);
+            }
+        }
+        uint32_t n_dates = budget.read_count(file, sizeof(uint32_t));
+        for (uint32_t d = 0; d < n_dates && file; ++d) {
+            header.date_names.push_back(budget.read_string(file));
+        }
+        if (!file) {
+            throw std::runtime_error("Bad bar file header: " + path);
+        }
+        return header;
+    }
+
+    struct BarGroupBounds {
+        uint32_t rows;
+        uint32_t min_ticker, max_ticker, min_date, max_date;
+    };
+    constexpr size_t BAR_GROUP_HEADER_BYTES = 5 * sizeof(uint32_t);
+    constexpr size_t BAR_ROW_BYTES = 2 * sizeof(uint32_t) + 5 * sizeof(double);
+}
+
+void MarketData::Builder::read_bar_file(std::ifstream& file, const std::string& path) {
+    Staging& staging = *this->staging;
+    BarFileHeader header = read_bar_header(file, path);
+    const auto& sector_names = header.sector_names;
+    const auto& ticker_sectors = header.ticker_sectors;
+    uint32_t n_tickers = static_cast<uint32_t>(header.ticker_names.size());
+    uint32_t n_dates = static_cast<uint32_t>(header.date_names.size());
+    for (uint32_t t = 0; t < n_tickers; ++t) {
+        staging.ticker_ids.emplace(std::move(header.ticker_names[t]), t);
+        staging.sectors.push_back(sector_names[ticker_sectors[t]]);
+    }
+    for (uint32_t d = 0; d < n_dates; ++d) {
+        staging.date_ids.emplace(std::move(header.date_names[d]), d);
+    }
+    if (staging.ticker_ids.size() != n_tickers || staging.date_ids.size() != n_dates) {
+        throw std::runtime_error("Bad bar file header: " + path);
+    }
+
+    std::vector<uint8_t> sector_seen(static_cast<size_t>(n_dates) * sector_names.size(), 0);
+    ByteBudget budget{bytes_left(file), "Truncated bar file: ", path};
+    while (true) {
+        uint32_t rows = read_u32(file);
+        if (!file) break;
+        for (int i = 0; i < 4; ++i) {
+            read_u32(file);  // group min/max ids, for readers that skip groups
+        }
+        budget.take(BAR_GROUP_HEADER_BYTES + uint64_t{rows} * BAR_ROW_BYTES);
+
+        size_t first = staging.tickers.size();
+        read_append(file, staging.tickers, rows);
+        read_append(file, staging.dates, rows);
+        read_append(file, staging.closes, rows);
+        read_append(file, staging.opens, rows);
+        read_append(file, staging.lows, rows);
+        read_append(file, staging.highs, rows);
+        read_append(file, staging.volumes, rows);
+        if (!file) {
+            throw std::runtime_error("Truncated bar file: " + path);
+        }
+
+        for (size_t r = first; r < staging.tickers.size(); ++r) {
+            if (staging.tickers[r] >= n_tickers || staging.dates[r] >= n_dates) {
+                throw std::runtime_error("Bad row in bar file: " + path);
+            }
+            sector_seen[staging.dates[r] * sector_names.size() + ticker_sectors[staging.tickers[r]]] = 1;
+        }
+    }
+
+    staging.date_sectors.resize(n_dates);
+    for (uint32_t d = 0; d < n_dates; ++d) {
+        for (size_t sector = 0; sector < sector_names.size(); ++sector) {
+            if (sector_seen[d * sector_names.size() + sector]) {
+                staging.date_sectors[d].insert(sector_names[sector]);
+            }
+        }
+    }
+}
+
+void MarketData::Builder::read_bar_file(std::ifstream& file, const std::string& path,
+                                        const LoadQuery& query, LoadStats& stats) {
+    Staging& staging = *this->staging;
+    BarFileHeader header = read_bar_header(file, path);
+    const size_t n_sectors = header.sector_names.size();
+    const size_t n_tickers = header.ticker_names.size();
+    const size_t n_dates = header.date_names.size();
+
+    // Which ids the query allows, with running counts so a group's id range can be
+    // checked for any allowed id in O(1)
+    std::vector<uint8_t> ticker_allowed(n_tickers), date_allowed(n_dates);
+    std::vector<uint32_t> tickers_before(n_tickers + 1, 0), dates_before(n_dates + 1, 0);
+    for (size_t t = 0; t < n_tickers; ++t) {
+        const std::string& sector = header.sector_names[header.ticker_sectors[t]];
+        ticker_allowed[t] = (query.tickers.empty() || query.tickers.count(header.ticker_names[t])) &&
+                            (query.sectors.empty() || query.sectors.count(sector));
+        tickers_before[t + 1] = tickers_before[t] + ticker_allowed[t];
+    }
+    for (size_t d = 0; d < n_dates; ++d) {
+        const std::string& date = header.date_names[d];
+        date_allowed[d] = (query.first_date.empty() || date >= query.first_date) &&
+                          (query.last_date.empty() || date <= query.last_date);
+        dates_before[d + 1] = dates_before[d] + date_allowed[d];
+    }
+    auto any_allowed = [](const std::vector<uint32_t>& before, uint32_t min, uint32_t max) {
+        // Out of range ids are read, so the row check reports them. In size_t, so an
+        // id of UINT32_MAX does not wrap past the range check.
+        return size_t{max} + 1 >= before.size() || min > max || before[size_t{max} + 1] > before[min];
+    };
+
+    // File ids -> staged ids, interned on first use so nothing the query dropped
+    // shows up as a ticker or date without rows
+    constexpr uint32_t unseen = UINT32_MAX;
+    std::vector<uint32_t> staged_tickers(n_tickers, unseen), staged_dates(n_dates, unseen);
+    std::vector<uint8_t> sector_seen(n_dates * n_sectors, 0);
+
+    std::vector<uint32_t> tickers, dates;
+    std::vector<double> closes, opens, lows, highs, volumes;
+    ByteBudget budget{bytes_left(file), "Truncated bar file: ", path};
+    while (true) {
+        BarGroupBounds group;
+        file.read(reinterpret_cast<char*>(&group), sizeof(group));
+        if (!file) break;
+        budget.take(BAR_GROUP_HEADER_BYTES + uint64_t{group.rows} * BAR_ROW_BYTES);
+        stats.bytes_read += BAR_GROUP_HEADER_BYTES;
+        if (!any_allowed(tickers_before, group.min_ticker, group.max_ticker) ||
+            !any_allowed(dates_before, group.min_date, group.max_date)) {
+            file.seekg(static_cast<std::streamoff>(group.rows * BAR_ROW_BYTES), std::ios::cur);
+            ++stats.blocks_skipped;
+            continue;
+        }
+
+        for (auto* column : {&tickers, &dates}) column->clear();
+        for (auto* column : {&closes, &opens, &lows, &highs, &volumes}) column->clear();
+        read_append(file, tickers, group.rows);
+        read_append(file, dates, group.rows);
+        read_append(file, closes, group.rows);
+        read_append(file, opens, group.rows);
+        read_append(file, lows, group.rows);
+        read_append(file, highs, group.rows);
+        read_append(file, volumes, group.rows);
+        if (!file) {
+            throw std::runtime_error("Truncated bar file: " + path);
+        }
+        ++stats.blocks_read;
+        stats.bytes_read += group.rows * BAR_ROW_BYTES;
+        stats.rows_read += group.rows;
+
+        for (uint32_t r = 0; r < group.rows; ++r) {
+            uint32_t ticker = tickers[r], date = dates[r];
+            if (ticker >= n_tickers || date >= n_dates) {
+                throw std::runtime_error("Bad row in bar file: " + path);
+            }
+            if (!ticker_allowed[ticker] || !date_allowed[date]) {
+                continue;
+            }
+            if (staged_tickers[ticker] == unseen) {
+                staged_tickers[ticker] = static_cast<uint32_t>(staging.ticker_ids.size());
+                staging.ticker_ids.emplace(header.ticker_names[ticker], staged_tickers[ticker]);
+                staging.sectors.push_back(header.sector_names[header.ticker_sectors[ticker]]);
+            }
+            if (staged_dates[date] == unseen) {
+                staged_dates[date] = static_cast<uint32_t>(staging.date_ids.size());
+                staging.date_ids.emplace(header.date_names[date], staged_dates[date]);
+                staging.date_sectors.emplace_back();
+            }
+            uint8_t& seen = sector_seen[date * n_sectors + header.ticker_sectors[ticker]];
+            if (!seen) {
+                seen = 1;
+                staging.date_sectors[staged_dates[date]].insert(header.sector_names[header.ticker_sectors[ticker]]);
+            }
+
+            staging.tickers.push_back(staged_tickers[ticker]);
+            staging.dates.push_back(staged_dates[date]);
+            staging.closes.push_back(closes[r]);
+            staging.opens.push_back(opens[r]);
+            staging.lows.push_back(lows[r]);
+            staging.highs.push_back(highs[r]);
+            staging.volumes.push_back(volumes[r]);
+            ++stats.rows_kept;
+        }
+    }
+}
+
+namespace {
+    // Sparse index over a stock CSV, kept beside it as <csv>.idx:
+    //   char[4]  magic "MKTI"
+    //   uint32   version
+    //   uint64   size of the CSV it was built from
+    //   int64    modification time of the CSV it was built from
+    //   uint32   sector count, then each sector as uint32 length + bytes
+    //   uint32   date count, then each distinct date, sorted, as uint32 length + bytes
+    //   uint32   block count, then each block {
+    //     uint64   byte offset of its first row, byte length of its rows
+    //     string   min_date, max_date, min_ticker, max_ticker    (uint32 length + bytes)
+    //     uint64   sector mask: bit s for sector s of the table; bit 63 stands for
+    //              sector 63 and every one after it
+    //   }
+    // A block is CSV_BLOCK_ROWS consecutive lines, so a query reads only the blocks
+    // whose bounds it overlaps. The size and modification time tell when the CSV has
+    // changed and the index must be rebuilt.
+    constexpr char CSV_INDEX_MAGIC[4] = {'M', 'K', 'T', 'I'};
+    constexpr uint32_t CSV_INDEX_VERSION = 1;
+    constexpr size_t CSV_BLOCK_ROWS = 128;
+
+    struct CsvBlock {
+        uint64_t offset = 0;
+        uint64_t bytes = 0;
+        std::string min_date, max_date, min_ticker, max_ticker;
+        uint64_t sectors = 0;
+    };
+
+    struct CsvIndex {
+        uint64_t csv_size = 0;
+        int64_t csv_mtime = 0;
+        std::vector<std::string> sectors;
+        std::vector<std::string> dates;
+        std::vector<CsvBlock> blocks;
+
+        uint64_t sector_bit(size_t sector) const { return uint64_t{1} << std::min<size_t>(sector, 63); }
+    };
+
+    void write_u64(std::ofstream& file, uint64_t value) {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    uint64_t read_u64(std::ifstream& file) {
+        uint64_t value = 0;
+        file.read(reinterpret_cast<char*>(&value), sizeof(value));
+        return value;
+    }
+
+    std::pair<uint64_t, int64_t> csv_version(const std::string& csv_path) {
+        namespace fs = std::filesystem;
+        return {fs::file_size(csv_path), static_cast<int64_t>(fs::last_write_time(csv_path).time_since_epoch().count())};
+    }
+
+    // One pass over the ticker, sector and date of every line
+    CsvIndex build_csv_index(std::ifstream& file, const std::string& csv_path) {
+        TRACE_SCOPE("index_csv");
+        CsvIndex index;
+        std::tie(index.csv_size, index.csv_mtime) = csv_version(csv_path);
+        std::unordered_map<std::string, size_t> sector_ids;
+        std::set<std::string> dates;
+
+        std::string line;
+        std::getline(file, line); // Skip header
+        uint64_t offset = static_cast<uint64_t>(file.tellg());
+        CsvBlock block;
+        size_t rows = 0;
+        bool bounded = false;
+        auto close_block = [&] {
+            if (rows > 0) {
+                index.blocks.push_back(std::move(block));
+            }
+            block = CsvBlock{};
+            rows = 0;
+            bounded = false;
+        };
+
+        while (std::getline(file, line)) {
+            if (rows == 0) {
+                block.offset = offset;
+            }
+            offset = file.eof() ? index.csv_size : offset + line.size() + 1;   // last line may lack a newline
+            block.bytes = offset - block.offset;
+            ++rows;
+
+            // Lines short of three fields never load, so they do not widen the bounds
+            size_t sector_end = line.find(',');
+            size_t date_end = sector_end == std::string::npos ? sector_end : line.find(',', sector_end + 1);
+            if (date_end != std::string::npos) {
+                std::string ticker = line.substr(0, sector_end);
+                std::string sector = line.substr(sector_end + 1, date_end - sector_end - 1);
+                std::string date = line.substr(date_end + 1, line.find(',', date_end + 1) - date_end - 1);
+                auto [it, added] = sector_ids.try_emplace(sector, index.sectors.size());
+                if (added) {
+                    index.sectors.push_back(sector);
+                }
+                block.sectors |= index.sector_bit(it->second);
+                if (!bounded) {
+                    block.min_date = block.max_date = date;
+                    block.min_ticker = block.max_ticker = ticker;
+                    bounded = true;
+                } else {
+                    block.min_date = std::min(block.min_date, date);
+                    block.max_date = std::max(block.max_date, date);
+                    block.min_ticker = std::min(block.min_ticker, ticker);
+                    block.max_ticker = std::max(block.max_ticker, ticker);
+                }
+                dates.insert(std::move(date));
+            }
+            if (rows == CSV_BLOCK_ROWS) {
+                close_block();
+            }
+        }
+        close_block();
+        index.dates.assign(dates.begin(), dates.end());
+        return index;
+    }
+
+    void write_csv_index(const CsvIndex& index, const std::string& index_path) {
+        // Written aside and renamed into place, so a reader never sees half an index
+        std::string temporary = index_path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary);
+            if (!file.is_open()) {
+                return;
+            }
+            file.write(CSV_INDEX_MAGIC, sizeof(CSV_INDEX_MAGIC));
+            write_u32(file, CSV_INDEX_VERSION);
+            write_u64(file, index.csv_size);
+            write_u64(file, static_cast<uint64_t>(index.csv_mtime));
+            write_u32(file, static_cast<uint32_t>(index.sectors.size()));
+            for (const auto& sector : index.sectors) {
+                write_string(file, sector);
+            }
+            write_u32(file, static_cast<uint32_t>(index.dates.size()));
+            for (const auto& date : index.dates) {
+                write_string(file, date);
+            }
+            write_u32(file, static_cast<uint32_t>(index.blocks.size()));
+            for (const auto& block : index.blocks) {
+                write_u64(file, block.offset);
+                write_u64(file, block.bytes);
+                for (const auto* bound : {&block.min_date, &block.max_date, &block.min_ticker, &block.max_ticker}) {
+                    write_string(file, *bound);
+                }
+                write_u64(file, block.sectors);
+            }
+            if (!file) {
+                return;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temporary, index_path, error);
+        if (error) {
+            std::filesystem::remove(temporary, error);
+        }
+    }
+
+    // Empty if the index is missing, unreadable or from another version of the CSV
+    std::optional<CsvIndex> read_csv_index(const std::string& index_path, uint64_t csv_size, int64_t csv_mtime) {
+        std::ifstream file(index_path, std::ios::binary);
+        char magic[4] = {};
+        file.read(magic, sizeof(magic));
+        if (!file || !std::equal(magic, magic + 4, CSV_INDEX_MAGIC) || read_u32(file) != CSV_INDEX_VERSION) {
+            return std::nullopt;
+        }
+
+        CsvIndex index;
+        index.csv_size = read_u64(file);
+        index.csv_mtime = static_cast<int64_t>(read_u64(file));
+        if (!file || index.csv_size != csv_size || index.csv_mtime != csv_mtime) {
+            return std::nullopt;
+        }
+        index.sectors.resize(read_u32(file));
+        for (auto& sector : index.sectors) {
+            sector = read_string(file);
+        }
+        uint32_t n_dates = read_u32(file);
+        for (uint32_t d = 0; d < n_dates && file; ++d) {
+            index.dates.push_back(read_string(file));
+        }
+        uint32_t n_blocks = read_u32(file);
+        for (uint32_t b = 0; b < n_blocks && file; ++b) {
+            CsvBlock block;
+            block.offset = read_u64(file);
+            block.bytes = read_u64(file);
+            for (auto* bound : {&block.min_date, &block.max_date, &block.min_ticker, &block.max_ticker}) {
+                *bound = read_string(file);
+            }
+            block.sectors = read_u64(file);
+            index.blocks.push_back(std::move(block));
+        }
+        if (!file) {
+            return std::nullopt;
+        }
+        return index;
+    }
+
+    // The CSV's index, rebuilt and saved if it is missing or stale. If it cannot be
+    // saved (a read-only directory, say) it is used from memory this once.
+    CsvIndex load_csv_index(std::ifstream& file, const std::string& csv_path) {
+        std::string index_path = csv_path + ".idx";
+        auto [size, mtime] = csv_version(csv_path);
+        if (auto index = read_csv_index(index_path, size, mtime)) {
+            return std::move(*index);
+        }
+        CsvIndex index = build_csv_index(file, csv_path);
+        file.clear();
+        write_csv_index(index, index_path);
+        return index;
+    }
+
+    bool block_matches(const CsvIndex& index, const CsvBlock& block, const LoadQuery& query) {
+        if ((!query.first_date.empty() && block.max_date < query.first_date) ||
+            (!query.last_date.empty() && block.min_date > query.last_date)) {
+            return false;
+        }
+        if (!query.tickers.empty()) {
+            auto it = query.tickers.lower_bound(block.min_ticker);
+            if (it == query.tickers.end() || *it > block.max_ticker) {
+                return false;
+            }
+        }
+        if (!query.sectors.empty()) {
+            uint64_t wanted = 0;
+            for (size_t s = 0; s < index.sectors.size(); ++s) {
+                if (query.sectors.count(index.sectors[s])) {
+                    wanted |= index.sector_bit(s);
+                }
+            }
+            if ((block.sectors & wanted) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+void MarketData::Builder::read_csv_blocks(std::ifstream& file, const std::string& path,
+                                          const LoadQuery& query, LoadStats& stats) {
+    CsvIndex index = load_csv_index(file, path);
+
+    std::string bytes, line;
+    std::vector<std::string> tokens;
+    StockData row;
+    for (const auto& block : index.blocks) {
+        if (!block_matches(index, block, query)) {
+            ++stats.blocks_skipped;
+            continue;
+        }
+        bytes.resize(block.bytes);
+        file.seekg(static_cast<std::streamoff>(block.offset));
+        file.read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        if (file.gcount() != static_cast<std::streamsize>(bytes.size())) {
+            throw std::runtime_error("Stock data file changed while loading: " + path);
+        }
+        ++stats.blocks_read;
+        stats.bytes_read += bytes.size();
+
+        // Rows the first three fields rule out are never parsed
+        for (size_t start = 0; start < bytes.size();) {
+            size_t end = std::min(bytes.find('\n', start), bytes.size());
+            line.assign(bytes, start, end - start);
+            start = end + 1;
+            ++stats.rows_read;
+
+            size_t sector_end = line.find(',');
+            size_t date_end = sector_end == std::string::npos ? sector_end : line.find(',', sector_end + 1);
+            if (date_end == std::string::npos) {
+                continue;
+            }
+            std::string_view view(line);
+            std::string_view ticker = view.substr(0, sector_end);
+            std::string_view sector = view.substr(sector_end + 1, date_end - sector_end - 1);
+            std::string_view date = view.substr(date_end + 1, view.find(',', date_end + 1) - date_end - 1);
+            if ((!query.first_date.empty() && date < query.first_date) ||
+                (!query.last_date.empty() && date > query.last_date) ||
+                (!query.tickers.empty() && !query.tickers.count(std::string(ticker))) ||
+                (!query.sectors.empty() && !query.sectors.count(std::string(sector)))) {
+                continue;
+            }
+            if (parse_csv_line(line, tokens, row)) {
+                add(row);
+                ++stats.rows_kept;
+            }
+        }
+    }
+}
+
+MarketData MarketData::load(const std::string& path, size_t adv_window) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open stock data file: " + path);
+    }
+
+    Builder builder;
+    char magic[4] = {};
+    file.read(magic, sizeof(magic));
+    if (file && std::equal(magic, magic + 4, BAR_FILE_MAGIC)) {
+        {
+            TRACE_SCOPE("read_bar_file");
+            builder.read_bar_file(file, path);
+        }
+        return builder.finish(adv_window);
+    }
+    file.clear();
+    file.seekg(0);
+
+    {
+        TRACE_SCOPE("parse_csv");
+        std::string line;
+        std::getline(file, line); // Skip header
+
+        std::vector<std::string> tokens;
+        StockData row;
+        while (std::getline(file, line)) {
+            if (parse_csv_line(line, tokens, row)) {
+                builder.add(row);
+            }
+        }
+    }
+
+    return builder.finish(adv_window);
+}
+
+MarketData MarketData::build(const std::vector<StockData>& rows, size_t adv_window) {
+    Builder builder;
+    for (const auto& row : rows) {
+        builder.add(row);
+    }
+    return builder.finish(adv_window);
+}
+
+MarketData MarketData::load(const std::string& path, const LoadQuery& query, size_t adv_window, LoadStats* stats) {
+    if (query.everything() && !stats) {
+        return load(path, adv_window);
+    }
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open stock data file: " + path);
+    }
+
+    LoadStats counted;
+    Builder builder;
+    char magic[4] = {};
+    file.read(magic, sizeof(magic));
+    if (file && std::equal(magic, magic + 4, BAR_FILE_MAGIC)) {
+        TRACE_SCOPE("read_bar_file");
+        builder.read_bar_file(file, path, query, counted);
+    } else {
+        TRACE_SCOPE("parse_csv");
+        file.clear();
+        file.seekg(0);
+        builder.read_csv_blocks(file, path, query, counted);
+    }
+    if (stats) {
+        *stats = counted;
+    }
+    return builder.finish(adv_window);
+}
+
+LoadQuery MarketData::trading_window(const std::string& path, const std::string& date,
+                                     int days_before, int days_after) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open stock data file: " + path);
+    }
+
+    std::vector<std::string> dates;
+    char magic[4] = {};
+    file.read(magic, sizeof(magic));
+    if (file && std::equal(magic, magic + 4, BAR_FILE_MAGIC)) {
+        dates = read_bar_header(file, path).date_names;
+        std::sort(dates.begin(), dates.end());
+    } else {
+        file.clear();
+        file.seekg(0);
+        dates = load_csv_index(file, path).dates;
+    }
+
+    LoadQuery query;
+    if (dates.empty()) {
+        query.first_date = query.last_date = date;
+        return query;
+    }
+    // Counted from the first trading day on or after `date`
+    auto at = std::lower_bound(dates.begin(), dates.end(), date) - dates.begin();
+    auto last = static_cast<std::ptrdiff_t>(dates.size()) - 1;
+    query.first_date = dates[std::clamp<std::ptrdiff_t>(at - std::max(days_before, 0), 0, last)];
+    query.last_date = dates[std::clamp<std::ptrdiff_t>(at + std::max(days_after, 0), 0, last)];
+    return query;
+}
+
+bool MarketData::is_bar_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[4] = {};
+    file.read(magic, sizeof(magic));
+    return file && std::equal(magic, magic + 4, BAR_FILE_MAGIC);
+}
+
+bool MarketData::parse_csv_line(const std::string& line, std::vector<std::string>& tokens, StockData& row) {
+    std::stringstream ss(line);
+    std::string token;
+    tokens.clear();
+    while (std::getline(ss, token, ',')) {
+        tokens.push_back(token);
+    }
+
+    if (tokens.size() < 8) return false;
+
+    row.ticker = tokens[0];
+    row.sector = tokens[1];
+    row.date = tokens[2];
+    row.close = std::stod(tokens[3]);
+    row.open = std::stod(tokens[4]);
+    row.low = std::stod(tokens[5]);
+    row.high = std::stod(tokens[6]);
+    row.volume = std::stod(tokens[7]);
+    return true;
+}
+
+uint32_t MarketData::date_index(const std::string& date) const {
+    auto it = std::lower_bound(dates.begin(), dates.end(), date);
+    if (it == dates.end() || *it != date) {
+        return npos;
+    }
+    return static_cast<uint32_t>(it - dates.begin());
+}
+
+size_t MarketData::dates_through(const std::string& date) const {
+    return std::upper_bound(dates.begin(), dates.end(), date) - dates.begin();
+}
+
+uint32_t MarketData::ticker_id(const std::string& ticker) const {
+    auto it = ticker_ids.find(ticker);
+    return it == ticker_ids.end() ? npos : it->second;
+}
+
+const std::string& MarketData::sector_of(const std::string& ticker) const {
+    uint32_t id = ticker_id(ticker);
+    if (id == npos) {
+        throw std::runtime_error("No sector data found for ticker: " + ticker);
+    }
+    return sectors[id];
+}
+
+uint32_t MarketData::find_row(uint32_t ticker, uint32_t date) const {
+    auto first = row_dates.begin() + row_offsets[ticker];
+    auto last = row_dates.begin() + row_offsets[ticker + 1];
+    auto it = std::lower_bound(first, last, date);
+    if (it == last || *it != date) {
+        return npos;
+    }
+    return static_cast<uint32_t>(it - row_dates.begin());
+}
+
+std::span<const uint32_t> MarketData::rows_on(uint32_t date) const {
+    return {date_rows.data() + date_offsets[date], date_rows.data() + date_offsets[date + 1]};
+}
+
+std::pair<uint32_t, uint32_t> MarketData::rows_before(uint32_t ticker, size_t end_date) const {
+    auto first = row_dates.begin() + row_offsets[ticker];
+    auto last = row_dates.begin() + row_offsets[ticker + 1];
+    auto end = std::lower_bound(first, last, end_date);
+    return {row_offsets[ticker], static_cast<uint32_t>(end - row_dates.begin())};
+}
+
+BarFileWriter::BarFileWriter(const std::string& path,
+                             const std::vector<std::string>& sectors,
+                             const std::vector<std::pair<std::string, uint32_t>>& tickers,
+                             const std::vector<std::string>& dates,
+                             size_t rows_per_group)
+    : file(path, std::ios::binary), rows_per_group(std::max<size_t>(rows_per_group, 1)) {
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open bar file for writing: " + path);
+    }
+
+    file.write(BAR_FILE_MAGIC, sizeof(BAR_FILE_MAGIC));
+    write_u32(file, BAR_FILE_VERSION);
+    write_u32(file, static_cast<uint32_t>(sectors.size()));
+    for (const auto& sector : sectors) {
+        write_string(file, sector);
+    }
+    write_u32(file, static_cast<uint32_t>(tickers.size()));
+    for (const auto& [ticker, sector] : tickers) {
+        write_string(file, ticker);
+        write_u32(file, sector);
+    }
+    write_u32(file, static_cast<uint32_t>(dates.size()));
+    for (const auto& date : dates) {
+        write_string(file, date);
+    }
+}
+
+void BarFileWriter::add(uint32_t ticker, uint32_t date, double close, double open, double low, double high, double volume) {
+    group_tickers.push_back(ticker);
+    group_dates.push_back(date);
+    group_closes.push_back(close);
+    group_opens.push_back(open);
+    group_lows.push_back(low);
+    group_highs.push_back(high);
+    group_volumes.push_back(volume);
+    if (group_tickers.size() == rows_per_group) {
+        write_group();
+    }
+}
+
+void BarFileWriter::write_group() {
+    if (group_tickers.empty()) {
+        return;
+    }
+
+    auto [min_ticker, max_ticker] = std::minmax_element(group_tickers.begin(), group_tickers.end());
+    auto [min_date, max_date] = std::minmax_element(group_dates.begin(), group_dates.end());
+    write_u32(file, static_cast<uint32_t>(group_tickers.size()));
+    write_u32(file, *min_ticker);
+    write_u32(file, *max_ticker);
+    write_u32(file, *min_date);
+    write_u32(file, *max_date);
+    write_array(file, group_tickers);
+    write_array(file, group_dates);
+    write_array(file, group_closes);
+    write_array(file, group_opens);
+    write_array(file, group_lows);
+    write_array(file, group_highs);
+    write_array(file, group_volumes);
+
+    for (auto* column : {&group_tickers, &group_dates}) {
+        column->clear();
+    }
+    for (auto* column : {&group_closes, &group_opens, &group_lows, &group_highs, &group_volumes}) {
+        column->clear();
+    }
+}
+
+void BarFileWriter::finish() {
+    write_group();
+    file.close();
+    if (file.fail()) {
+        throw std::runtime_error("Could not write bar file");
+    }
+}
@@ -0,0 +1,203 @@
+// market_data.hpp
+#pragma once
+#include "loader.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Which bars to load. Empty bounds and sets match everything; a row is loaded when it
+// matches all of them. Rows are skipped before they are parsed where the file allows:
+// by row group in a bar file, and by block through a sparse index in a CSV.
+struct LoadQuery {
+    std::string first_date;             // inclusive
+    std::string last_date;              // inclusive
+    std::set<std::string> tickers;
+    std::set<std::string> sectors;
+
+    bool everything() const {
+        return first_date.empty() && last_date.empty() && tickers.empty() && sectors.empty();
+    }
+    bool matches(const std::string& ticker, const std::string& sector, const std::string& date) const {
+        return (first_date.empty() || date >= first_date) && (last_date.empty() || date <= last_date) &&
+               (tickers.empty() || tickers.count(ticker)) && (sectors.empty() || sectors.count(sector));
+    }
+    bool operator==(const LoadQuery&) const = default;
+};
+
+// How much of the file a query load touched
+struct LoadStats {
+    size_t blocks_read = 0;     // row groups, or CSV index blocks
+    size_t blocks_skipped = 0;
+    size_t bytes_read = 0;      // bar data, after the header
+    size_t rows_read = 0;
+    size_t rows_kept = 0;
+};
+
+// Columnar store of the daily bars in stock_data.csv (or a binary bar file, below).
+//
+// Rows are grouped by ticker (ticker t owns rows [row_offsets[t], row_offsets[t + 1])),
+// in date order, with one array per field, so a ticker's price history is a contiguous
+// slice. A second index lists the rows of each date for cross-sections. When the file
+// has the same ticker and date twice, the later row wins.
+//
+// The rolling average dollar volume (close * volume over the ticker's last
+// adv_window rows, up to and including each row) is computed once here.
+class MarketData {
+public:
+    static constexpr uint32_t npos = UINT32_MAX;
+    static constexpr size_t DEFAULT_ADV_WINDOW = 20;
+
+private:
+    std::vector<std::string> dates;                 // sorted
+    std::vector<std::set<std::string>> date_sectors;
+    std::vector<std::string> tickers;               // sorted; a ticker's id is its index
+    std::unordered_map<std::string, uint32_t> ticker_ids;
+    std::vector<std::string> sectors;               // per ticker, from its last row in the file
+    size_t adv_window = DEFAULT_ADV_WINDOW;
+
+    std::vector<uint32_t> row_offsets;              // tickers + 1
+    std::vector<uint32_t> row_tickers;
+    std::vector<uint32_t> row_dates;
+    std::vector<double> closes;
+    std::vector<double> opens;
+    std::vector<double> lows;
+    std::vector<double> highs;
+    std::vector<double> volumes;
+    std::vector<double> average_dollar_volumes;
+
+    std::vector<uint32_t> date_offsets;             // dates + 1
+    std::vector<uint32_t> date_rows;                // by date, then ticker id
+
+public:
+    // Takes rows in file order and indexes them once they are all in. load() and
+    // build() go through it; so does the pipelined CSV load (ingest.hpp), which adds
+    // each run of rows as the parsers finish it.
+    class Builder {
+    private:
+        struct Staging;
+        std::unique_ptr<Staging> staging;
+
+        void read_bar_file(std::ifstream& file, const std::string& path);
+        void read_bar_file(std::ifstream& file, const std::string& path, const LoadQuery& query, LoadStats& stats);
+        void read_csv_blocks(std::ifstream& file, const std::string& path, const LoadQuery& query, LoadStats& stats);
+        friend class MarketData;
+
+    public:
+        Builder();
+        ~Builder();
+        Builder(Builder&&) noexcept;
+        Builder& operator=(Builder&&) noexcept;
+
+        void add(const std::string& ticker, const std::string& sector, const std::string& date,
+                 double close, double open, double low, double high, double volume);
+        void add(const StockData& row) {
+            add(row.ticker, row.sector, row.date, row.close, row.open, row.low, row.high, row.volume);
+        }
+        // Indexes everything added; the builder is empty afterwards
+        MarketData finish(size_t adv_window = DEFAULT_ADV_WINDOW);
+    };
+
+    // Reads a binary bar file, or parses a CSV (header: ticker,sector,date,close,open,
+    // low,high,volume) straight into columns
+    static MarketData load(const std::string& path, size_t adv_window = DEFAULT_ADV_WINDOW);
+    static MarketData build(const std::vector<StockData>& rows, size_t adv_window = DEFAULT_ADV_WINDOW);
+
+    // Only the rows matching `query`. Loading a CSV this way first builds a sparse index
+    // of it (byte offset, date, ticker and sector bounds of every block of rows) and
+    // keeps it next to the file as <path>.idx, rebuilt whenever the CSV changes. The
+    // average dollar volume only sees the loaded rows, so start the range adv_window
+    // trading days early if the first days' figures matter.
+    static MarketData load(const std::string& path, const LoadQuery& query,
+                           size_t adv_window = DEFAULT_ADV_WINDOW, LoadStats* stats = nullptr);
+
+    // The query for `days_before` trading days before `date` through `days_after` after
+    // it, counted in the file's own dates (from the bar file header or the CSV index)
+    static LoadQuery trading_window(const std::string& path, const std::string& date,
+                                    int days_before, int days_after);
+
+    // Whether `path` starts with the bar file magic
+    static bool is_bar_file(const std::string& path);
+    // Splits one CSV line into `row`, using `tokens` as scratch; false (and the line is
+    // skipped) when it has fewer than the eight fields
+    static bool parse_csv_line(const std::string& line, std::vector<std::string>& tokens, StockData& row);
+
+    bool empty() const { return dates.empty(); }
+    size_t row_count() const { return closes.size(); }
+    size_t get_adv_window() const { return adv_window; }
+
+    const std::vector<std::string>& get_dates() const { return dates; }
+    // Index of `date`, or npos if it is not a trading date
+    uint32_t date_index(const std::string& date) const;
+    // Number of trading dates on or before `date`
+    size_t dates_through(const std::string& date) const;
+    const std::set<std::string>& sectors_on(uint32_t date) const { return date_sectors[date]; }
+
+    const std::vector<std::string>& get_tickers() const { return tickers; }
+    uint32_t ticker_id(const std::string& ticker) const;
+    const std::string& ticker(uint32_t id) const { return tickers[id]; }
+    const std::string& sector(uint32_t id) const { return sectors[id]; }
+    // Throws for unknown tickers
+    const std::string& sector_of(const std::string& ticker) const;
+
+    // Row of `ticker` on `date`, or npos
+    uint32_t find_row(uint32_t ticker, uint32_t date) const;
+    std::span<const uint32_t> rows_on(uint32_t date) const;
+    // Rows of `ticker` dated before date index `end_date`, oldest first
+    std::pair<uint32_t, uint32_t> rows_before(uint32_t ticker, size_t end_date) const;
+
+    uint32_t row_ticker(uint32_t row) const { return row_tickers[row]; }
+    uint32_t row_date(uint32_t row) const { return row_dates[row]; }
+    double close(uint32_t row) const { return closes[row]; }
+    double open(uint32_t row) const { return opens[row]; }
+    double low(uint32_t row) const { return lows[row]; }
+    double high(uint32_t row) const { return highs[row]; }
+    double volume(uint32_t row) const { return volumes[row]; }
+    double average_dollar_volume(uint32_t row) const { return average_dollar_volumes[row]; }
+    const double* close_data() const { return closes.data(); }
+};
+
+// Binary bar file, little-endian. Strings are uint32 length + bytes.
+//
+//   char    magic[4] = "MKTB"
+//   uint32  version = 1
+//   uint32  n_sectors,  n_sectors x string
+//   uint32  n_tickers,  n_tickers x {string ticker, uint32 sector}
+//   uint32  n_dates,    n_dates x string
+//   row groups until end of file, each {
+//     uint32   rows
+//     uint32   min_ticker, max_ticker, min_date, max_date   ids of the rows in the group
+//     uint32   ticker[rows], date[rows]
+//     float64  close[rows], open[rows], low[rows], high[rows], volume[rows]
+//   }
+//
+// Bars are streamed in with add() and written a group at a time, so a file of any size
+// can be produced without holding it in memory. A query load seeks past every group
+// whose id bounds rule it out, so groups are kept small enough (half a year of one
+// ticker, when bars are added ticker by ticker) that a date range can skip most of them.
+class BarFileWriter {
+private:
+    std::ofstream file;
+    size_t rows_per_group;
+    std::vector<uint32_t> group_tickers;
+    std::vector<uint32_t> group_dates;
+    std::vector<double> group_closes, group_opens, group_lows, group_highs, group_volumes;
+
+    void write_group();
+
+public:
+    BarFileWriter(const std::string& path,
+                  const std::vector<std::string>& sectors,
+                  const std::vector<std::pair<std::string, uint32_t>>& tickers,   // name, sector
+                  const std::vector<std::string>& dates,
+                  size_t rows_per_group = 128);
+
+    void add(uint32_t ticker, uint32_t date, double close, double open, double low, double high, double volume);
+    // Writes the last partial group and closes the file
+    void finish();
+};
@@ -0,0 +1,204 @@
+// memory.cpp
+#include "memory.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <fstream>
+#include <new>
+#include <ostream>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace {
+    constexpr size_t SUBSYSTEMS = static_cast<size_t>(Subsystem::COUNT);
+    constexpr uint32_t NOT_COUNTED = UINT32_MAX;
+
+    const char* const SUBSYSTEM_NAMES[SUBSYSTEMS] = {"other", "market_data", "caches", "rebalance"};
+
+    struct Account {
+        std::atomic<int64_t> bytes{0};
+        std::atomic<int64_t> peak{0};
+        std::atomic<int64_t> allocations{0};
+    };
+
+    Account accounts[SUBSYSTEMS];
+    std::atomic<bool> counting{false};
+    thread_local Subsystem current_subsystem = Subsystem::Other;
+
+#if STOCK_ANALYZER_MEMORY_ACCOUNTING
+    // Sits right before every block handed out; 16 bytes keeps the block max_align_t aligned
+    struct alignas(16) Header {
+        uint64_t size;
+        uint32_t subsystem;     // NOT_COUNTED for blocks allocated while counting was off
+        uint32_t offset;        // from the start of the malloc'd memory to the block
+    };
+    static_assert(sizeof(Header) == 16);
+
+    void charge(Header* header, size_t size) {
+        header->size = size;
+        header->subsystem = NOT_COUNTED;
+        if (!counting.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        auto index = static_cast<uint32_t>(current_subsystem);
+        header->subsystem = index;
+        Account& account = accounts[index];
+        int64_t now = account.bytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed) +
+                      static_cast<int64_t>(size);
+        account.allocations.fetch_add(1, std::memory_order_relaxed);
+        int64_t peak = account.peak.load(std::memory_order_relaxed);
+        while (now > peak && !account.peak.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {
+        }
+    }
+
+    void* allocate(size_t size, size_t alignment) noexcept {
+        // Over-aligned blocks get a whole alignment unit in front, with the header at its end
+        size_t prefix = std::max(alignment, sizeof(Header));
+        void* base = alignment > alignof(std::max_align_t)
+            ? std::aligned_alloc(alignment, (size + prefix + alignment - 1) / alignment * alignment)
+            : std::malloc(size + prefix);
+        if (!base) {
+            return nullptr;
+        }
+        char* block = static_cast<char*>(base) + prefix;
+        Header* header = reinterpret_cast<Header*>(block) - 1;
+        header->offset = static_cast<uint32_t>(prefix);
+        charge(header, size);
+        return block;
+    }
+
+    void* allocate_or_throw(size_t size, size_t alignment) {
+        for (;;) {
+            if (void* block = allocate(size, alignment)) {
+                return block;
+            }
+            std::new_handler handler = std::get_new_handler();
+            if (!handler) {
+                throw std::bad_alloc();
+            }
+            handler();
+        }
+    }
+
+    void release(void* block) noexcept {
+        if (!block) {
+            return;
+        }
+        Header* header = static_cast<Header*>(block) - 1;
+        if (header->subsystem != NOT_COUNTED) {
+            accounts[header->subsystem].bytes.fetch_sub(static_cast<int64_t>(header->size), std::memory_order_relaxed);
+        }
+        std::free(static_cast<char*>(block) - header->offset);
+    }
+
+    constexpr size_t DEFAULT_ALIGNMENT = alignof(std::max_align_t);
+#endif
+}
+
+#if STOCK_ANALYZER_MEMORY_ACCOUNTING
+void* operator new(std::size_t size) { return allocate_or_throw(size, DEFAULT_ALIGNMENT); }
+void* operator new[](std::size_t size) { return allocate_or_throw(size, DEFAULT_ALIGNMENT); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate(size, DEFAULT_ALIGNMENT); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocate(size, DEFAULT_ALIGNMENT); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return allocate_or_throw(size, static_cast<size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return allocate_or_throw(size, static_cast<size_t>(alignment));
+}
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate(size, static_cast<size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* block) noexcept { release(block); }
+void operator delete[](void* block) noexcept { release(block); }
+void operator delete(void* block, std::size_t) noexcept { release(block); }
+void operator delete[](void* block, std::size_t) noexcept { release(block); }
+void operator delete(void* block, const std::nothrow_t&) noexcept { release(block); }
+void operator delete[](void* block, const std::nothrow_t&) noexcept { release(block); }
+void operator delete(void* block, std::align_val_t) noexcept { release(block); }
+void operator delete[](void* block, std::align_val_t) noexcept { release(block); }
+void operator delete(void* block, std::size_t, std::align_val_t) noexcept { release(block); }
+void operator delete[](void* block, std::size_t, std::align_val_t) noexcept { release(block); }
+void operator delete(void* block, std::align_val_t, const std::nothrow_t&) noexcept { release(block); }
+void operator delete[](void* block, std::align_val_t, const std::nothrow_t&) noexcept { release(block); }
+#endif
+
+void MemoryStats::enable() {
+    counting.store(STOCK_ANALYZER_MEMORY_ACCOUNTING != 0, std::memory_order_relaxed);
+}
+
+bool MemoryStats::enabled() {
+    return counting.load(std::memory_order_relaxed);
+}
+
+SubsystemUsage MemoryStats::usage(Subsystem subsystem) {
+    const Account& account = accounts[static_cast<size_t>(subsystem)];
+    return SubsystemUsage{
+        account.bytes.load(std::memory_order_relaxed),
+        account.peak.load(std::memory_order_relaxed),
+        account.allocations.load(std::memory_order_relaxed)
+    };
+}
+
+void MemoryStats::reset_peaks() {
+    for (auto& account : accounts) {
+        account.peak.store(account.bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+}
+
+size_t MemoryStats::peak_rss_bytes() {
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;     // kilobytes on Linux
+}
+
+size_t MemoryStats::current_rss_bytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    size_t resident = 0;
+    if (!(statm >> pages >> resident)) {
+        return 0;
+    }
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+const char* MemoryStats::name(Subsystem subsystem) {
+    return SUBSYSTEM_NAMES[static_cast<size_t>(subsystem)];
+}
+
+void MemoryStats::write_report(std::ostream& out, size_t cached_prices) {
+    constexpr double MB = 1024.0 * 1024.0;
+    out << "Memory by subsystem:\n";
+    if (!enabled()) {
+        out << "  heap accounting is off (configure with -DSTOCK_ANALYZER_MEMORY_ACCOUNTING=ON)\n";
+    } else {
+        out << fmt::format("{:<14} {:>12} {:>12} {:>14}\n", "subsystem", "live MB", "peak MB", "allocations");
+        for (size_t s = 0; s < SUBSYSTEMS; ++s) {
+            auto used = usage(static_cast<Subsystem>(s));
+            out << fmt::format("{:<14} {:>12.2f} {:>12.2f} {:>14}\n",
+                               SUBSYSTEM_NAMES[s], used.bytes / MB, used.peak_bytes / MB, used.allocations);
+        }
+        if (cached_prices > 0) {
+            out << fmt::format("Bytes per cached price: {:.1f} ({} prices)\n",
+                               static_cast<double>(usage(Subsystem::MarketData).bytes) / cached_prices,
+                               cached_prices);
+        }
+    }
+    out << fmt::format("Peak RSS: {:.1f} MB (now {:.1f} MB)\n", peak_rss_bytes() / MB, current_rss_bytes() / MB);
+}
+
+MemoryScope::MemoryScope(Subsystem subsystem) : previous(current_subsystem) {
+    current_subsystem = subsystem;
+}
+
+MemoryScope::~MemoryScope() {
+    current_subsystem = previous;
+}
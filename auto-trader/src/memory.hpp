@@ -0,0 +1,69 @@
+// memory.hpp
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+// Only built with STOCK_ANALYZER_MEMORY_ACCOUNTING=1 (the CMake option of the same name,
+// off by default, and always on in rebalance_benchmark) is operator new replaced;
+// otherwise the allocator is left alone and every count below reads zero
+#ifndef STOCK_ANALYZER_MEMORY_ACCOUNTING
+#define STOCK_ANALYZER_MEMORY_ACCOUNTING 0
+#endif
+
+// Heap use by subsystem.
+//
+// memory.cpp replaces the global operator new / delete with versions that put a small
+// header in front of each block recording its size and the subsystem it was allocated
+// for: the innermost MemoryScope on the allocating thread, or Other. A block stays
+// charged to that subsystem until it is freed, whichever thread frees it, so moving
+// data between containers does not move it between subsystems.
+//
+// Counting is off until MemoryStats::enable(); blocks allocated before then are never
+// counted. Peak RSS comes from getrusage and covers everything, counted or not.
+enum class Subsystem : uint8_t {
+    Other,
+    MarketData,     // the loaded bars, their indexes and the parse staging
+    Caches,         // speculated ROI and correlation caches
+    Rebalance,      // ranking snapshots, selection and allocation temporaries
+    COUNT
+};
+
+struct SubsystemUsage {
+    int64_t bytes = 0;          // live now
+    int64_t peak_bytes = 0;     // since enable() or the last reset_peaks()
+    int64_t allocations = 0;    // since enable()
+};
+
+class MemoryStats {
+public:
+    static void enable();
+    static bool enabled();
+
+    static SubsystemUsage usage(Subsystem subsystem);
+    // Sets every subsystem's peak to its current bytes
+    static void reset_peaks();
+
+    static size_t peak_rss_bytes();
+    static size_t current_rss_bytes();
+
+    static const char* name(Subsystem subsystem);
+
+    // Live and peak bytes per subsystem, bytes per cached price (market data bytes over
+    // `cached_prices` rows, when given) and RSS
+    static void write_report(std::ostream& out, size_t cached_prices = 0);
+};
+
+// Charges heap allocations on this thread to `subsystem` until it goes out of scope
+class MemoryScope {
+private:
+    Subsystem previous;
+
+public:
+    explicit MemoryScope(Subsystem subsystem);
+    ~MemoryScope();
+
+    MemoryScope(const MemoryScope&) = delete;
+    MemoryScope& operator=(const MemoryScope&) = delete;
+};
@@ -4,6 +4,8 @@
 #include <vector>
 #include <optional>
 #include <map>
+#include <tuple>
+#include <variant>
 #include <nlohmann/json.hpp>
 using json = nlohmann::json;
 
@@ -67,6 +69,14 @@ struct RebalanceAction {
     std::optional<double> actual_net_capital;
 };
 
+// Historical-simulation risk of a portfolio held unchanged over the lookback
+struct RiskReport {
+    double volatility;                  // daily, as a fraction of portfolio value
+    double value_at_risk;               // one-day loss not exceeded at the confidence level, $
+    double conditional_value_at_risk;   // average one-day loss beyond that, $
+    double max_drawdown;                // worst peak-to-trough fall, as a fraction
+};
+
 struct RebalanceSummary {
     double total_portfolio_value;
     double remaining_cash;
@@ -74,4 +84,8 @@ struct RebalanceSummary {
     double total_speculated_net_capital;
     std::optional<double> average_actual_roi;
     std::optional<double> total_actual_net_capital;
-};
\ No newline at end of file
+    std::optional<RiskReport> old_risk;
+    std::optional<RiskReport> new_risk;
+};
+
+using RebalanceResult = std::tuple<std::vector<RebalanceAction>, RebalanceSummary, Portfolio>;
\ No newline at end of file
@@ -0,0 +1,126 @@
+// netting.cpp
+#include "netting.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+TickerIndex::TickerIndex(std::vector<std::string> names) : tickers(std::move(names)) {
+    std::sort(tickers.begin(), tickers.end());
+    tickers.erase(std::unique(tickers.begin(), tickers.end()), tickers.end());
+}
+
+uint32_t TickerIndex::find(const std::string& ticker) const {
+    auto it = std::lower_bound(tickers.begin(), tickers.end(), ticker);
+    if (it == tickers.end() || *it != ticker) {
+        return npos;
+    }
+    return static_cast<uint32_t>(it - tickers.begin());
+}
+
+TradeNetter::TradeNetter(TickerIndex index) : index(std::move(index)) {}
+
+void TradeNetter::add(const std::string& account_id, const std::vector<RebalanceAction>& actions) {
+    uint32_t account = static_cast<uint32_t>(accounts.size());
+    accounts.push_back(account_id);
+
+    for (const auto& action : actions) {
+        bool buy = action.action_type == "BUY";
+        if (action.traded_shares <= 0 || (!buy && action.action_type != "SELL")) {
+            continue;
+        }
+        uint32_t ticker = index.find(action.ticker);
+        if (ticker == TickerIndex::npos) {
+            throw std::runtime_error("Ticker not in netting universe: " + action.ticker);
+        }
+        entries.push_back(Entry{account, ticker, buy ? action.traded_shares : -action.traded_shares});
+    }
+}
+
+NettingResult TradeNetter::net() const {
+    const size_t n_tickers = index.size();
+    NettingResult result;
+    result.accounts = accounts;
+    result.actions = entries.size();
+    result.tickers.reserve(n_tickers);
+    for (uint32_t t = 0; t < n_tickers; ++t) {
+        result.tickers.push_back(index.name(t));
+    }
+
+    // Per-ticker totals and a stable counting sort of entries by ticker id
+    std::vector<int64_t> bought(n_tickers, 0);
+    std::vector<int64_t> sold(n_tickers, 0);
+    std::vector<size_t> offsets(n_tickers + 1, 0);
+    for (const auto& entry : entries) {
+        ++offsets[entry.ticker + 1];
+        if (entry.shares > 0) {
+            bought[entry.ticker] += entry.shares;
+        } else {
+            sold[entry.ticker] -= entry.shares;
+        }
+    }
+    for (size_t t = 0; t < n_tickers; ++t) {
+        offsets[t + 1] += offsets[t];
+    }
+    std::vector<uint32_t> order(entries.size());
+    std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        order[cursor[entries[i].ticker]++] = static_cast<uint32_t>(i);
+    }
+
+    result.allocations.reserve(entries.size());
+    std::vector<std::pair<int64_t, size_t>> remainders;  // (remainder, allocation)
+
+    for (uint32_t t = 0; t < n_tickers; ++t) {
+        if (offsets[t] == offsets[t + 1]) continue;
+
+        const int64_t buys = bought[t];
+        const int64_t sells = sold[t];
+        const bool buyers_majority = buys >= sells;
+        const int64_t majority = std::max(buys, sells);
+        const int64_t crossed_total = std::min(buys, sells);
+
+        BlockOrder block{t, buys, sells, result.allocations.size(), offsets[t + 1] - offsets[t]};
+
+        // Minority side crosses in full; majority side gets floor(size * crossed / majority)
+        remainders.clear();
+        int64_t assigned = 0;
+        for (size_t k = offsets[t]; k < offsets[t + 1]; ++k) {
+            const Entry& entry = entries[order[k]];
+            int64_t size = std::abs(static_cast<int64_t>(entry.shares));
+            int64_t crossed = size;
+            if ((entry.shares > 0) == buyers_majority) {
+                crossed = size * crossed_total / majority;
+                int64_t remainder = size * crossed_total % majority;
+                if (remainder) {
+                    remainders.emplace_back(remainder, result.allocations.size());
+                }
+                assigned += crossed;
+            }
+            result.allocations.push_back(AccountAllocation{
+                entry.account, entry.shares, static_cast<int32_t>(crossed), 0});
+        }
+
+        // Hand the shares lost to rounding to the largest remainders (earlier accounts on ties)
+        auto leftover = static_cast<size_t>(crossed_total - assigned);
+        if (leftover > 0) {
+            auto larger = [](const auto& a, const auto& b) {
+                return a.first != b.first ? a.first > b.first : a.second < b.second;
+            };
+            std::nth_element(remainders.begin(), remainders.begin() + (leftover - 1), remainders.end(), larger);
+            for (size_t i = 0; i < leftover; ++i) {
+                ++result.allocations[remainders[i].second].crossed;
+            }
+        }
+
+        for (size_t i = block.first_allocation; i < result.allocations.size(); ++i) {
+            auto& allocation = result.allocations[i];
+            allocation.market = std::abs(allocation.requested) - allocation.crossed;
+        }
+
+        result.gross_shares += buys + sells;
+        result.market_shares += std::abs(block.net_shares());
+        result.block_orders.push_back(block);
+    }
+
+    return result;
+}
@@ -0,0 +1,82 @@
+// netting.hpp
+#pragma once
+#include "models.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Dense ids for a fixed ticker universe: the sorted, de-duplicated names, looked up
+// by binary search. Ids index plain arrays, so per-ticker state needs no hashing.
+class TickerIndex {
+private:
+    std::vector<std::string> tickers;
+
+public:
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    TickerIndex() = default;
+    explicit TickerIndex(std::vector<std::string> tickers);
+
+    size_t size() const { return tickers.size(); }
+    uint32_t find(const std::string& ticker) const;    // npos if unknown
+    const std::string& name(uint32_t id) const { return tickers[id]; }
+};
+
+// One account's share of a ticker's trading. `requested` is signed (+ buy, - sell);
+// `crossed` of its shares are filled against opposing accounts and `market` by the
+// block order.
+struct AccountAllocation {
+    uint32_t account;
+    int32_t requested;
+    int32_t crossed;
+    int32_t market;
+};
+
+// Net market order for one ticker; its allocations are
+// allocations[first_allocation, first_allocation + allocation_count)
+struct BlockOrder {
+    uint32_t ticker;
+    int64_t bought;
+    int64_t sold;
+    size_t first_allocation;
+    size_t allocation_count;
+
+    int64_t net_shares() const { return bought - sold; }
+};
+
+struct NettingResult {
+    std::vector<BlockOrder> block_orders;           // tickers with any trading, by ticker id
+    std::vector<AccountAllocation> allocations;     // grouped by block order, accounts in add() order
+    std::vector<std::string> tickers;               // names by ticker id
+    std::vector<std::string> accounts;              // ids by account number
+    int64_t gross_shares = 0;                       // sum of every account's |requested|
+    int64_t market_shares = 0;                      // sum of every block order's |net|
+    size_t actions = 0;
+};
+
+// Nets BUY/SELL actions from many accounts per ticker. Each ticker's minority side is
+// crossed in full against the majority side; the majority side's crossed shares are
+// split pro rata to requested size (largest remainder, so they sum exactly) and the
+// remainder goes to market as one block order.
+class TradeNetter {
+private:
+    struct Entry {
+        uint32_t account;
+        uint32_t ticker;
+        int32_t shares;
+    };
+
+    TickerIndex index;
+    std::vector<std::string> accounts;
+    std::vector<Entry> entries;
+
+public:
+    explicit TradeNetter(TickerIndex index);
+
+    // HOLD actions are ignored; throws on a ticker outside the index
+    void add(const std::string& account_id, const std::vector<RebalanceAction>& actions);
+
+    size_t action_count() const { return entries.size(); }
+
+    NettingResult net() const;
+};
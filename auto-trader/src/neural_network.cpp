@@ -0,0 +1,177 @@
+// neural_network.cpp
+#include "neural_network.hpp"
+#include "gemm.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+    uint32_t read_u32(std::ifstream& file) {
+        uint32_t value = 0;
+        file.read(reinterpret_cast<char*>(&value), sizeof(value));
+        return value;
+    }
+
+    // Reads a rows x columns array once the bytes left in the file are known to hold
+    // it, so a corrupt header fails instead of asking for gigabytes
+    template <typename T>
+    void read_array(std::ifstream& file, std::vector<T>& out, uint64_t rows, uint64_t columns,
+                    uint64_t& remaining, const std::string& path) {
+        if (columns != 0 && rows > remaining / sizeof(T) / columns) {
+            throw std::runtime_error("Truncated network file: " + path);
+        }
+        uint64_t bytes = rows * columns * sizeof(T);
+        remaining -= bytes;
+        out.resize(rows * columns);
+        file.read(reinterpret_cast<char*>(out.data()), static_cast<std::streamsize>(bytes));
+    }
+}
+
+NeuralNetwork NeuralNetwork::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open network file: " + path);
+    }
+
+    char magic[4];
+    file.read(magic, sizeof(magic));
+    if (!file || std::memcmp(magic, "NNET", 4) != 0) {
+        throw std::runtime_error("Not a network file: " + path);
+    }
+    if (read_u32(file) != 1) {
+        throw std::runtime_error("Unsupported network file version: " + path);
+    }
+
+    NeuralNetwork network;
+    network.window = read_u32(file);
+    uint32_t n_layers = read_u32(file);
+    if (!file) {
+        throw std::runtime_error("Truncated network file: " + path);
+    }
+
+    std::streamoff header_end = file.tellg();
+    file.seekg(0, std::ios::end);
+    auto remaining = static_cast<uint64_t>(file.tellg() - header_end);
+    file.seekg(header_end);
+
+    // Shape of one sample as it flows through the network
+    size_t length = network.window;
+    size_t channels = 1;
+
+    for (uint32_t i = 0; i < n_layers; ++i) {
+        Layer layer;
+        layer.type = static_cast<LayerType>(read_u32(file));
+        layer.activation = static_cast<Activation>(read_u32(file));
+        uint32_t dtype = read_u32(file);
+
+        size_t rows;
+        if (layer.type == LayerType::Dense) {
+            layer.in = read_u32(file);
+            layer.out = read_u32(file);
+            layer.kernel = 1;
+            if (layer.in != length * channels) {
+                throw std::runtime_error("Dense layer input size mismatch in network file: " + path);
+            }
+            rows = layer.in;
+            length = 1;
+        } else if (layer.type == LayerType::Conv1D) {
+            layer.in = read_u32(file);
+            layer.out = read_u32(file);
+            layer.kernel = read_u32(file);
+            if (layer.in != channels || layer.kernel == 0 || layer.kernel > length) {
+                throw std::runtime_error("Conv1d layer shape mismatch in network file: " + path);
+            }
+            rows = layer.kernel * layer.in;
+            length = length - layer.kernel + 1;
+        } else {
+            throw std::runtime_error("Unknown layer type in network file: " + path);
+        }
+        channels = layer.out;
+
+        if (layer.activation != Activation::None && layer.activation != Activation::Relu &&
+            layer.activation != Activation::Tanh) {
+            throw std::runtime_error("Unknown activation in network file: " + path);
+        }
+
+        if (dtype == 0) {
+            read_array(file, layer.weights, rows, layer.out, remaining, path);
+        } else if (dtype == 1) {
+            read_array(file, layer.quantized_weights, rows, layer.out, remaining, path);
+            read_array(file, layer.scales, 1, layer.out, remaining, path);
+        } else {
+            throw std::runtime_error("Unknown weight type in network file: " + path);
+        }
+        read_array(file, layer.bias, 1, layer.out, remaining, path);
+
+        network.layers.push_back(std::move(layer));
+    }
+
+    if (!file) {
+        throw std::runtime_error("Truncated network file: " + path);
+    }
+    if (network.layers.empty() || length * channels != 1) {
+        throw std::runtime_error("Network must end in a single output: " + path);
+    }
+
+    return network;
+}
+
+void NeuralNetwork::forward(const float* inputs, size_t batch, float* outputs) const {
+    std::vector<float> current(inputs, inputs + batch * window);
+    std::vector<float> next;
+    std::vector<float> columns;
+    size_t length = window;
+    size_t channels = 1;
+
+    for (const auto& layer : layers) {
+        // Every layer is a single GEMM over the whole batch: rows of A are samples
+        // (dense) or sliding windows of every sample (conv1d, via im2col)
+        const float* a = current.data();
+        size_t m = batch;
+        size_t k = length * channels;
+        size_t out_length = 1;
+
+        if (layer.type == LayerType::Conv1D) {
+            out_length = length - layer.kernel + 1;
+            k = layer.kernel * channels;
+            m = batch * out_length;
+            columns.resize(m * k);
+            for (size_t b = 0; b < batch; ++b) {
+                for (size_t t = 0; t < out_length; ++t) {
+                    const float* window_start = current.data() + (b * length + t) * channels;
+                    std::copy(window_start, window_start + k, columns.data() + (b * out_length + t) * k);
+                }
+            }
+            a = columns.data();
+        }
+
+        next.resize(m * layer.out);
+        if (layer.quantized_weights.empty()) {
+            sgemm(m, layer.out, k, a, k, layer.weights.data(), layer.out, next.data(), layer.out);
+        } else {
+            sgemm_i8(m, layer.out, k, a, k, layer.quantized_weights.data(), layer.out,
+                     layer.scales.data(), next.data(), layer.out);
+        }
+
+        for (size_t row = 0; row < m; ++row) {
+            float* values = next.data() + row * layer.out;
+            for (size_t j = 0; j < layer.out; ++j) {
+                float v = values[j] + layer.bias[j];
+                if (layer.activation == Activation::Relu) {
+                    v = std::max(v, 0.0f);
+                } else if (layer.activation == Activation::Tanh) {
+                    v = std::tanh(v);
+                }
+                values[j] = v;
+            }
+        }
+
+        current.swap(next);
+        length = out_length;
+        channels = layer.out;
+    }
+
+    std::copy(current.begin(), current.begin() + batch, outputs);
+}
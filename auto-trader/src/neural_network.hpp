@@ -0,0 +1,57 @@
+// neural_network.hpp
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Inference-only MLP / 1D-convolution network. Little-endian weight file:
+//
+//   char    magic[4] = "NNET"
+//   uint32  version = 1
+//   uint32  window         number of daily log returns fed to the network
+//   uint32  n_layers
+//   n_layers x {
+//     uint32  type         0 = dense, 1 = conv1d (valid padding, stride 1)
+//     uint32  activation   0 = none, 1 = relu, 2 = tanh
+//     uint32  dtype        0 = float32 weights, 1 = int8 weights
+//     dense:  uint32 in, out
+//     conv1d: uint32 in_channels, out_channels, kernel
+//     weights   [rows x out] row-major, rows = in (dense) or kernel * in_channels (conv1d)
+//     float32   scales[out]  only for int8 weights
+//     float32   bias[out]
+//   }
+//
+// The input is a (window x 1) sequence; a conv1d layer maps (length x in_channels) to
+// (length - kernel + 1 x out_channels) and a dense layer flattens whatever it is given.
+// The last layer must have a single output, read as the speculated ROI.
+class NeuralNetwork {
+public:
+    enum class LayerType : uint32_t { Dense = 0, Conv1D = 1 };
+    enum class Activation : uint32_t { None = 0, Relu = 1, Tanh = 2 };
+
+    struct Layer {
+        LayerType type;
+        Activation activation;
+        size_t in;       // dense inputs, or conv1d input channels
+        size_t out;      // outputs / output channels
+        size_t kernel;   // 1 for dense
+        std::vector<float> weights;
+        std::vector<int8_t> quantized_weights;
+        std::vector<float> scales;
+        std::vector<float> bias;
+    };
+
+private:
+    size_t window = 0;
+    std::vector<Layer> layers;
+
+public:
+    static NeuralNetwork load(const std::string& path);
+
+    size_t get_window() const { return window; }
+
+    // Evaluates `batch` input sequences (window floats each, contiguous) as one
+    // matrix multiply per layer and writes one output per sequence
+    void forward(const float* inputs, size_t batch, float* outputs) const;
+};
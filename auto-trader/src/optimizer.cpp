@@ -0,0 +1,257 @@
+// optimizer.cpp
+#include "optimizer.hpp"
+#include "gemm.hpp"
+#include <algorithm>
+#include <cmath>
+
+double shrunk_covariance(const float* returns, size_t n_assets, size_t n_obs,
+                         std::vector<double>& covariance) {
+    const size_t n = n_assets;
+    const size_t t = n_obs;
+    covariance.assign(n * n, 0.0);
+    if (n == 0 || t == 0) {
+        return 0.0;
+    }
+
+    // Demeaned series, and the same data transposed as the right-hand GEMM operand
+    std::vector<float> x(n * t);
+    std::vector<float> xt(t * n);
+    for (size_t i = 0; i < n; ++i) {
+        const float* series = returns + i * t;
+        double mean = 0.0;
+        for (size_t k = 0; k < t; ++k) {
+            mean += series[k];
+        }
+        mean /= t;
+        for (size_t k = 0; k < t; ++k) {
+            float v = static_cast<float>(series[k] - mean);
+            x[i * t + k] = v;
+            xt[k * n + i] = v;
+        }
+    }
+
+    std::vector<float> gram(n * n);
+    sgemm(n, n, t, x.data(), t, xt.data(), n, gram.data(), n);
+
+    // Sample covariance, symmetrised against rounding differences between the halves
+    double trace = 0.0;
+    double sum_sq = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = i; j < n; ++j) {
+            double s = 0.5 * (static_cast<double>(gram[i * n + j]) + gram[j * n + i]) / t;
+            covariance[i * n + j] = s;
+            covariance[j * n + i] = s;
+            sum_sq += i == j ? s * s : 2.0 * s * s;
+        }
+        trace += covariance[i * n + i];
+    }
+
+    // Ledoit-Wolf: beta estimates the variance of the sample covariance entries,
+    // delta its distance from the target mu * I
+    double mu = trace / n;
+    double beta_sum = 0.0;
+    for (size_t k = 0; k < t; ++k) {
+        double norm_sq = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            double v = xt[k * n + i];
+            norm_sq += v * v;
+        }
+        beta_sum += norm_sq * norm_sq;
+    }
+    double beta = (beta_sum / t - sum_sq) / (static_cast<double>(n) * t);
+    double delta = (sum_sq - n * mu * mu) / n;
+    beta = std::clamp(beta, 0.0, std::max(delta, 0.0));
+    double shrinkage = delta > 0.0 ? beta / delta : 0.0;
+
+    for (size_t i = 0; i < n * n; ++i) {
+        covariance[i] *= 1.0 - shrinkage;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        covariance[i * n + i] += shrinkage * mu;
+    }
+    return shrinkage;
+}
+
+void project_capped_simplex(std::vector<double>& weights,
+                            const std::vector<int>& sectors, size_t n_sectors,
+                            double max_weight, double max_sector_weight) {
+    const size_t n = weights.size();
+    if (n == 0) {
+        return;
+    }
+    const double cap = max_weight;
+
+    // Assets grouped by sector (counting sort)
+    std::vector<size_t> offsets(n_sectors + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+        ++offsets[sectors[i] + 1];
+    }
+    for (size_t s = 0; s < n_sectors; ++s) {
+        offsets[s + 1] += offsets[s];
+    }
+    std::vector<size_t> members(n);
+    std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < n; ++i) {
+        members[cursor[sectors[i]]++] = i;
+    }
+
+    double budget = 0.0;
+    for (size_t s = 0; s < n_sectors; ++s) {
+        budget += std::min(max_sector_weight, (offsets[s + 1] - offsets[s]) * cap);
+    }
+    budget = std::min(budget, 1.0);
+
+    std::vector<double> sector_sums(n_sectors);
+    auto fill_sector_sums = [&](double tau) {
+        std::fill(sector_sums.begin(), sector_sums.end(), 0.0);
+        for (size_t i = 0; i < n; ++i) {
+            sector_sums[sectors[i]] += std::clamp(weights[i] - tau, 0.0, cap);
+        }
+    };
+
+    // Outer threshold: a sector over its cap contributes exactly the cap whatever its
+    // own shift turns out to be, so the total is monotone in tau alone
+    auto [min_it, max_it] = std::minmax_element(weights.begin(), weights.end());
+    double lo = *min_it - cap;
+    double hi = *max_it;
+    for (int iter = 0; iter < 64; ++iter) {
+        double mid = 0.5 * (lo + hi);
+        fill_sector_sums(mid);
+        double total = 0.0;
+        for (double sum : sector_sums) {
+            total += std::min(sum, max_sector_weight);
+        }
+        (total > budget ? lo : hi) = mid;
+    }
+    const double tau = 0.5 * (lo + hi);
+    fill_sector_sums(tau);
+
+    // Per-sector shift for the sectors whose cap binds
+    std::vector<double> shifts(n_sectors, 0.0);
+    for (size_t s = 0; s < n_sectors; ++s) {
+        if (sector_sums[s] <= max_sector_weight) continue;
+        double shift_lo = 0.0;
+        double shift_hi = 0.0;
+        for (size_t k = offsets[s]; k < offsets[s + 1]; ++k) {
+            shift_hi = std::max(shift_hi, weights[members[k]] - tau);
+        }
+        for (int iter = 0; iter < 64; ++iter) {
+            double mid = 0.5 * (shift_lo + shift_hi);
+            double sum = 0.0;
+            for (size_t k = offsets[s]; k < offsets[s + 1]; ++k) {
+                sum += std::clamp(weights[members[k]] - tau - mid, 0.0, cap);
+            }
+            (sum > max_sector_weight ? shift_lo : shift_hi) = mid;
+        }
+        shifts[s] = 0.5 * (shift_lo + shift_hi);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        weights[i] = std::clamp(weights[i] - tau - shifts[sectors[i]], 0.0, cap);
+    }
+}
+
+std::vector<double> mean_variance_weights(const std::vector<double>& expected_returns,
+                                          const std::vector<double>& covariance,
+                                          const std::vector<int>& sectors, size_t n_sectors,
+                                          const OptimizerOptions& options) {
+    const size_t n = expected_returns.size();
+    const double risk_aversion = options.risk_aversion;
+
+    // Gradient Lipschitz constant: risk_aversion * lambda_max(S) <= risk_aversion * max_i sum_j |S_ij|
+    double row_bound = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        double sum = 0.0;
+        for (size_t j = 0; j < n; ++j) {
+            sum += std::abs(covariance[i * n + j]);
+        }
+        row_bound = std::max(row_bound, sum);
+    }
+    const double step = 1.0 / std::max(risk_aversion * row_bound, 1e-12);
+
+    std::vector<double> weights(n, 1.0 / std::max<size_t>(n, 1));
+    project_capped_simplex(weights, sectors, n_sectors, options.max_weight, options.max_sector_weight);
+    std::vector<double> momentum = weights;
+    std::vector<double> next(n);
+    double t = 1.0;
+
+    for (int iter = 0; iter < options.max_iterations; ++iter) {
+        for (size_t i = 0; i < n; ++i) {
+            const double* row = covariance.data() + i * n;
+            double risk = 0.0;
+            for (size_t j = 0; j < n; ++j) {
+                risk += row[j] * momentum[j];
+            }
+            next[i] = momentum[i] - step * (risk_aversion * risk - expected_returns[i]);
+        }
+        project_capped_simplex(next, sectors, n_sectors, options.max_weight, options.max_sector_weight);
+
+        double change = 0.0;
+        double t_next = 0.5 * (1.0 + std::sqrt(1.0 + 4.0 * t * t));
+        for (size_t i = 0; i < n; ++i) {
+            change = std::max(change, std::abs(next[i] - weights[i]));
+            momentum[i] = next[i] + (t - 1.0) / t_next * (next[i] - weights[i]);
+        }
+        weights.swap(next);
+        t = t_next;
+
+        if (change < options.tolerance) break;
+    }
+
+    return weights;
+}
+
+std::vector<double> risk_parity_weights(const std::vector<double>& covariance,
+                                        const std::vector<int>& sectors, size_t n_sectors,
+                                        const OptimizerOptions& options) {
+    const size_t n = sectors.size();
+    if (n == 0) {
+        return {};
+    }
+    const double budget = 1.0 / n;
+
+    // Start from inverse volatility; risk[i] tracks (S y)_i as coordinates move
+    std::vector<double> y(n);
+    for (size_t i = 0; i < n; ++i) {
+        double variance = covariance[i * n + i];
+        y[i] = variance > 0.0 ? 1.0 / std::sqrt(variance) : 1.0;
+    }
+    std::vector<double> risk(n, 0.0);
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j < n; ++j) {
+            risk[i] += covariance[i * n + j] * y[j];
+        }
+    }
+
+    for (int iter = 0; iter < options.max_iterations; ++iter) {
+        double max_change = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            const double* row = covariance.data() + i * n;
+            double variance = row[i];
+            if (variance <= 0.0) continue;
+
+            // Root of variance * y^2 + others * y - budget = 0
+            double others = risk[i] - variance * y[i];
+            double updated = (-others + std::sqrt(others * others + 4.0 * variance * budget)) / (2.0 * variance);
+            double delta = updated - y[i];
+            if (delta != 0.0) {
+                for (size_t j = 0; j < n; ++j) {
+                    risk[j] += row[j] * delta;
+                }
+            }
+            max_change = std::max(max_change, std::abs(delta) / updated);
+            y[i] = updated;
+        }
+        if (max_change < options.tolerance) break;
+    }
+
+    double total = 0.0;
+    for (double v : y) {
+        total += v;
+    }
+    for (double& v : y) {
+        v /= total;
+    }
+    project_capped_simplex(y, sectors, n_sectors, options.max_weight, options.max_sector_weight);
+    return y;
+}
@@ -0,0 +1,50 @@
+// optimizer.hpp
+#pragma once
+#include <cstddef>
+#include <vector>
+
+enum class AllocationMode {
+    RankRamp,       // 2(n - i) / n^2 of the portfolio to the i-th ranked stock
+    MeanVariance,   // maximise mu'w - risk_aversion / 2 * w'Sw
+    RiskParity      // equal risk contributions w_i (Sw)_i
+};
+
+struct OptimizerOptions {
+    AllocationMode mode = AllocationMode::RankRamp;
+    double risk_aversion = 4.0;
+    double max_weight = 0.10;           // per stock
+    double max_sector_weight = 0.35;    // per sector
+    int lookback_period = 120;          // trading days of daily returns behind the covariance
+    int max_iterations = 500;
+    double tolerance = 1e-7;
+};
+
+// Covariance of n_assets daily return series (row-major, n_assets x n_obs), shrunk
+// toward a scaled identity with the Ledoit-Wolf optimal intensity (as in sklearn, with
+// 1/n_obs normalisation). The Gram matrix is one call to the blocked SIMD sgemm kernel.
+// Writes the n_assets x n_assets matrix to `covariance` and returns the intensity used.
+double shrunk_covariance(const float* returns, size_t n_assets, size_t n_obs,
+                         std::vector<double>& covariance);
+
+// Euclidean projection of `weights` onto long-only weights of at most max_weight each
+// and max_sector_weight per sector, summing to 1 or to the most the caps allow.
+// `sectors` holds a sector id in [0, n_sectors) per asset. The solution has the form
+// clip(y_i - tau - sigma_sector, 0, max_weight); tau and the active sector shifts are
+// found by bisection, O(n) per step.
+void project_capped_simplex(std::vector<double>& weights,
+                            const std::vector<int>& sectors, size_t n_sectors,
+                            double max_weight, double max_sector_weight);
+
+// Long-only mean-variance weights by accelerated projected gradient (FISTA) with a
+// step from a Gershgorin bound on the covariance's largest eigenvalue
+std::vector<double> mean_variance_weights(const std::vector<double>& expected_returns,
+                                          const std::vector<double>& covariance,
+                                          const std::vector<int>& sectors, size_t n_sectors,
+                                          const OptimizerOptions& options);
+
+// Equal-risk-contribution weights by cyclical coordinate descent on
+// 1/2 y'Sy - 1/n sum(log y), normalised and then projected onto the caps (which can
+// move binding names away from exact parity)
+std::vector<double> risk_parity_weights(const std::vector<double>& covariance,
+                                        const std::vector<int>& sectors, size_t n_sectors,
+                                        const OptimizerOptions& options);
@@ -0,0 +1,61 @@
+// parallel.hpp
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs body(i) for i in [0, count) on up to max_threads threads (0 = all cores).
+// Indices are handed out in small chunks from a shared counter so uneven work
+// (e.g. tickers with longer histories) balances itself. The first exception
+// thrown by any worker is rethrown on the calling thread.
+template <typename Body>
+void parallel_for(size_t count, Body&& body, unsigned max_threads = 0, size_t chunk = 16) {
+    unsigned threads = max_threads > 0 ? max_threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, (count + chunk - 1) / std::max<size_t>(chunk, 1)));
+
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            body(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto worker = [&] {
+        try {
+            for (size_t begin = next.fetch_add(chunk); begin < count; begin = next.fetch_add(chunk)) {
+                size_t end = std::min(count, begin + chunk);
+                for (size_t i = begin; i < end; ++i) {
+                    body(i);
+                }
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+            next.store(count);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (unsigned t = 1; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
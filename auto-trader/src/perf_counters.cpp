@@ -0,0 +1,178 @@
+// perf_counters.cpp
+#include "perf_counters.hpp"
+#include <cmath>
+#include <cstring>
+#include <fmt/format.h>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr double NOT_OPEN = std::numeric_limits<double>::quiet_NaN();
+
+    const char* const COUNTER_NAMES[Profiler::COUNTERS] = {
+        "cycles", "instructions", "LLC misses", "branch misses", "task clock", "page faults"
+    };
+
+    struct PhaseCounters {
+        const char* name;
+        size_t calls = 0;
+        size_t items = 0;
+        Profiler::Values totals{};
+    };
+
+    std::mutex phases_mutex;
+    std::vector<PhaseCounters> phases;
+    std::string status_message;
+
+    // Counters belong to the thread that opened them
+    thread_local bool profiling_thread = false;
+    std::array<int, Profiler::COUNTERS> fds = {-1, -1, -1, -1, -1, -1};
+
+#ifdef __linux__
+    struct CounterConfig {
+        uint32_t type;
+        uint64_t config;
+    };
+
+    const CounterConfig COUNTER_CONFIGS[Profiler::COUNTERS] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS}
+    };
+
+    int open_counter(const CounterConfig& counter) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = counter.type;
+        attr.config = counter.config;
+        attr.inherit = 1;           // count the threads a phase starts too
+        attr.exclude_kernel = 1;    // allowed at perf_event_paranoid 2
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    std::string paranoid_level() {
+        std::ifstream file("/proc/sys/kernel/perf_event_paranoid");
+        std::string level;
+        return file >> level ? level : "unknown";
+    }
+#endif
+
+    std::string format_count(double value, int precision = 0) {
+        return !std::isfinite(value) ? "n/a" : fmt::format("{:.{}f}", value, precision);
+    }
+}
+
+bool Profiler::enable() {
+    std::lock_guard<std::mutex> lock(phases_mutex);
+    if (active.load()) {
+        return true;
+    }
+
+#ifdef __linux__
+    std::string missing;
+    int first_error = 0;
+    bool any_open = false;
+    for (int c = 0; c < COUNTERS; ++c) {
+        fds[c] = open_counter(COUNTER_CONFIGS[c]);
+        if (fds[c] >= 0) {
+            any_open = true;
+        } else {
+            if (!first_error) first_error = errno;
+            missing += missing.empty() ? COUNTER_NAMES[c] : std::string(", ") + COUNTER_NAMES[c];
+        }
+    }
+    if (!missing.empty()) {
+        status_message = missing + " unavailable: " + std::strerror(first_error) +
+                         " (perf_event_paranoid is " + paranoid_level() + ")";
+    }
+    if (!any_open) {
+        return false;
+    }
+    profiling_thread = true;
+    active.store(true, std::memory_order_relaxed);
+    return true;
+#else
+    status_message = "hardware counters need Linux perf_event_open";
+    return false;
+#endif
+}
+
+const std::string& Profiler::status() {
+    return status_message;
+}
+
+bool Profiler::read(Values& values) {
+    if (!profiling_thread) {
+        return false;
+    }
+#ifdef __linux__
+    for (int c = 0; c < COUNTERS; ++c) {
+        values[c] = NOT_OPEN;
+        if (fds[c] < 0) continue;
+        uint64_t raw[3];    // value, time enabled, time running
+        if (::read(fds[c], raw, sizeof(raw)) != static_cast<ssize_t>(sizeof(raw))) continue;
+        // Scale up if the kernel multiplexed this counter with others
+        values[c] = raw[2] > 0 ? raw[0] * (static_cast<double>(raw[1]) / raw[2]) : 0.0;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Profiler::record(const char* name, const Values& start, const Values& end, size_t items) {
+    std::lock_guard<std::mutex> lock(phases_mutex);
+    PhaseCounters* phase = nullptr;
+    for (auto& existing : phases) {
+        if (std::strcmp(existing.name, name) == 0) phase = &existing;
+    }
+    if (!phase) {
+        phase = &phases.emplace_back(PhaseCounters{name});
+    }
+    phase->calls++;
+    phase->items += items;
+    for (int c = 0; c < COUNTERS; ++c) {
+        phase->totals[c] += end[c] - start[c];
+    }
+}
+
+void Profiler::write_report(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(phases_mutex);
+    out << "Hardware counters (each phase includes the threads it starts):\n";
+    if (!status_message.empty()) {
+        out << "  " << status_message << "\n";
+    }
+    if (phases.empty()) {
+        return;
+    }
+
+    out << fmt::format("{:<16} {:>6} {:>8} {:>14} {:>14} {:>6} {:>12} {:>10} {:>12} {:>10} {:>10} {:>10}\n",
+                       "phase", "calls", "items", "cycles", "instructions", "IPC", "LLC misses", "LLC/item",
+                       "br misses", "br/item", "task ms", "faults");
+    for (const auto& phase : phases) {
+        const auto& t = phase.totals;
+        double per_item = phase.items > 0 ? 1.0 / phase.items : NOT_OPEN;
+        out << fmt::format("{:<16} {:>6} {:>8} {:>14} {:>14} {:>6} {:>12} {:>10} {:>12} {:>10} {:>10} {:>10}\n",
+                           phase.name, phase.calls, phase.items,
+                           format_count(t[Cycles]), format_count(t[Instructions]),
+                           format_count(t[Instructions] / t[Cycles], 2),
+                           format_count(t[CacheMisses]), format_count(t[CacheMisses] * per_item, 1),
+                           format_count(t[BranchMisses]), format_count(t[BranchMisses] * per_item, 1),
+                           format_count(t[TaskClock] / 1e6, 3), format_count(t[PageFaults]));
+    }
+}
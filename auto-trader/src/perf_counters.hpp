@@ -0,0 +1,89 @@
+// perf_counters.hpp
+#pragma once
+#include "trace.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+// Hardware counters around the major phases, to tell cache-miss-bound work from
+// branch-bound work where wall-clock spans (trace.hpp) cannot.
+//
+// Profiler::enable() opens Linux perf_event_open counters for cycles, instructions,
+// last-level cache misses, branch misses, task clock and page faults on the calling
+// thread. A ProfileScope on that thread adds the counts over its lifetime to its phase,
+// along with the number of items (usually tickers) it handled, so the report can give
+// IPC and misses per item. Counters also count threads started while they are open, so a phase's
+// figures include any parallel_for workers it runs; scopes on other threads are ignored,
+// and a phase run once per item across workers is wrapped in one covering scope.
+//
+// Counters that cannot be opened (no PMU in a VM, perf_event_paranoid, not Linux) are
+// reported as n/a and the reason is given; if none can be opened profiling stays off.
+// Like TRACE_SCOPE, scopes cost one atomic load while disabled and nothing when built
+// with STOCK_ANALYZER_TRACING=0.
+class Profiler {
+public:
+    enum Counter { Cycles, Instructions, CacheMisses, BranchMisses, TaskClock, PageFaults, COUNTERS };
+    using Values = std::array<double, COUNTERS>;    // NaN for counters that are not open
+
+private:
+    static inline std::atomic<bool> active{false};
+
+public:
+    // False when no counter could be opened
+    static bool enable();
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+    // Which counters are missing and why; empty when all of them opened
+    static const std::string& status();
+
+    // Current counts, or false when called from a thread other than the one that enabled
+    static bool read(Values& values);
+    static void record(const char* name, const Values& start, const Values& end, size_t items);
+
+    // One line per phase in the order they were first recorded
+    static void write_report(std::ostream& out);
+};
+
+#if STOCK_ANALYZER_TRACING
+class ProfileScope {
+private:
+    static inline thread_local int covering_depth = 0;
+    const char* name;
+    size_t items = 0;
+    Profiler::Values start;
+    bool covering;
+    bool running;
+
+public:
+    // A covering scope is the only one recorded until it closes: scopes opened inside
+    // it on this thread, e.g. in this thread's share of a parallel_for, would also
+    // count the other workers and so are skipped.
+    explicit ProfileScope(const char* name, bool covering = false)
+        : name(name), covering(covering),
+          running(covering_depth == 0 && Profiler::enabled() && Profiler::read(start)) {
+        if (running && covering) ++covering_depth;
+    }
+    ~ProfileScope() {
+        if (!running) return;
+        if (covering) --covering_depth;
+        Profiler::Values end;
+        if (Profiler::read(end)) {
+            Profiler::record(name, start, end, items);
+        }
+    }
+
+    // Tickers handled, for the per-ticker columns
+    void set_items(size_t count) { items = count; }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+};
+#else
+class ProfileScope {
+public:
+    explicit ProfileScope(const char*, bool = false) {}
+    void set_items(size_t) {}
+};
+#endif
@@ -1,112 +1,122 @@
 #include "portfolio_rebalancer.hpp"
+#include "allocation.hpp"
+#include "arena.hpp"
+#include "loader.hpp"
+#include "memory.hpp"
+#include "perf_counters.hpp"
+#include "rebalance_session.hpp"
+#include "trace.hpp"
+#include "writer.hpp"
+#include <chrono>
 #include <fstream>
 #include <sstream>
 #include <algorithm>
 #include <cmath>
 #include <numeric>
 #include <iostream>
+#include <map>
+#include <span>
+#include <string_view>
+#include <unordered_set>
 
-std::string PortfolioRebalancer::get_future_date(const std::string& current_date, int holding_window) {
-    std::vector<std::string> all_dates;
-    for (const auto& [date_key, _] : date_to_sectors_cache) {
-        all_dates.push_back(date_key);
-    }
-    
-    std::sort(all_dates.begin(), all_dates.end());
-    auto current_it = std::find(all_dates.begin(), all_dates.end(), current_date);
+std::string PortfolioRebalancer::get_future_date(
+    const MarketData& data,
+    const std::string& current_date,
+    int holding_window) {
+    const auto& trading_dates = data.get_dates();
+    auto current_it = std::lower_bound(trading_dates.begin(), trading_dates.end(), current_date);
     
-    if (current_it == all_dates.end()) {
+    if (current_it == trading_dates.end() || *current_it != current_date) {
         throw std::runtime_error("Current date not found in data");
     }
     
-    if (std::distance(current_it, all_dates.end()) <= holding_window) {
+    if (std::distance(current_it, trading_dates.end()) <= holding_window) {
         throw std::runtime_error("Not enough future data available");
     }
     
     return *(current_it + holding_window);
 }
 
-void PortfolioRebalancer::preprocess_stock_data(const std::string& stock_data_path) {
-    std::ifstream file(stock_data_path);
-    if (!file.is_open()) {
-        throw std::runtime_error("Could not open stock data file: " + stock_data_path);
-    }
-
-    std::string line;
-    std::getline(file, line); // Skip header
-
-    while (std::getline(file, line)) {
-        std::stringstream ss(line);
-        std::string ticker, date, sector;
-        double close, open, low, high;
-        int volume;
-        
-        // Parse CSV line
-        std::string token;
-        std::vector<std::string> tokens;
-        while (std::getline(ss, token, ',')) {
-            tokens.push_back(token);
-        }
-        
-        if (tokens.size() < 8) continue; // Skip invalid lines
-        
-        ticker = tokens[0];
-        sector = tokens[1];
-        date = tokens[2];
-        close = std::stod(tokens[3]);
-        open = std::stod(tokens[4]);
-        low = std::stod(tokens[5]);
-        high = std::stod(tokens[6]);
-        volume = std::stoi(tokens[7]);
+PortfolioRebalancer::LoadedData PortfolioRebalancer::current_data() const {
+    std::lock_guard<std::mutex> lock(market_data_mutex);
+    return {market_data, market_data_generation};
+}
 
-        // Cache the data
-        stock_data_cache[date][ticker] = close;
-        ticker_to_sector_cache[ticker] = sector;
-        date_to_sectors_cache[date].insert(sector);
-    }
+std::shared_ptr<const MarketData> PortfolioRebalancer::current_market_data() const {
+    std::lock_guard<std::mutex> lock(market_data_mutex);
+    return market_data;
 }
 
-std::set<std::string> PortfolioRebalancer::get_sectors_from_date(const std::string& date) {
-    auto it = date_to_sectors_cache.find(date);
-    if (it == date_to_sectors_cache.end()) {
+std::set<std::string> PortfolioRebalancer::get_sectors_from_date(const MarketData& data, const std::string& date) {
+    uint32_t date_index = data.date_index(date);
+    if (date_index == MarketData::npos) {
         throw std::runtime_error("No sector data found for date: " + date);
     }
-    return it->second;
+    return data.sectors_on(date_index);
 }
 
-double PortfolioRebalancer::get_stock_price(const std::string& ticker, const std::string& date) {
-    auto date_it = stock_data_cache.find(date);
-    if (date_it == stock_data_cache.end()) {
+double PortfolioRebalancer::get_stock_price(
+    const MarketData& data,
+    const std::string& ticker,
+    const std::string& date) {
+    uint32_t date_index = data.date_index(date);
+    if (date_index == MarketData::npos) {
         throw std::runtime_error("No data found for date: " + date);
     }
     
-    auto ticker_it = date_it->second.find(ticker);
-    if (ticker_it == date_it->second.end()) {
+    uint32_t ticker_id = data.ticker_id(ticker);
+    uint32_t row = ticker_id == MarketData::npos ? MarketData::npos : data.find_row(ticker_id, date_index);
+    if (row == MarketData::npos) {
         throw std::runtime_error("No price data found for ticker: " + ticker + " on date: " + date);
     }
     
-    return ticker_it->second;
+    return data.close(row);
+}
+
+PriceHistory PortfolioRebalancer::get_ticker_history(
+    const MarketData& data,
+    const std::string& ticker,
+    const std::string& end_date) {
+    
+    // A ticker's closes are stored contiguously in date order
+    uint32_t ticker_id = data.ticker_id(ticker);
+    if (ticker_id == MarketData::npos) {
+        return {};
+    }
+    auto [first, last] = data.rows_before(ticker_id, data.dates_through(end_date));
+    return PriceHistory(data.close_data() + first, last - first);
+}
+
+std::string PortfolioRebalancer::get_speculated_roi_key(
+    const Strategy& strategy,
+    const std::string& ticker,
+    const std::string& date,
+    int holding_window,
+    uint64_t data_generation) {
+    return ticker + "_" + date + "_" + 
+           std::to_string(holding_window) + "_" + 
+           strategy.cache_key() + "_" +
+           std::to_string(data_generation);
 }
 
 double PortfolioRebalancer::get_speculated_roi(
-    const std::vector<double>& ticker_data,
+    PriceHistory ticker_data,
     Strategy& strategy,
     const std::string& ticker,
     const std::string& date,
-    int holding_window) {
+    int holding_window,
+    uint64_t data_generation) {
     
-    std::string cache_key = ticker + "_" + date + "_" + 
-                           std::to_string(holding_window) + "_" + 
-                           typeid(strategy).name();
+    std::string cache_key = get_speculated_roi_key(strategy, ticker, date, holding_window, data_generation);
     
-    auto it = speculated_roi_cache.find(cache_key);
-    if (it != speculated_roi_cache.end()) {
-        return it->second;
+    if (auto cached = speculated_roi_cache.find(cache_key)) {
+        return *cached;
     }
     
     try {
-        double roi = strategy.speculate(ticker_data, date, holding_window);
-        speculated_roi_cache[cache_key] = roi;
+        double roi = strategy.speculate(ticker, ticker_data, date, holding_window);
+        MemoryScope memory(Subsystem::Caches);
+        speculated_roi_cache.insert(cache_key, roi);
         return roi;
     } catch (const std::exception& e) {
         std::cerr << "Error processing " << ticker << ": " << e.what() << std::endl;
@@ -114,76 +124,87 @@ double PortfolioRebalancer::get_speculated_roi(
     }
 }
 
-std::optional<std::tuple<double, double, double>> PortfolioRebalancer::get_actual_roi(
-    const std::vector<double>& ticker_data,
-    const std::string& ticker,
-    const std::string& start_date,
-    int holding_window) {
-    
-    std::string cache_key = ticker + "_" + start_date + "_" + std::to_string(holding_window);
-    
-    auto it = actual_roi_cache.find(cache_key);
-    if (it != actual_roi_cache.end()) {
-        return it->second;
-    }
-    
-    if (ticker_data.empty()) {
-        return std::nullopt;
-    }
-    
-    try {
-        double start_price = get_stock_price(ticker, start_date);
-        auto future_date = get_future_date(start_date, holding_window);
-        double end_price = get_stock_price(ticker, future_date);
-        double actual_roi = (end_price - start_price) / start_price;
-        
-        auto result = std::make_tuple(start_price, end_price, actual_roi);
-        actual_roi_cache[cache_key] = result;
-        return result;
-    } catch (const std::exception&) {
-        return std::nullopt;
-    }
-}
-
 std::vector<std::pair<std::string, double>> PortfolioRebalancer::get_ranked_stocks(
+    const LoadedData& loaded,
     Strategy& speculation_strategy,
     const std::string& portfolio_date,
-    int holding_window) {
+    int holding_window,
+    const UniverseFilter& universe) {
     
+    const MarketData& data = *loaded.data;
     std::vector<std::pair<std::string, double>> rankings;
-    std::set<std::string> seen_tickers;
+    std::vector<std::string> pending_tickers;
+    std::vector<PriceHistory> pending_histories;
     
-    for (const auto& [ticker, price] : stock_data_cache[portfolio_date]) {
-        if (seen_tickers.find(ticker) != seen_tickers.end()) {
-            continue;
-        }
-        
-        seen_tickers.insert(ticker);
-        
-        // Gather historical data for this ticker
-        std::vector<double> ticker_data;
-        for (const auto& [date, prices] : stock_data_cache) {
-            if (date <= portfolio_date) {
-                auto it = prices.find(ticker);
-                if (it != prices.end()) {
-                    ticker_data.push_back(it->second);
+    uint32_t date_index = data.date_index(portfolio_date);
+    std::span<const uint32_t> rows;
+    if (date_index != MarketData::npos) {
+        rows = data.rows_on(date_index);
+    }
+    {
+        TRACE_SCOPE("gather_histories");
+        ProfileScope profile("history_build");
+        profile.set_items(rows.size());
+        for (uint32_t row : rows) {
+            // Illiquid and penny stocks are never scored
+            if (data.average_dollar_volume(row) < universe.min_adv ||
+                data.close(row) < universe.min_price) {
+                continue;
+            }
+
+            const std::string& ticker = data.ticker(data.row_ticker(row));
+            auto cached = speculated_roi_cache.find(
+                get_speculated_roi_key(speculation_strategy, ticker, portfolio_date, holding_window,
+                                       loaded.generation));
+            if (cached) {
+                if (*cached != 0.0) {
+                    rankings.emplace_back(ticker, *cached);
                 }
+                continue;
             }
+            
+            // Gather historical data for this ticker
+            pending_tickers.push_back(ticker);
+            pending_histories.push_back(get_ticker_history(data, ticker, portfolio_date));
         }
-        
-        double speculated_roi = get_speculated_roi(
-            ticker_data,
-            speculation_strategy,
-            ticker,
+    }
+    
+    // Score every uncached ticker in one call so the strategy can batch or
+    // parallelise across the universe
+    std::vector<double> speculated_rois;
+    {
+        TRACE_SCOPE("score");
+        ProfileScope profile("scoring");
+        profile.set_items(pending_tickers.size());
+        speculated_rois = speculation_strategy.speculate_batch(
+            pending_tickers,
+            pending_histories,
             portfolio_date,
             holding_window
         );
+    }
+    
+    for (size_t i = 0; i < pending_tickers.size(); ++i) {
+        const auto& ticker = pending_tickers[i];
+        // A ticker the strategy could not score is cached as 0.0, as a failed single
+        // score is, and left out of the ranking
+        if (std::isnan(speculated_rois[i])) {
+            speculated_rois[i] = 0.0;
+        }
+        {
+            MemoryScope memory(Subsystem::Caches);
+            speculated_roi_cache.insert(
+                get_speculated_roi_key(speculation_strategy, ticker, portfolio_date, holding_window,
+                                       loaded.generation),
+                speculated_rois[i]);
+        }
         
-        if (speculated_roi != 0.0) {
-            rankings.emplace_back(ticker, speculated_roi);
+        if (speculated_rois[i] != 0.0) {
+            rankings.emplace_back(ticker, speculated_rois[i]);
         }
     }
     
+    TRACE_SCOPE("sort_ranking");
     std::sort(rankings.begin(), rankings.end(),
               [](const auto& a, const auto& b) { return a.second > b.second; });
     
@@ -201,14 +222,17 @@ RebalanceSummary PortfolioRebalancer::get_rebalance_summary(
             0.0,
             0.0,
             std::nullopt,
+            std::nullopt,
+            std::nullopt,
             std::nullopt
         };
     }
     
+    ArenaScope arena;
     double total_portfolio_value = remaining_cash;
-    std::vector<double> speculated_rois;
+    std::pmr::vector<double> speculated_rois(arena.resource());
     double total_speculated_net_capital = 0.0;
-    std::vector<double> actual_rois;
+    std::pmr::vector<double> actual_rois(arena.resource());
     double total_actual_net_capital = 0.0;
     
     for (const auto& action : actions) {
@@ -239,165 +263,755 @@ RebalanceSummary PortfolioRebalancer::get_rebalance_summary(
         avg_speculated_roi,
         total_speculated_net_capital,
         avg_actual_roi,
-        total_actual_net_capital
+        total_actual_net_capital,
+        std::nullopt,
+        std::nullopt
     };
 }
 
-std::tuple<std::vector<RebalanceAction>, RebalanceSummary, Portfolio>
-PortfolioRebalancer::rebalance_portfolio(
+
+void PortfolioRebalancer::load_stock_data(const std::string& stock_data_path) {
+    std::lock_guard<std::mutex> lock(load_mutex);
+    if (stock_data_path == loaded_stock_data_path && loaded_query.everything()) {
+        return;
+    }
+
+    std::shared_ptr<const MarketData> data;
+    {
+        TRACE_SCOPE("load_stock_data");
+        ProfileScope profile("ingest");
+        MemoryScope memory(Subsystem::MarketData);
+        data = std::make_shared<const MarketData>(MarketData::load(stock_data_path));
+        profile.set_items(data->get_tickers().size());
+    }
+    install_market_data(std::move(data), stock_data_path);
+}
+
+LoadStats PortfolioRebalancer::load_stock_data(const std::string& stock_data_path, const LoadQuery& query) {
+    std::lock_guard<std::mutex> lock(load_mutex);
+    if (stock_data_path == loaded_stock_data_path && query == loaded_query) {
+        return {};
+    }
+
+    LoadStats stats;
+    std::shared_ptr<const MarketData> data;
+    {
+        TRACE_SCOPE("load_stock_data");
+        ProfileScope profile("ingest");
+        MemoryScope memory(Subsystem::MarketData);
+        data = std::make_shared<const MarketData>(
+            MarketData::load(stock_data_path, query, MarketData::DEFAULT_ADV_WINDOW, &stats));
+        profile.set_items(data->get_tickers().size());
+    }
+    install_market_data(std::move(data), stock_data_path, query);
+    return stats;
+}
+
+void PortfolioRebalancer::load_for_dates(const std::string& stock_data_path, Strategy& speculation_strategy,
+                                         const std::vector<std::string>& dates, int holding_window,
+                                         const RebalanceOptions& options, unsigned threads) {
+    // A strategy that may look at the whole history only scores right from the whole file
+    int strategy_history = speculation_strategy.required_history();
+    if (options.history_days <= 0 || strategy_history <= 0 || dates.empty()) {
+        load_and_score(stock_data_path, speculation_strategy, dates, holding_window, options.universe, threads);
+        return;
+    }
+
+    // Enough days for the strategy, the returns and correlations behind the options,
+    // and the average dollar volume on the first of them
+    int lookback = std::max({options.history_days, strategy_history, options.return_lookback(),
+                             options.max_correlation < 1.0 ? options.correlation_window : 0});
+    int days_before = lookback + static_cast<int>(MarketData::DEFAULT_ADV_WINDOW);
+    auto [first, last] = std::minmax_element(dates.begin(), dates.end());
+    LoadQuery query = MarketData::trading_window(stock_data_path, *first, days_before, 0);
+    query.last_date = MarketData::trading_window(stock_data_path, *last, 0, holding_window).last_date;
+    load_stock_data(stock_data_path, query);
+}
+
+uint64_t PortfolioRebalancer::install_market_data(std::shared_ptr<const MarketData> data,
+                                                  const std::string& stock_data_path,
+                                                  const LoadQuery& query) {
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> data_lock(market_data_mutex);
+        market_data = std::move(data);
+        generation = ++market_data_generation;
+    }
+    // Rankings started before the swap may still add scores under the old generation;
+    // they are never looked up again and go with the next load
+    speculated_roi_cache.clear();
+    {
+        std::lock_guard<std::mutex> correlation_lock(correlation_mutex);
+        correlation_cache.reset();
+        correlation_generation = generation;
+    }
+    loaded_stock_data_path = stock_data_path;
+    loaded_query = query;
+    return generation;
+}
+
+IngestStats PortfolioRebalancer::load_and_score(
+    const std::string& stock_data_path,
     Strategy& speculation_strategy,
+    const std::vector<std::string>& dates,
     int holding_window,
-    int max_holdings,
-    int max_sector_lead,
-    double adjust_by) {
-    
-    // Load and preprocess data
-    preprocess_stock_data("./data/stock_data.csv");
-    
-    // Load portfolio from JSON file
-    std::ifstream f("./data/portfolio.json");
-    if (!f.is_open()) {
-        throw std::runtime_error("Could not open portfolio file");
-    }
-    json portfolio_json = json::parse(f);
-    Portfolio portfolio{
-        portfolio_json["id"],
-        portfolio_json["date"],
-        portfolio_json["cash"],
-        portfolio_json["holdings"]
+    const UniverseFilter& universe,
+    unsigned threads) {
+    
+    std::unique_lock<std::mutex> lock(load_mutex);
+    if (stock_data_path == loaded_stock_data_path && loaded_query.everything()) {
+        return {};
+    }
+    if (MarketData::is_bar_file(stock_data_path)) {
+        // Already a straight copy into columns; nothing to overlap with
+        lock.unlock();
+        load_stock_data(stock_data_path);
+        return {};
+    }
+
+    // Score each run on every requested date it trades on; runs scored by several
+    // threads at once collect here
+    std::mutex scores_mutex;
+    std::vector<std::tuple<std::string, const std::string*, double>> scores;   // ticker, date, roi
+    auto score = [&](std::span<const TickerRun* const> runs) {
+        for (const auto& date : dates) {
+            std::vector<std::string> tickers;
+            std::vector<PriceHistory> histories;
+            for (const TickerRun* run : runs) {
+                auto it = std::lower_bound(run->dates.begin(), run->dates.end(), date);
+                if (it == run->dates.end() || *it != date) {
+                    continue;
+                }
+                size_t row = it - run->dates.begin();
+                // Illiquid and penny stocks are never scored
+                if (run->average_dollar_volumes[row] < universe.min_adv || run->closes[row] < universe.min_price) {
+                    continue;
+                }
+                tickers.push_back(run->ticker);
+                histories.emplace_back(run->closes.data(), row + 1);
+            }
+            if (tickers.empty()) {
+                continue;
+            }
+
+            auto rois = speculation_strategy.speculate_batch(tickers, histories, date, holding_window);
+            std::lock_guard<std::mutex> scores_lock(scores_mutex);
+            for (size_t i = 0; i < tickers.size(); ++i) {
+                scores.emplace_back(std::move(tickers[i]), &date, std::isnan(rois[i]) ? 0.0 : rois[i]);
+            }
+        }
     };
+
+    IngestResult ingest;
+    {
+        TRACE_SCOPE("load_stock_data");
+        ProfileScope profile("ingest");
+        MemoryScope memory(Subsystem::MarketData);
+        ingest = IngestPipeline::load_csv(
+            stock_data_path,
+            speculation_strategy.scores_independently() ? IngestPipeline::ScoreBatch(score) : IngestPipeline::ScoreBatch(),
+            threads);
+        profile.set_items(ingest.data.get_tickers().size());
+    }
+    uint64_t generation = install_market_data(std::make_shared<const MarketData>(std::move(ingest.data)),
+                                              stock_data_path);
+
+    // A ticker split over several runs was scored on part of its history; the
+    // ranking scores it again from the full data
+    MemoryScope memory(Subsystem::Caches);
+    for (const auto& [ticker, date, roi] : scores) {
+        if (!ingest.split_tickers.count(ticker)) {
+            speculated_roi_cache.insert(
+                get_speculated_roi_key(speculation_strategy, ticker, *date, holding_window, generation), roi);
+        }
+    }
+    return ingest.stats;
+}
+
+void PortfolioRebalancer::clear_caches() {
+    std::lock_guard<std::mutex> lock(load_mutex);
+    install_market_data(std::make_shared<const MarketData>(), "");
+}
+
+TickerIndex PortfolioRebalancer::get_ticker_index() const {
+    return TickerIndex(current_market_data()->get_tickers());
+}
+
+RankingSnapshot PortfolioRebalancer::build_ranking_snapshot(
+    Strategy& speculation_strategy,
+    const std::string& date,
+    int holding_window,
+    const UniverseFilter& universe) {
     
-    auto sectors = get_sectors_from_date(portfolio.date);
+    return build_ranking_snapshot(current_data(), speculation_strategy, date, holding_window, universe);
+}
+
+RankingSnapshot PortfolioRebalancer::build_ranking_snapshot(
+    LoadedData loaded,
+    Strategy& speculation_strategy,
+    const std::string& date,
+    int holding_window,
+    const UniverseFilter& universe) {
     
-    // Calculate current holdings and valuations
-    std::unordered_map<std::string, int> old_holdings;
-    std::unordered_map<std::string, double> old_portfolio_valuations;
-    double total_value = portfolio.cash;
+    TRACE_SCOPE("ranking");
+    MemoryScope memory(Subsystem::Rebalance);
+    const MarketData& data = *loaded.data;
+    RankingSnapshot snapshot;
+    snapshot.market_data = loaded.data;
+    snapshot.data_generation = loaded.generation;
+    snapshot.date = date;
+    snapshot.holding_window = holding_window;
+    snapshot.sectors = get_sectors_from_date(data, date);
+    try {
+        snapshot.future_date = get_future_date(data, date, holding_window);
+    } catch (const std::runtime_error&) {
+        // No realised returns to report; allocation fails later for lack of a future date
+    }
+
+    snapshot.ranked_stocks = get_ranked_stocks(loaded, speculation_strategy, date, holding_window, universe);
+    snapshot.rank_of.reserve(snapshot.ranked_stocks.size());
+    for (size_t i = 0; i < snapshot.ranked_stocks.size(); ++i) {
+        snapshot.rank_of.emplace(snapshot.ranked_stocks[i].first, i);
+    }
+
+    // get_ranked_stocks has cached a score for every ticker priced on the date that
+    // the universe filter kept
+    TRACE_SCOPE("actual_roi");
+    auto rows = data.rows_on(data.date_index(date));
+    uint32_t future_index = snapshot.future_date ? data.date_index(*snapshot.future_date) : MarketData::npos;
+
+    snapshot.prices.reserve(rows.size());
+    snapshot.average_dollar_volumes.reserve(rows.size());
+    snapshot.speculated_rois.reserve(rows.size());
+    for (uint32_t row : rows) {
+        uint32_t ticker_id = data.row_ticker(row);
+        const std::string& ticker = data.ticker(ticker_id);
+        double start_price = data.close(row);
+        snapshot.prices.emplace(ticker, start_price);
+        snapshot.average_dollar_volumes.emplace(ticker, data.average_dollar_volume(row));
+
+        snapshot.speculated_rois[ticker] = speculated_roi_cache.find(
+            get_speculated_roi_key(speculation_strategy, ticker, date, holding_window,
+                                   loaded.generation)).value_or(0.0);
+
+        if (future_index != MarketData::npos) {
+            uint32_t end_row = data.find_row(ticker_id, future_index);
+            if (end_row != MarketData::npos) {
+                double end_price = data.close(end_row);
+                snapshot.actual_rois[ticker] = std::make_tuple(
+                    start_price, end_price, (end_price - start_price) / start_price);
+            }
+        }
+    }
+
+    return snapshot;
+}
+
+RankingSnapshot PortfolioRebalancer::build_ranking_snapshot(
+    Strategy& speculation_strategy,
+    const Portfolio& portfolio,
+    int holding_window,
+    const UniverseFilter& universe) {
     
+    auto loaded = current_data();
+    std::vector<std::string> held;
     for (const auto& holding : portfolio.holdings) {
-        std::string ticker = std::get<std::string>(holding.at("ticker"));
-        int quantity = std::get<int>(holding.at("quantity"));
-        old_holdings[ticker] = quantity;
-        
-        double price = get_stock_price(ticker, portfolio.date);
-        double value = price * quantity;
-        total_value += value;
-        old_portfolio_valuations[ticker] = value;
+        held.push_back(std::get<std::string>(holding.at("ticker")));
+    }
+    score_holdings(loaded, speculation_strategy, held, portfolio.date, holding_window);
+    return build_ranking_snapshot(std::move(loaded), speculation_strategy, portfolio.date, holding_window, universe);
+}
+
+void PortfolioRebalancer::score_holdings(
+    const LoadedData& loaded,
+    Strategy& strategy,
+    const std::vector<std::string>& tickers,
+    const std::string& date,
+    int holding_window) {
+    
+    TRACE_SCOPE("score_holdings");
+    MemoryScope memory(Subsystem::Rebalance);
+    for (const auto& ticker : tickers) {
+        get_speculated_roi(get_ticker_history(*loaded.data, ticker, date), strategy, ticker, date, holding_window,
+                           loaded.generation);
     }
+}
 
-    // Get current holdings ranked by speculated ROI
-    std::vector<std::pair<std::string, double>> old_ranked_stocks;
-    for (const auto& [ticker, quantity] : old_holdings) {
-        std::vector<double> ticker_data;
-        for (const auto& [date, prices] : stock_data_cache) {
-            if (date <= portfolio.date) {
-                auto it = prices.find(ticker);
-                if (it != prices.end()) {
-                    ticker_data.push_back(it->second);
-                }
+void PortfolioRebalancer::add_risk_reports(
+    const RankingSnapshot& snapshot,
+    const PortfolioState& state,
+    const std::vector<RebalanceAction>& actions,
+    const RiskOptions& options,
+    RebalanceSummary& summary) {
+    
+    TRACE_SCOPE("risk_report");
+    if (options.lookback_period <= 0 || snapshot.daily_returns.empty()) {
+        return;
+    }
+    size_t days = std::min<size_t>(options.lookback_period, snapshot.daily_returns.begin()->second.size());
+    if (days < 2) {
+        return;
+    }
+
+    // Old and new dollar positions side by side, one row per ticker held in either
+    ArenaScope arena;
+    std::vector<const float*> series;
+    std::pmr::vector<double> positions(arena.resource());
+    std::pmr::unordered_map<std::string_view, size_t> row_of(arena.resource());
+    auto add_position = [&](const std::string& ticker, double value, size_t column) {
+        auto row_it = row_of.find(ticker);
+        if (row_it == row_of.end()) {
+            auto series_it = snapshot.daily_returns.find(ticker);
+            if (series_it == snapshot.daily_returns.end()) return;
+            row_it = row_of.emplace(ticker, series.size()).first;
+            series.push_back(series_it->second.data() + (series_it->second.size() - days));
+            positions.resize(positions.size() + 2, 0.0);
+        }
+        positions[row_it->second * 2 + column] += value;
+    };
+    for (const auto& [ticker, value] : state.valuations) {
+        add_position(ticker, value, 0);
+    }
+    for (const auto& action : actions) {
+        add_position(action.ticker, action.new_holding_value, 1);
+    }
+
+    std::pmr::vector<double> pnl(days * 2, arena.resource());
+    historical_pnl(series, days, positions.data(), 2, pnl.data());
+
+    std::vector<double> old_pnl(days);
+    std::vector<double> new_pnl(days);
+    for (size_t t = 0; t < days; ++t) {
+        old_pnl[t] = pnl[t * 2];
+        new_pnl[t] = pnl[t * 2 + 1];
+    }
+    summary.old_risk = risk_report(old_pnl, state.total_value, options.confidence);
+    summary.new_risk = risk_report(new_pnl, summary.total_portfolio_value, options.confidence);
+}
+
+void PortfolioRebalancer::load_returns(RankingSnapshot& snapshot, int lookback) const {
+    if (lookback <= snapshot.return_lookback) {
+        return;
+    }
+    TRACE_SCOPE("load_returns");
+    MemoryScope memory(Subsystem::Rebalance);
+    const MarketData& data = *snapshot.market_data;
+
+    // Returns over the window's dates need the close before them too
+    size_t end_date = data.dates_through(snapshot.date);
+    size_t days = std::min<size_t>(lookback, end_date > 0 ? end_date - 1 : 0);
+    size_t first_date = end_date - std::min(days + 1, end_date);
+
+    snapshot.daily_returns.clear();
+    snapshot.daily_returns.reserve(snapshot.prices.size());
+    for (const auto& [ticker, _] : snapshot.prices) {
+        std::vector<float> series(days, 0.0f);
+        uint32_t ticker_id = data.ticker_id(ticker);
+        auto [first, last] = data.rows_before(ticker_id, end_date);
+        double previous = 0.0;
+        for (uint32_t row = first; row < last; ++row) {
+            size_t k = data.row_date(row);
+            if (k < first_date) continue;
+            k -= first_date;
+            double price = data.close(row);
+            if (k > 0 && previous > 0.0) {
+                series[k - 1] = static_cast<float>(price / previous - 1.0);
             }
+            previous = price;
         }
-        
-        double speculated_roi = get_speculated_roi(
-            ticker_data,
-            speculation_strategy,
-            ticker,
-            portfolio.date,
-            holding_window
-        );
-        old_ranked_stocks.emplace_back(ticker, speculated_roi);
+        snapshot.daily_returns.emplace(ticker, std::move(series));
     }
-    std::sort(old_ranked_stocks.begin(), old_ranked_stocks.end(),
-              [](const auto& a, const auto& b) { return a.second > b.second; });
+    snapshot.return_lookback = lookback;
+}
+
+void PortfolioRebalancer::load_correlations(RankingSnapshot& snapshot, int window) {
+    if (snapshot.correlations && snapshot.correlations->get_window() == static_cast<size_t>(window)) {
+        return;
+    }
+    TRACE_SCOPE("load_correlations");
+    MemoryScope memory(Subsystem::Caches);
+    const MarketData& data = *snapshot.market_data;
+    std::lock_guard<std::mutex> lock(correlation_mutex);
 
-    // Get all available stocks ranked by ROI
-    auto unfiltered_ranked_stocks = get_ranked_stocks(
-        speculation_strategy,
-        portfolio.date,
-        holding_window
-    );
+    // `window` returns need window + 1 closes
+    const auto& trading_dates = data.get_dates();
+    auto end_it = trading_dates.begin() + data.dates_through(snapshot.date);
+    auto start_it = end_it - std::min<ptrdiff_t>(window + 1, end_it - trading_dates.begin());
 
-    // Filter stocks ensuring sector balance
+    // A snapshot of replaced data neither reuses nor replaces the current cache
+    bool current = snapshot.data_generation == correlation_generation;
+    bool reuse = false;
+    if (current && correlation_cache && correlation_cache->get_window() == static_cast<size_t>(window)) {
+        // Roll forward from the cache's date if that is still inside the new window
+        auto cached = std::lower_bound(trading_dates.begin(), end_it, correlation_cache->get_date());
+        if (cached != end_it && *cached == correlation_cache->get_date() && cached + 1 >= start_it) {
+            start_it = cached + 1;
+            reuse = true;
+        }
+    }
+
+    std::shared_ptr<CorrelationCache> cache;
+    if (!reuse) {
+        cache = std::make_shared<CorrelationCache>(window);
+    } else if (start_it != end_it && correlation_cache.use_count() > 1) {
+        cache = std::make_shared<CorrelationCache>(*correlation_cache);
+    } else {
+        cache = correlation_cache;
+    }
+    if (current) {
+        correlation_cache = cache;
+    }
+    std::vector<std::pair<std::string, double>> closes;
+    for (auto it = start_it; it != end_it; ++it) {
+        closes.clear();
+        for (uint32_t row : data.rows_on(static_cast<uint32_t>(it - trading_dates.begin()))) {
+            closes.emplace_back(data.ticker(data.row_ticker(row)), data.close(row));
+        }
+        cache->advance(*it, closes);
+    }
+    snapshot.correlations = std::move(cache);
+}
+
+std::vector<double> PortfolioRebalancer::target_weights(
+    const RankingSnapshot& snapshot,
+    const std::vector<std::pair<std::string, double>>& ranked_stocks,
+    int n,
+    const RebalanceOptions& options) const {
+    
+    TRACE_SCOPE("optimizer");
+    const auto& optimizer = options.optimizer;
+    if (snapshot.daily_returns.empty()) {
+        throw std::runtime_error("No return history loaded for the " +
+                                 std::string(optimizer.mode == AllocationMode::MeanVariance ? "mean-variance" : "risk parity") +
+                                 " allocation on " + snapshot.date);
+    }
+
+    size_t days = std::min<size_t>(std::max(optimizer.lookback_period, 1),
+                                   snapshot.daily_returns.begin()->second.size());
+    std::vector<float> returns(static_cast<size_t>(n) * days, 0.0f);
+    std::vector<double> expected_returns(n);
+    std::vector<int> sectors(n);
+
+    for (int i = 0; i < n; ++i) {
+        const auto& [ticker, speculated_roi] = ranked_stocks[i];
+        expected_returns[i] = speculated_roi;
+
+        // Sectors are numbered by their position in the date's sector set; a sector
+        // missing from it (a ticker that changed sector) gets the spare id
+        auto sector_it = snapshot.sectors.find(snapshot.market_data->sector_of(ticker));
+        sectors[i] = static_cast<int>(std::distance(snapshot.sectors.begin(), sector_it));
+
+        auto series_it = snapshot.daily_returns.find(ticker);
+        if (series_it != snapshot.daily_returns.end()) {
+            const auto& series = series_it->second;
+            std::copy(series.end() - days, series.end(), returns.begin() + static_cast<size_t>(i) * days);
+        }
+    }
+
+    // Daily covariance scaled to the holding window the ROIs are speculated over
+    std::vector<double> covariance;
+    shrunk_covariance(returns.data(), n, days, covariance);
+    for (double& c : covariance) {
+        c *= snapshot.holding_window;
+    }
+
+    size_t n_sectors = snapshot.sectors.size() + 1;
+    if (optimizer.mode == AllocationMode::MeanVariance) {
+        return mean_variance_weights(expected_returns, covariance, sectors, n_sectors, optimizer);
+    }
+    return risk_parity_weights(covariance, sectors, n_sectors, optimizer);
+}
+
+std::vector<std::pair<std::string, double>> PortfolioRebalancer::filter_ranked_stocks(
+    const RankingSnapshot& snapshot,
+    std::span<const std::pair<std::string, double>> old_ranked_stocks,
+    int max_holdings,
+    int max_sector_lead,
+    double max_correlation,
+    size_t* consumed) const {
+    
+    TRACE_SCOPE("sector_filter");
+    ProfileScope profile("selection");
+    MemoryScope memory(Subsystem::Rebalance);
+    ArenaScope arena;
+    const auto& unfiltered_ranked_stocks = snapshot.ranked_stocks;
     std::vector<std::pair<std::string, double>> ranked_stocks;
-    std::unordered_map<std::string, int> sector_counts;
-    for (const auto& sector : sectors) {
+    std::pmr::unordered_map<std::string_view, int> sector_counts(arena.resource());
+    for (const auto& sector : snapshot.sectors) {
         sector_counts[sector] = 0;
     }
 
-    while (ranked_stocks.size() < max_holdings && !unfiltered_ranked_stocks.empty()) {
+    // Correlation ids of everything selected so far, when new picks are checked against them
+    const CorrelationCache* correlations = nullptr;
+    if (max_correlation < 1.0) {
+        correlations = snapshot.correlations.get();
+        if (!correlations) {
+            throw std::runtime_error("No correlations loaded for the ranking on " + snapshot.date);
+        }
+    }
+    std::pmr::vector<uint32_t> selected_ids(arena.resource());
+    auto too_correlated = [&](uint32_t id) {
+        return std::any_of(selected_ids.begin(), selected_ids.end(),
+                           [&](uint32_t other) { return correlations->correlation(id, other) > max_correlation; });
+    };
+
+    // Holdings are kept where the ranking reaches them, found by ticker rather than by
+    // walking them in step with the ranking: a holding the universe filter dropped is
+    // never reached, and ties in ROI may order the two lists differently
+    std::pmr::unordered_map<std::string_view, size_t> held_at(arena.resource());
+    for (size_t i = 0; i < old_ranked_stocks.size(); ++i) {
+        held_at.emplace(old_ranked_stocks[i].first, i);
+    }
+    std::pmr::vector<char> kept(old_ranked_stocks.size(), 0, arena.resource());
+
+    size_t next = 0;
+    while (ranked_stocks.size() < max_holdings && next < unfiltered_ranked_stocks.size()) {
+        const auto& ticker = unfiltered_ranked_stocks[next].first;
         // First try to keep high-performing current holdings
-        if (!old_ranked_stocks.empty() && !unfiltered_ranked_stocks.empty() &&
-            old_ranked_stocks.front().first == unfiltered_ranked_stocks.front().first) {
-            ranked_stocks.push_back(old_ranked_stocks.front());
-            old_ranked_stocks.erase(old_ranked_stocks.begin());
-            unfiltered_ranked_stocks.erase(unfiltered_ranked_stocks.begin());
+        auto held_it = held_at.find(ticker);
+        if (held_it != held_at.end()) {
+            if (correlations) {
+                selected_ids.push_back(correlations->id(ticker));
+            }
+            ranked_stocks.push_back(old_ranked_stocks[held_it->second]);
+            kept[held_it->second] = 1;
         } else {
-            auto& [ticker, roi] = unfiltered_ranked_stocks.front();
-            std::string sector = ticker_to_sector_cache[ticker];
+            const std::string& sector = snapshot.market_data->sector_of(ticker);
             int min_sector_count = std::min_element(
                 sector_counts.begin(), sector_counts.end(),
                 [](const auto& a, const auto& b) { return a.second < b.second; }
             )->second;
 
             if (sector_counts[sector] < min_sector_count + max_sector_lead) {
-                sector_counts[sector]++;
-                ranked_stocks.push_back(unfiltered_ranked_stocks.front());
+                uint32_t id = correlations ? correlations->id(ticker) : CorrelationCache::npos;
+                if (!correlations || !too_correlated(id)) {
+                    sector_counts[sector]++;
+                    ranked_stocks.push_back(unfiltered_ranked_stocks[next]);
+                    if (correlations) {
+                        selected_ids.push_back(id);
+                    }
+                }
             }
-            unfiltered_ranked_stocks.erase(unfiltered_ranked_stocks.begin());
         }
+        ++next;
     }
 
+    if (consumed) {
+        *consumed = next;
+    }
+    profile.set_items(next);
+
     // Add remaining old stocks at the end
-    ranked_stocks.insert(ranked_stocks.end(), 
-                        old_ranked_stocks.begin(), 
-                        old_ranked_stocks.end());
+    for (size_t i = 0; i < old_ranked_stocks.size(); ++i) {
+        if (!kept[i]) {
+            ranked_stocks.push_back(old_ranked_stocks[i]);
+        }
+    }
+    return ranked_stocks;
+}
+
+CandidateList PortfolioRebalancer::select_candidates(
+    const RankingSnapshot& snapshot,
+    int max_holdings,
+    int max_sector_lead,
+    double max_correlation) const {
+    
+    CandidateList candidates;
+    candidates.max_holdings = max_holdings;
+    candidates.max_sector_lead = max_sector_lead;
+    candidates.max_correlation = max_correlation;
+    candidates.ranked_stocks = filter_ranked_stocks(snapshot, {}, max_holdings, max_sector_lead,
+                                                    max_correlation, &candidates.consumed);
+    return candidates;
+}
+
+PortfolioState PortfolioRebalancer::prepare_portfolio(
+    const RankingSnapshot& snapshot,
+    const Portfolio& portfolio,
+    std::pmr::memory_resource* resource) const {
+    
+    TRACE_SCOPE("prepare_portfolio");
+    MemoryScope memory(Subsystem::Rebalance);
+    if (portfolio.date != snapshot.date) {
+        throw std::runtime_error("Portfolio date " + portfolio.date +
+                                 " does not match ranking date " + snapshot.date);
+    }
+
+    PortfolioState state(resource);
+    state.id = portfolio.id;
+    state.cash = portfolio.cash;
+    state.total_value = portfolio.cash;
+
+    // Calculate current holdings and valuations
+    for (const auto& holding : portfolio.holdings) {
+        std::string ticker = std::get<std::string>(holding.at("ticker"));
+        int quantity = std::get<int>(holding.at("quantity"));
+        state.holdings[ticker] = quantity;
+
+        auto price_it = snapshot.prices.find(ticker);
+        if (price_it == snapshot.prices.end()) {
+            throw std::runtime_error("No price data found for ticker: " + ticker + " on date: " + snapshot.date);
+        }
+        double value = price_it->second * quantity;
+        state.total_value += value;
+        state.valuations[ticker] = value;
+    }
+
+    // Get current holdings ranked by speculated ROI
+    for (const auto& [ticker, quantity] : state.holdings) {
+        auto roi_it = snapshot.speculated_rois.find(ticker);
+        state.ranked_holdings.emplace_back(ticker, roi_it != snapshot.speculated_rois.end() ? roi_it->second : 0.0);
+
+        auto rank_it = snapshot.rank_of.find(ticker);
+        if (rank_it != snapshot.rank_of.end()) {
+            state.best_holding_rank = std::min(state.best_holding_rank, rank_it->second);
+        }
+    }
+    std::sort(state.ranked_holdings.begin(), state.ranked_holdings.end(),
+              [](const auto& a, const auto& b) { return a.second > b.second; });
+
+    return state;
+}
+
+std::vector<std::pair<std::string, double>> PortfolioRebalancer::select_for_portfolio(
+    const RankingSnapshot& snapshot,
+    const CandidateList& candidates,
+    const PortfolioState& state) const {
+    
+    // Filter stocks ensuring sector balance. The shared selection applies unless a
+    // holding is among the tickers it examined, which changes the walk.
+    if (state.best_holding_rank < candidates.consumed) {
+        return filter_ranked_stocks(snapshot, state.ranked_holdings, candidates.max_holdings,
+                                    candidates.max_sector_lead, candidates.max_correlation);
+    }
+
+    std::vector<std::pair<std::string, double>> ranked_stocks;
+    ranked_stocks.reserve(candidates.ranked_stocks.size() + state.ranked_holdings.size());
+    ranked_stocks.insert(ranked_stocks.end(), candidates.ranked_stocks.begin(), candidates.ranked_stocks.end());
+    ranked_stocks.insert(ranked_stocks.end(), state.ranked_holdings.begin(), state.ranked_holdings.end());
+    return ranked_stocks;
+}
+
+RebalanceResult PortfolioRebalancer::allocate_portfolio(
+    const RankingSnapshot& snapshot,
+    const CandidateList& candidates,
+    const Portfolio& portfolio,
+    double adjust_by,
+    const RebalanceOptions& options) const {
+    
+    ArenaScope arena;
+    auto state = prepare_portfolio(snapshot, portfolio, arena.resource());
+    // The shared weights cover the candidates' first max_holdings names, which lead
+    // the selection whenever the portfolio takes the shared walk
+    bool shared = state.best_holding_rank >= candidates.consumed && !candidates.weights.empty();
+    return allocate_portfolio(snapshot, state, select_for_portfolio(snapshot, candidates, state),
+                              candidates.max_holdings, adjust_by, options,
+                              shared ? &candidates.weights : nullptr);
+}
+
+std::vector<double> PortfolioRebalancer::optimizer_weights(
+    const RankingSnapshot& snapshot,
+    const std::vector<std::pair<std::string, double>>& ranked_stocks,
+    int max_holdings,
+    const RebalanceOptions& options) const {
+    
+    int n = std::min(max_holdings, static_cast<int>(ranked_stocks.size()));
+    if (options.optimizer.mode == AllocationMode::RankRamp || n <= 0) {
+        return {};
+    }
+    return target_weights(snapshot, ranked_stocks, n, options);
+}
+
+RebalanceResult PortfolioRebalancer::allocate_portfolio(
+    const RankingSnapshot& snapshot,
+    const PortfolioState& state,
+    const std::vector<std::pair<std::string, double>>& ranked_stocks,
+    int max_holdings,
+    double adjust_by,
+    const RebalanceOptions& options,
+    const std::vector<double>* weights) const {
+    
+    TRACE_SCOPE("allocate");
+    ProfileScope profile("allocation");
+    MemoryScope memory(Subsystem::Rebalance);
+    // The valuation maps and buy candidates are keyed by views of ranked_stocks' tickers
+    ArenaScope arena;
+    profile.set_items(ranked_stocks.size());
+    auto get_price = [&](const std::string& ticker) {
+        auto it = snapshot.prices.find(ticker);
+        if (it == snapshot.prices.end()) {
+            throw std::runtime_error("No price data found for ticker: " + ticker + " on date: " + snapshot.date);
+        }
+        return it->second;
+    };
+    auto held_shares = [&](const std::string& ticker) {
+        auto it = state.holdings.find(ticker);
+        return it != state.holdings.end() ? it->second : 0;
+    };
+    auto held_value = [&](const std::string& ticker) {
+        auto it = state.valuations.find(ticker);
+        return it != state.valuations.end() ? it->second : 0.0;
+    };
 
     // Calculate target valuations
-    std::unordered_map<std::string, double> new_portfolio_valuations;
+    std::pmr::unordered_map<std::string_view, double> new_portfolio_valuations(arena.resource());
     int n = std::min(max_holdings, static_cast<int>(ranked_stocks.size()));
+    std::vector<double> computed_weights;
+    if (!weights) {
+        computed_weights = optimizer_weights(snapshot, ranked_stocks, max_holdings, options);
+        weights = &computed_weights;
+    }
     for (int i = 0; i < ranked_stocks.size(); ++i) {
         const auto& [ticker, _] = ranked_stocks[i];
         if (i < n) {
-            new_portfolio_valuations[ticker] = (2.0 * (n - i) * total_value) / (n * n);
+            new_portfolio_valuations[ticker] = weights->empty()
+                ? (2.0 * (n - i) * state.total_value) / (n * n)
+                : (*weights)[i] * state.total_value;
         } else {
             new_portfolio_valuations[ticker] = 0.0;
         }
     }
 
-    // Blend valuations
-    std::unordered_map<std::string, double> blended_portfolio_valuations;
-    std::set<std::string> all_tickers;
-    for (const auto& [ticker, _] : old_portfolio_valuations) all_tickers.insert(ticker);
-    for (const auto& [ticker, _] : new_portfolio_valuations) all_tickers.insert(ticker);
+    // Blend valuations. Every holding is in ranked_stocks, so this covers them all.
+    std::pmr::unordered_map<std::string_view, double> blended_portfolio_valuations(arena.resource());
+    for (const auto& [ticker, new_val] : new_portfolio_valuations) {
+        blended_portfolio_valuations[ticker] =
+            held_value(std::string(ticker)) * (1 - adjust_by) + new_val * adjust_by;
+    }
 
-    for (const auto& ticker : all_tickers) {
-        double old_val = old_portfolio_valuations.count(ticker) ? 
-                        old_portfolio_valuations[ticker] : 0.0;
-        double new_val = new_portfolio_valuations.count(ticker) ? 
-                        new_portfolio_valuations[ticker] : 0.0;
-        blended_portfolio_valuations[ticker] = old_val * (1 - adjust_by) + new_val * adjust_by;
+    // Don't build positions past what the stock trades. Existing positions above the cap
+    // are left alone rather than sold down, and the value held back stays in cash.
+    double held_back_cash = 0.0;
+    if (options.universe.max_position_pct_adv > 0.0) {
+        for (auto& [ticker, target_val] : blended_portfolio_valuations) {
+            std::string held_ticker(ticker);
+            auto adv_it = snapshot.average_dollar_volumes.find(held_ticker);
+            double adv = adv_it != snapshot.average_dollar_volumes.end() ? adv_it->second : 0.0;
+            double cap = std::max(adv * options.universe.max_position_pct_adv / 100.0, held_value(held_ticker));
+            if (target_val > cap) {
+                held_back_cash += target_val - cap;
+                target_val = cap;
+            }
+        }
     }
 
     // SELLS to free up cash
-    double available_cash = portfolio.cash;
+    double available_cash = state.cash;
     std::vector<RebalanceAction> actions;
 
     for (const auto& [ticker, speculated_roi] : ranked_stocks) {
-        double current_val = old_portfolio_valuations.count(ticker) ? 
-                            old_portfolio_valuations[ticker] : 0.0;
-        double target_val = blended_portfolio_valuations.count(ticker) ? 
-                        blended_portfolio_valuations[ticker] : 0.0;
+        double current_val = held_value(ticker);
+        auto target_it = blended_portfolio_valuations.find(ticker);
+        double target_val = target_it != blended_portfolio_valuations.end() ? target_it->second : 0.0;
         
-        std::cout << "Current ticker: " << ticker << std::endl;
         if (current_val > target_val) {
-            double current_price = get_stock_price(ticker, portfolio.date);
-            int current_quantity = old_holdings[ticker];
+            double current_price = get_price(ticker);
+            int current_quantity = held_shares(ticker);
             int target_quantity = static_cast<int>(target_val / current_price);
             int shares_to_sell = current_quantity - target_quantity;
             double new_holding_value = target_quantity * current_price;
             
             if (shares_to_sell > 0) {
-                std::cout << "selling shares ticker: " << ticker << std::endl;
                 RebalanceAction action{
                     "SELL",
                     ticker,
@@ -412,7 +1026,6 @@ PortfolioRebalancer::rebalance_portfolio(
                 actions.push_back(action);
                 available_cash += current_price * shares_to_sell;
             } else if (target_quantity > 0) {
-                std::cout << "target quantity ticker: " << ticker << std::endl;
                 RebalanceAction hold_action{
                     "HOLD",
                     ticker,
@@ -431,31 +1044,32 @@ PortfolioRebalancer::rebalance_portfolio(
 
     // BUY initial stocks starting with highest projections first
     struct BuyCandidate {
-        std::string ticker;
+        const std::string* ticker;
         double speculated_roi;
         int shares_to_buy;
         double share_price;
+        double target_value;
     };
 
-    std::vector<BuyCandidate> buy_candidates;
+    std::pmr::vector<BuyCandidate> buy_candidates(arena.resource());
 
     for (const auto& [ticker, speculated_roi] : ranked_stocks) {
-        double current_val = old_portfolio_valuations.count(ticker) ? 
-                            old_portfolio_valuations[ticker] : 0.0;
-        double target_val = blended_portfolio_valuations.count(ticker) ? 
-                        blended_portfolio_valuations[ticker] : 0.0;
+        double current_val = held_value(ticker);
+        auto target_it = blended_portfolio_valuations.find(ticker);
+        double target_val = target_it != blended_portfolio_valuations.end() ? target_it->second : 0.0;
         
         if (target_val >= current_val) {
-            double share_price = get_stock_price(ticker, portfolio.date);
-            int current_quantity = old_holdings.count(ticker) ? old_holdings[ticker] : 0;
+            double share_price = get_price(ticker);
+            int current_quantity = held_shares(ticker);
             int target_quantity = static_cast<int>(target_val / share_price);
             int shares_to_buy = target_quantity - current_quantity;
 
             BuyCandidate candidate{
-                ticker,
+                &ticker,
                 speculated_roi,
                 shares_to_buy,
-                share_price
+                share_price,
+                target_val
             };
 
             available_cash -= share_price * shares_to_buy;
@@ -463,24 +1077,37 @@ PortfolioRebalancer::rebalance_portfolio(
         }
     }
 
-    // Greedily buy up buy_candidates with remaining available cash
-    for (auto& candidate : buy_candidates) {
-        if (available_cash >= candidate.share_price) {
-            candidate.shares_to_buy += 1;
-            available_cash -= candidate.share_price;
-        }
+    // Spend the cash left by truncating to whole shares where it best closes the gap
+    // to the blended targets. Capped optimizer weights can sum to less than 1; that
+    // share of the portfolio is meant to stay in cash along with anything held back.
+    double unallocated_weight = 0.0;
+    for (double weight : *weights) {
+        unallocated_weight -= weight;
+    }
+    unallocated_weight = weights->empty() ? 0.0 : std::max(0.0, 1.0 + unallocated_weight);
+    double cash_target = adjust_by * unallocated_weight * state.total_value + held_back_cash;
+    std::vector<ShareTarget> share_targets;
+    share_targets.reserve(buy_candidates.size());
+    for (const auto& candidate : buy_candidates) {
+        share_targets.push_back(ShareTarget{
+            candidate.share_price,
+            candidate.target_value,
+            held_shares(*candidate.ticker) + candidate.shares_to_buy
+        });
+    }
+    available_cash = allocate_cash(share_targets, available_cash, cash_target);
+    for (size_t i = 0; i < buy_candidates.size(); ++i) {
+        buy_candidates[i].shares_to_buy = share_targets[i].shares - held_shares(*buy_candidates[i].ticker);
     }
 
     for (const auto& candidate : buy_candidates) {
-        int outstanding_shares = (old_holdings.count(candidate.ticker) ? 
-                                old_holdings[candidate.ticker] : 0) + 
-                            candidate.shares_to_buy;
+        int outstanding_shares = held_shares(*candidate.ticker) + candidate.shares_to_buy;
         double new_holding_value = outstanding_shares * candidate.share_price;
         
         if (candidate.shares_to_buy > 0) {
             RebalanceAction action{
                 "BUY",
-                candidate.ticker,
+                *candidate.ticker,
                 candidate.shares_to_buy,
                 candidate.speculated_roi,
                 new_holding_value * candidate.speculated_roi,
@@ -493,7 +1120,7 @@ PortfolioRebalancer::rebalance_portfolio(
         } else if (outstanding_shares > 0) {
             RebalanceAction hold_action{
                 "HOLD",
-                candidate.ticker,
+                *candidate.ticker,
                 0,
                 candidate.speculated_roi,
                 new_holding_value * candidate.speculated_roi,
@@ -506,33 +1133,31 @@ PortfolioRebalancer::rebalance_portfolio(
         }
     }
 
+    // A ticker sold and bought, or listed twice, would be traded twice by whoever
+    // executes the plan
+    std::pmr::unordered_set<std::string_view> traded(arena.resource());
+    for (const auto& action : actions) {
+        if (!traded.insert(action.ticker).second) {
+            throw std::runtime_error("Rebalance on " + snapshot.date + " lists ticker " + action.ticker + " twice");
+        }
+    }
+
     // Add future performance data if available
     for (auto& action : actions) {
-        std::vector<double> ticker_data;
-        for (const auto& [date, prices] : stock_data_cache) {
-            auto it = prices.find(action.ticker);
-            if (it != prices.end()) {
-                ticker_data.push_back(it->second);
-            }
-        }
-        
-        auto future_perf = get_actual_roi(
-            ticker_data,
-            action.ticker,
-            portfolio.date,
-            holding_window
-        );
-        
-        if (future_perf) {
-            auto [start_price, end_price, actual_roi] = *future_perf;
+        auto future_perf = snapshot.actual_rois.find(action.ticker);
+        if (future_perf != snapshot.actual_rois.end()) {
+            auto [start_price, end_price, actual_roi] = future_perf->second;
             action.actual_roi = actual_roi;
             action.actual_net_capital = actual_roi * action.outstanding_shares * start_price;
         }
     }
 
     auto rebalance_summary = get_rebalance_summary(actions, available_cash);
+    add_risk_reports(snapshot, state, actions, options.risk, rebalance_summary);
 
-    std::string future_date = get_future_date(portfolio.date, holding_window);
+    if (!snapshot.future_date) {
+        throw std::runtime_error("Not enough future data available");
+    }
 
     // Convert JSON holdings to Portfolio's expected type
     std::vector<std::map<std::string, std::variant<std::string, int>>> new_holdings;
@@ -544,11 +1169,195 @@ PortfolioRebalancer::rebalance_portfolio(
     }
 
     Portfolio new_portfolio{
-        portfolio.id,
-        future_date,
+        state.id,
+        *snapshot.future_date,
         available_cash,
         new_holdings
     };
 
     return {actions, rebalance_summary, new_portfolio};
-}
\ No newline at end of file
+}
+
+RebalanceResult PortfolioRebalancer::rebalance_portfolio(
+    Strategy& speculation_strategy,
+    int holding_window,
+    int max_holdings,
+    int max_sector_lead,
+    double adjust_by,
+    const RebalanceOptions& options) {
+    
+    TRACE_SCOPE("rebalance_portfolio");
+    ArenaScope arena;
+    Portfolio portfolio = Loader::load_portfolio("./data/portfolio.json");
+    // Load what the date needs; a full load scores it as the data is parsed
+    load_for_dates("./data/stock_data.csv", speculation_strategy, {portfolio.date}, holding_window, options);
+
+    return rebalance(speculation_strategy, portfolio, holding_window,
+                     max_holdings, max_sector_lead, adjust_by, options);
+}
+
+RebalanceResult PortfolioRebalancer::rebalance(
+    Strategy& speculation_strategy,
+    const Portfolio& portfolio,
+    int holding_window,
+    int max_holdings,
+    int max_sector_lead,
+    double adjust_by,
+    const RebalanceOptions& options) {
+    
+    RebalanceSession session(*this, speculation_strategy, portfolio, holding_window, options);
+    return session.rebalance(max_holdings, max_sector_lead, adjust_by);
+}
+
+BatchStats PortfolioRebalancer::rebalance_batch(
+    Strategy& speculation_strategy,
+    const std::string& portfolios_path,
+    const std::string& output_path,
+    int holding_window,
+    int max_holdings,
+    int max_sector_lead,
+    double adjust_by,
+    const RebalanceOptions& options,
+    unsigned threads,
+    std::optional<TradeNetter>* netter) {
+    
+    constexpr size_t BATCH_CHUNK = 1024;
+
+    TRACE_SCOPE("rebalance_batch");
+    std::vector<Portfolio> portfolios;
+    {
+        TRACE_SCOPE("load_portfolios");
+        portfolios = Loader::load_portfolios(portfolios_path);
+    }
+    std::set<std::string> distinct_dates;
+    for (const auto& portfolio : portfolios) {
+        distinct_dates.insert(portfolio.date);
+    }
+    std::vector<std::string> dates(distinct_dates.begin(), distinct_dates.end());
+    load_for_dates("./data/stock_data.csv", speculation_strategy, dates, holding_window, options, threads);
+    if (netter) {
+        netter->emplace(get_ticker_index());
+    }
+
+    std::ofstream out(output_path);
+    if (!out.is_open()) {
+        throw std::runtime_error("Could not open output file for writing");
+    }
+
+    BatchStats stats;
+    stats.portfolios = portfolios.size();
+
+    // One ranking per distinct date, built on this thread: the cascade and ensemble
+    // strategies cannot be scored from several threads at once (see strategies.hpp),
+    // and each ranking already spreads its universe over speculate_batch. A date that
+    // cannot be ranked fails only the portfolios on it.
+    struct DateRanking {
+        RankingSnapshot snapshot;
+        CandidateList candidates;
+        std::string error;
+    };
+    std::map<std::string, DateRanking> rankings;
+
+    // Every ticker held on each date is scored on its own first, as a single
+    // rebalance does, so a portfolio ranks its holdings the same way in both modes
+    std::map<std::string, std::set<std::string>> held_on;
+    for (const auto& portfolio : portfolios) {
+        auto& held = held_on[portfolio.date];
+        for (const auto& holding : portfolio.holdings) {
+            held.insert(std::get<std::string>(holding.at("ticker")));
+        }
+    }
+
+    auto ranking_start = std::chrono::steady_clock::now();
+    for (const auto& portfolio : portfolios) {
+        if (rankings.count(portfolio.date)) continue;
+        TRACE_SCOPE("batch_ranking");
+        DateRanking& ranking = rankings[portfolio.date];
+        try {
+            auto loaded = current_data();
+            const auto& held = held_on.at(portfolio.date);
+            score_holdings(loaded, speculation_strategy, {held.begin(), held.end()}, portfolio.date, holding_window);
+            ranking.snapshot = build_ranking_snapshot(std::move(loaded), speculation_strategy, portfolio.date,
+                                                      holding_window, options.universe);
+            if (options.return_lookback() > 0) {
+                load_returns(ranking.snapshot, options.return_lookback());
+            }
+            if (options.max_correlation < 1.0) {
+                load_correlations(ranking.snapshot, options.correlation_window);
+            }
+            ranking.candidates = select_candidates(ranking.snapshot, max_holdings, max_sector_lead,
+                                                   options.max_correlation);
+            // Portfolios taking the shared walk all start with the same max_holdings
+            // names, so the optimizer runs once per date rather than per portfolio
+            if (ranking.candidates.ranked_stocks.size() >= static_cast<size_t>(max_holdings)) {
+                ranking.candidates.weights = optimizer_weights(ranking.snapshot, ranking.candidates.ranked_stocks,
+                                                               max_holdings, options);
+            }
+        } catch (const std::exception& e) {
+            ranking.error = e.what();
+        }
+    }
+    stats.dates = rankings.size();
+    auto allocation_start = std::chrono::steady_clock::now();
+    // One phase for every portfolio: the allocation and selection scopes run in this
+    // thread's share of each parallel_for would pick up the other workers too
+    ProfileScope profile("batch_allocation", true);
+    profile.set_items(portfolios.size());
+
+    // Allocate and serialise a chunk in parallel, then write it in input order, so
+    // memory stays bounded however many portfolios there are
+    std::vector<std::string> lines;
+    std::vector<char> failed;
+    std::vector<std::vector<RebalanceAction>> chunk_actions;
+    for (size_t begin = 0; begin < portfolios.size(); begin += BATCH_CHUNK) {
+        size_t count = std::min(BATCH_CHUNK, portfolios.size() - begin);
+        lines.assign(count, std::string());
+        failed.assign(count, 0);
+        if (netter) {
+            chunk_actions.assign(count, {});
+        }
+
+        TRACE_SCOPE("batch_chunk");
+        parallel_for(count, [&](size_t i) {
+            const Portfolio& portfolio = portfolios[begin + i];
+            const DateRanking& ranking = rankings.at(portfolio.date);
+            std::ostringstream line;
+            if (!ranking.error.empty()) {
+                Writer::write_rebalance_error_line(line, portfolio.id, ranking.error);
+                failed[i] = 1;
+            } else {
+                try {
+                    auto result = allocate_portfolio(ranking.snapshot, ranking.candidates, portfolio,
+                                                     adjust_by, options);
+                    {
+                        TRACE_SCOPE("serialize");
+                        Writer::write_rebalance_line(line, portfolio.id, result);
+                    }
+                    if (netter) {
+                        chunk_actions[i] = std::move(std::get<0>(result));
+                    }
+                } catch (const std::exception& e) {
+                    line.str(std::string());
+                    Writer::write_rebalance_error_line(line, portfolio.id, e.what());
+                    failed[i] = 1;
+                }
+            }
+            lines[i] = line.str();
+        }, threads, 8);
+
+        TRACE_SCOPE("write_results");
+        for (size_t i = 0; i < count; ++i) {
+            out << lines[i];
+            stats.failed += failed[i];
+            if (netter && !failed[i]) {
+                (*netter)->add(portfolios[begin + i].id, chunk_actions[i]);
+            }
+        }
+        out.flush();
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    stats.ranking_seconds = std::chrono::duration<double>(allocation_start - ranking_start).count();
+    stats.allocation_seconds = std::chrono::duration<double>(end - allocation_start).count();
+    return stats;
+}
@@ -1,50 +1,357 @@
 // portfolio_rebalancer.hpp
 #pragma once
+#include "correlation.hpp"
+#include "ingest.hpp"
+#include "market_data.hpp"
 #include "models.hpp"
+#include "netting.hpp"
+#include "optimizer.hpp"
+#include "risk.hpp"
+#include "score_cache.hpp"
 #include "strategies.hpp"
 #include <unordered_map>
 #include <memory>
+#include <mutex>
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
 #include <set>
+#include <span>
 
+// Tickers the rebalancer will consider. min_adv and min_price drop tickers before they
+// are scored; max_position_pct_adv caps how far a position is built up, as a
+// percentage of the stock's average daily dollar volume. Zero turns each one off.
+struct UniverseFilter {
+    double min_adv = 0.0;
+    double min_price = 0.0;
+    double max_position_pct_adv = 0.0;
+};
+
+// Settings beyond the holding window and the max_holdings / max_sector_lead /
+// adjust_by knobs; the defaults reproduce the original rank-ramp rebalance
+struct RebalanceOptions {
+    OptimizerOptions optimizer;
+    double max_correlation = 1.0;   // skip new picks more correlated than this with any earlier pick
+    int correlation_window = 60;    // trading days of daily returns behind those correlations
+    RiskOptions risk;
+    UniverseFilter universe;
+    // Trading days of bars to load before a rebalance date. Above zero only that much
+    // history (widened for the strategy's required_history(), the options' own
+    // lookbacks and the average dollar volume window) and the holding window after are
+    // loaded, instead of the whole file, so scores match a full load. A strategy whose
+    // history is unbounded, like MovingAverageStrategy with its volatility over every
+    // return, always loads the whole file.
+    int history_days = 0;
+
+    // Trading days of daily returns a snapshot needs for these options
+    int return_lookback() const {
+        return std::max(optimizer.mode != AllocationMode::RankRamp ? optimizer.lookback_period : 0,
+                        risk.lookback_period);
+    }
+};
+
+// Everything about one rebalance date that does not depend on the portfolio: the
+// universe ranking, prices and realised returns. Built once per (strategy, date,
+// holding window) and shared read-only by every portfolio rebalanced on that date.
+struct RankingSnapshot {
+    std::shared_ptr<const MarketData> market_data;                // what it was built from
+    uint64_t data_generation = 0;                                 // see PortfolioRebalancer::install_market_data
+    std::string date;
+    int holding_window = 0;
+    std::optional<std::string> future_date;
+    std::set<std::string> sectors;
+    std::vector<std::pair<std::string, double>> ranked_stocks;    // nonzero speculated ROI, best first
+    std::unordered_map<std::string, size_t> rank_of;              // ticker -> index in ranked_stocks
+    std::unordered_map<std::string, double> speculated_rois;      // every ticker priced on the date
+    std::unordered_map<std::string, double> prices;
+    std::unordered_map<std::string, double> average_dollar_volumes;
+    std::unordered_map<std::string, std::tuple<double, double, double>> actual_rois;  // start, end, roi
+    int return_lookback = 0;                                      // see PortfolioRebalancer::load_returns
+    std::unordered_map<std::string, std::vector<float>> daily_returns;
+    std::shared_ptr<const CorrelationCache> correlations;         // see PortfolioRebalancer::load_correlations
+};
+
+// The sector-balanced pick from a snapshot for a portfolio that holds none of the
+// tickers it examined. Portfolios whose holdings rank above `consumed` redo the
+// selection themselves, since held tickers bypass the sector limit.
+struct CandidateList {
+    int max_holdings = 0;
+    int max_sector_lead = 0;
+    double max_correlation = 1.0;
+    std::vector<std::pair<std::string, double>> ranked_stocks;
+    size_t consumed = 0;
+    std::vector<double> weights;    // optimizer weights of the first max_holdings candidates, if computed
+};
+
+// A portfolio's side of an allocation against one snapshot: its holdings valued at
+// the snapshot's prices and ranked by their speculated ROI. A state prepared for a
+// single allocation is built in that allocation's arena (arena.hpp).
+struct PortfolioState {
+    std::string id;
+    double cash = 0.0;
+    double total_value = 0.0;
+    std::pmr::unordered_map<std::string, int> holdings;
+    std::pmr::unordered_map<std::string, double> valuations;
+    std::pmr::vector<std::pair<std::string, double>> ranked_holdings;
+    size_t best_holding_rank = SIZE_MAX;    // smallest index of a holding in the snapshot ranking
+
+    PortfolioState() = default;
+    explicit PortfolioState(std::pmr::memory_resource* resource)
+        : holdings(resource), valuations(resource), ranked_holdings(resource) {}
+};
+
+struct BatchStats {
+    size_t portfolios = 0;
+    size_t failed = 0;
+    size_t dates = 0;
+    double ranking_seconds = 0.0;
+    double allocation_seconds = 0.0;
+};
+
+// Rebalances portfolios against one set of stock data.
+//
+// Loaded market data is immutable and shared: each snapshot holds the MarketData it
+// was built from, so loading other data replaces it for later rebalances without
+// disturbing ones in flight. Speculated ROIs go to a sharded ScoreCache and the
+// rolling correlation cache is advanced under a lock, so any number of threads can
+// build snapshots and rebalance different portfolios and dates at once. The strategy
+// passed in must then be safe to call concurrently too (see strategies.hpp).
 class PortfolioRebalancer {
 private:
-    std::unordered_map<std::string, std::unordered_map<std::string, double>> stock_data_cache;
-    std::unordered_map<std::string, std::set<std::string>> date_to_sectors_cache;
-    std::unordered_map<std::string, std::string> ticker_to_sector_cache;
-    std::unordered_map<std::string, double> speculated_roi_cache;
-    std::unordered_map<std::string, std::tuple<double, double, double>> actual_roi_cache;
-
-    std::string get_future_date(const std::string& current_date, int holding_window);
-    void preprocess_stock_data(const std::string& stock_data_path);
-    std::set<std::string> get_sectors_from_date(const std::string& date);
-    double get_stock_price(const std::string& ticker, const std::string& date);
-    double get_speculated_roi(const std::vector<double>& ticker_data,
+    std::mutex load_mutex;                      // one load at a time; guards the loaded_ members
+    std::string loaded_stock_data_path;
+    LoadQuery loaded_query;
+    mutable std::mutex market_data_mutex;       // guards the pointer and generation, not the data
+    std::shared_ptr<const MarketData> market_data = std::make_shared<const MarketData>();
+    uint64_t market_data_generation = 0;
+    ScoreCache speculated_roi_cache;
+    std::mutex correlation_mutex;               // guards the cache pointer and its generation
+    std::shared_ptr<CorrelationCache> correlation_cache;
+    uint64_t correlation_generation = 0;
+
+    // The loaded data and the generation it was installed as, read together
+    struct LoadedData {
+        std::shared_ptr<const MarketData> data;
+        uint64_t generation = 0;
+    };
+    LoadedData current_data() const;
+    std::shared_ptr<const MarketData> current_market_data() const;
+    // Swaps in newly loaded data under a new generation and drops the caches built
+    // from the old; the caller holds load_mutex. Scores are keyed on the generation
+    // and the correlation cache only keeps the current one's, so a ranking still
+    // running on the old data cannot leave results where rankings on the new data
+    // would find them. Returns the new generation.
+    uint64_t install_market_data(std::shared_ptr<const MarketData> data, const std::string& stock_data_path,
+                                 const LoadQuery& query = {});
+    // Loads the part of the stock data the options need around [first_date, last_date],
+    // or all of it with the dates scored as it is parsed when history_days is zero or
+    // the strategy may look at the whole history
+    void load_for_dates(const std::string& stock_data_path, Strategy& speculation_strategy,
+                        const std::vector<std::string>& dates, int holding_window,
+                        const RebalanceOptions& options, unsigned threads = 0);
+    static std::string get_future_date(const MarketData& data, const std::string& current_date, int holding_window);
+    static std::set<std::string> get_sectors_from_date(const MarketData& data, const std::string& date);
+    static double get_stock_price(const MarketData& data, const std::string& ticker, const std::string& date);
+    // A view of the ticker's closes in `data`
+    static PriceHistory get_ticker_history(const MarketData& data, const std::string& ticker,
+                                           const std::string& end_date);
+    static std::string get_speculated_roi_key(const Strategy& strategy,
+                                              const std::string& ticker,
+                                              const std::string& date,
+                                              int holding_window,
+                                              uint64_t data_generation);
+    // Scores each ticker on `date` on its own unless it is already cached, as held
+    // tickers are before a ranking, so they get a real score even if a batch
+    // strategy's shortlist or the universe filter would leave them out
+    void score_holdings(const LoadedData& loaded,
+                        Strategy& strategy,
+                        const std::vector<std::string>& tickers,
+                        const std::string& date,
+                        int holding_window);
+    double get_speculated_roi(PriceHistory ticker_data,
                             Strategy& strategy,
                             const std::string& ticker,
                             const std::string& date,
-                            int holding_window);
-    std::optional<std::tuple<double, double, double>> get_actual_roi(
-        const std::vector<double>& ticker_data,
-        const std::string& ticker,
-        const std::string& start_date,
-        int holding_window);
+                            int holding_window,
+                            uint64_t data_generation);
     std::vector<std::pair<std::string, double>> get_ranked_stocks(
+        const LoadedData& loaded,
         Strategy& speculation_strategy,
         const std::string& portfolio_date,
-        int holding_window);
-    RebalanceSummary get_rebalance_summary(
+        int holding_window,
+        const UniverseFilter& universe);
+    std::vector<std::pair<std::string, double>> filter_ranked_stocks(
+        const RankingSnapshot& snapshot,
+        std::span<const std::pair<std::string, double>> old_ranked_stocks,
+        int max_holdings,
+        int max_sector_lead,
+        double max_correlation,
+        size_t* consumed = nullptr) const;
+    std::vector<double> target_weights(
+        const RankingSnapshot& snapshot,
+        const std::vector<std::pair<std::string, double>>& ranked_stocks,
+        int n,
+        const RebalanceOptions& options) const;
+    static void add_risk_reports(
+        const RankingSnapshot& snapshot,
+        const PortfolioState& state,
+        const std::vector<RebalanceAction>& actions,
+        const RiskOptions& options,
+        RebalanceSummary& summary);
+    static RebalanceSummary get_rebalance_summary(
         const std::vector<RebalanceAction>& actions,
         double remaining_cash);
+    RankingSnapshot build_ranking_snapshot(
+        LoadedData loaded,
+        Strategy& speculation_strategy,
+        const std::string& date,
+        int holding_window,
+        const UniverseFilter& universe);
 
 public:
     PortfolioRebalancer() = default;
     
-    std::tuple<std::vector<RebalanceAction>, RebalanceSummary, Portfolio> rebalance_portfolio(
+    RebalanceResult rebalance_portfolio(
+        Strategy& speculation_strategy,
+        int holding_window,
+        int max_holdings,
+        int max_sector_lead,
+        double adjust_by,
+        const RebalanceOptions& options = {});
+
+    // Rebalances `portfolio` against the loaded stock data without reading any files.
+    // Safe to call from several threads at once.
+    RebalanceResult rebalance(
         Strategy& speculation_strategy,
+        const Portfolio& portfolio,
         int holding_window,
         int max_holdings,
         int max_sector_lead,
-        double adjust_by);
+        double adjust_by,
+        const RebalanceOptions& options = {});
+
+    // Rebalances every portfolio in `portfolios_path` (a directory of portfolio JSON
+    // files or a JSONL file) and streams one JSON line per portfolio to `output_path`,
+    // in input order. The ranking is computed once per date; allocation runs in parallel.
+    // If `netter` is given it is set, once the stock data for the portfolios' dates is
+    // loaded, to a TradeNetter over its tickers holding every rebalanced portfolio's actions.
+    BatchStats rebalance_batch(
+        Strategy& speculation_strategy,
+        const std::string& portfolios_path,
+        const std::string& output_path,
+        int holding_window,
+        int max_holdings,
+        int max_sector_lead,
+        double adjust_by,
+        const RebalanceOptions& options = {},
+        unsigned threads = 0,
+        std::optional<TradeNetter>* netter = nullptr);
+
+    // Loads the stock CSV; repeated calls with the same path are no-ops. Rebalances
+    // already running keep the data they started with.
+    void load_stock_data(const std::string& stock_data_path);
+
+    // Only the bars matching `query` (see MarketData::load); repeated calls with the
+    // same path and query are no-ops
+    LoadStats load_stock_data(const std::string& stock_data_path, const LoadQuery& query);
+
+    // load_stock_data that also scores the universe on each of `dates` while the CSV
+    // is still being parsed: each ticker is scored as soon as its rows are (see
+    // ingest.hpp), so ranking those dates afterwards finds every score cached. Bar
+    // files, and strategies whose scores depend on their batch, are loaded and then
+    // ranked as usual. Returns the pipeline's timings, all zero if it did not run.
+    IngestStats load_and_score(
+        const std::string& stock_data_path,
+        Strategy& speculation_strategy,
+        const std::vector<std::string>& dates,
+        int holding_window,
+        const UniverseFilter& universe = {},
+        unsigned threads = 0);
+
+    // Every ticker in the loaded stock data
+    TickerIndex get_ticker_index() const;
+
+    // Daily bars held for the loaded stock data
+    size_t cached_prices() const { return current_market_data()->row_count(); }
+
+    // Speculated ROIs held in the score cache
+    size_t cached_scores() const { return speculated_roi_cache.size(); }
+
+    RankingSnapshot build_ranking_snapshot(
+        Strategy& speculation_strategy,
+        const std::string& date,
+        int holding_window,
+        const UniverseFilter& universe = {});
+
+    // Snapshot for one portfolio's date. Its holdings are scored one at a time first,
+    // so a strategy that only scores a shortlist in batch still gives them a real score.
+    RankingSnapshot build_ranking_snapshot(
+        Strategy& speculation_strategy,
+        const Portfolio& portfolio,
+        int holding_window,
+        const UniverseFilter& universe = {});
+
+    // Adds daily returns over the `lookback` trading days up to the snapshot's date
+    // for every ticker priced on it, as the optimizer modes and risk reports need.
+    // Missing days carry the last price forward.
+    void load_returns(RankingSnapshot& snapshot, int lookback) const;
+
+    // Points the snapshot at return correlations over the `window` trading days up to
+    // its date, which max_correlation needs. The rebalancer keeps one rolling cache and
+    // advances it from its last date when dates move forward (as in a walk-forward
+    // backtest), copying it first if an earlier snapshot still holds it. A snapshot of
+    // data that has since been replaced gets a cache of its own. Concurrent calls take
+    // turns.
+    void load_correlations(RankingSnapshot& snapshot, int window);
+
+    CandidateList select_candidates(
+        const RankingSnapshot& snapshot,
+        int max_holdings,
+        int max_sector_lead,
+        double max_correlation = 1.0) const;
+
+    PortfolioState prepare_portfolio(
+        const RankingSnapshot& snapshot,
+        const Portfolio& portfolio,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const;
+
+    // Candidates followed by the portfolio's holdings, in the order allocation ranks them
+    std::vector<std::pair<std::string, double>> select_for_portfolio(
+        const RankingSnapshot& snapshot,
+        const CandidateList& candidates,
+        const PortfolioState& state) const;
+
+    // Sell/buy plan for one portfolio against a snapshot. Touches no mutable state,
+    // so any number of portfolios can be allocated concurrently.
+    RebalanceResult allocate_portfolio(
+        const RankingSnapshot& snapshot,
+        const CandidateList& candidates,
+        const Portfolio& portfolio,
+        double adjust_by,
+        const RebalanceOptions& options = {}) const;
+
+    // The target-valuation blend, sells and buys for an already prepared portfolio
+    // and selection. `weights` are the selection's optimizer_weights if the caller
+    // already has them; otherwise they are computed here.
+    RebalanceResult allocate_portfolio(
+        const RankingSnapshot& snapshot,
+        const PortfolioState& state,
+        const std::vector<std::pair<std::string, double>>& ranked_stocks,
+        int max_holdings,
+        double adjust_by,
+        const RebalanceOptions& options = {},
+        const std::vector<double>* weights = nullptr) const;
+
+    // Optimizer weights of the first max_holdings names of a selection (empty under
+    // RankRamp). They depend only on those names and the options, not on the
+    // portfolio or adjust_by, so callers allocating many portfolios or what-ifs to
+    // one selection compute them once and pass them to allocate_portfolio.
+    std::vector<double> optimizer_weights(
+        const RankingSnapshot& snapshot,
+        const std::vector<std::pair<std::string, double>>& ranked_stocks,
+        int max_holdings,
+        const RebalanceOptions& options) const;
 
     void clear_caches();
-};
\ No newline at end of file
+};
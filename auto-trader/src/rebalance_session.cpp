@@ -0,0 +1,44 @@
+// rebalance_session.cpp
+#include "rebalance_session.hpp"
+
+RebalanceSession::RebalanceSession(
+    PortfolioRebalancer& rebalancer,
+    Strategy& speculation_strategy,
+    const Portfolio& portfolio,
+    int holding_window,
+    const RebalanceOptions& options)
+    : rebalancer(rebalancer),
+      snapshot(rebalancer.build_ranking_snapshot(speculation_strategy, portfolio, holding_window,
+                                                options.universe)),
+      state(rebalancer.prepare_portfolio(snapshot, portfolio)) {
+    set_options(options);
+}
+
+void RebalanceSession::set_options(const RebalanceOptions& new_options) {
+    options = new_options;
+    for (auto& [key, selection] : selections) {
+        selection.weights.reset();
+    }
+    if (options.return_lookback() > 0) {
+        rebalancer.load_returns(snapshot, options.return_lookback());
+    }
+    if (options.max_correlation < 1.0) {
+        rebalancer.load_correlations(snapshot, options.correlation_window);
+    }
+}
+
+RebalanceResult RebalanceSession::rebalance(int max_holdings, int max_sector_lead, double adjust_by) {
+    auto key = std::make_tuple(max_holdings, max_sector_lead, options.max_correlation);
+    auto it = selections.find(key);
+    if (it == selections.end()) {
+        auto candidates = rebalancer.select_candidates(snapshot, max_holdings, max_sector_lead,
+                                                       options.max_correlation);
+        it = selections.emplace(key, Selection{rebalancer.select_for_portfolio(snapshot, candidates, state), std::nullopt}).first;
+    }
+    auto& selection = it->second;
+    if (!selection.weights) {
+        selection.weights = rebalancer.optimizer_weights(snapshot, selection.ranked_stocks, max_holdings, options);
+    }
+    return rebalancer.allocate_portfolio(snapshot, state, selection.ranked_stocks, max_holdings, adjust_by,
+                                         options, &*selection.weights);
+}
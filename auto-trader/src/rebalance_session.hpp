@@ -0,0 +1,44 @@
+// rebalance_session.hpp
+#pragma once
+#include "portfolio_rebalancer.hpp"
+#include <map>
+#include <optional>
+#include <tuple>
+
+// Interactive what-if rebalancing of one portfolio. Everything that allocation
+// parameters cannot change is computed once: the ranking snapshot for the portfolio's
+// date, strategy and holding window, and the portfolio's valuations against it.
+// rebalance() then re-runs only the sector selection and its optimizer weights (both
+// memoised per max_holdings / max_sector_lead / max_correlation, the weights until the
+// options change), the target-valuation blend, and the sells and buys.
+//
+// The session reads sectors through `rebalancer`, which must outlive it and keep its
+// stock data loaded.
+class RebalanceSession {
+private:
+    PortfolioRebalancer& rebalancer;
+    RankingSnapshot snapshot;
+    PortfolioState state;
+    RebalanceOptions options;
+    struct Selection {
+        std::vector<std::pair<std::string, double>> ranked_stocks;
+        std::optional<std::vector<double>> weights;
+    };
+    std::map<std::tuple<int, int, double>, Selection> selections;
+
+public:
+    RebalanceSession(PortfolioRebalancer& rebalancer,
+                     Strategy& speculation_strategy,
+                     const Portfolio& portfolio,
+                     int holding_window,
+                     const RebalanceOptions& options = {});
+
+    RebalanceResult rebalance(int max_holdings, int max_sector_lead, double adjust_by);
+
+    // Changes the options for later rebalances; selections stay cached but their weights
+    // are recomputed. The universe filter's min_adv / min_price were applied when the
+    // session was built and stay.
+    void set_options(const RebalanceOptions& options);
+
+    const RankingSnapshot& get_snapshot() const { return snapshot; }
+};
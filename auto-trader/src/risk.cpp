@@ -0,0 +1,54 @@
+// risk.cpp
+#include "risk.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+void historical_pnl(const std::vector<const float*>& series, size_t days,
+                    const double* positions, size_t n_portfolios,
+                    double* pnl) {
+    std::fill(pnl, pnl + days * n_portfolios, 0.0);
+    for (size_t i = 0; i < series.size(); ++i) {
+        const float* returns = series[i];
+        const double* position = positions + i * n_portfolios;
+        for (size_t t = 0; t < days; ++t) {
+            double r = returns[t];
+            double* row = pnl + t * n_portfolios;
+            for (size_t p = 0; p < n_portfolios; ++p) {
+                row[p] += position[p] * r;
+            }
+        }
+    }
+}
+
+RiskReport risk_report(std::vector<double>& pnl, double value, double confidence) {
+    RiskReport report{0.0, 0.0, 0.0, 0.0};
+    const size_t days = pnl.size();
+    if (days < 2 || value <= 0.0) {
+        return report;
+    }
+
+    // Drawdown needs the P&L in date order, so walk it before selecting the tail
+    double equity = 1.0;
+    double peak = 1.0;
+    double mean = 0.0;
+    double sum_squares = 0.0;
+    for (double day : pnl) {
+        equity *= 1.0 + day / value;
+        peak = std::max(peak, equity);
+        report.max_drawdown = std::max(report.max_drawdown, (peak - equity) / peak);
+        mean += day;
+        sum_squares += day * day;
+    }
+    mean /= days;
+    double variance = std::max(sum_squares / days - mean * mean, 0.0) * days / (days - 1);
+    report.volatility = std::sqrt(variance) / value;
+
+    // The worst ceil((1 - confidence) * days) days form the tail: the least bad of them
+    // is the VaR and their average the CVaR (both as positive losses)
+    size_t tail = std::clamp<size_t>(static_cast<size_t>(std::ceil((1.0 - confidence) * days)), 1, days);
+    std::nth_element(pnl.begin(), pnl.begin() + (tail - 1), pnl.end());
+    report.value_at_risk = std::max(0.0, -pnl[tail - 1]);
+    report.conditional_value_at_risk = std::max(0.0, -std::accumulate(pnl.begin(), pnl.begin() + tail, 0.0) / tail);
+    return report;
+}
@@ -0,0 +1,23 @@
+// risk.hpp
+#pragma once
+#include "models.hpp"
+#include <cstddef>
+#include <vector>
+
+struct RiskOptions {
+    int lookback_period = 250;  // trading days of history simulated; 0 turns the report off
+    double confidence = 0.95;
+};
+
+// Historical-simulation P&L of several dollar-position vectors at once. series[i] points
+// at `days` daily returns of the i-th ticker; positions is row-major n_tickers x
+// n_portfolios. pnl (days x n_portfolios, row-major) receives sum_i position * return
+// for every day, accumulated a ticker column at a time so each return series is read
+// once for all portfolios.
+void historical_pnl(const std::vector<const float*>& series, size_t days,
+                    const double* positions, size_t n_portfolios,
+                    double* pnl);
+
+// VaR / CVaR (by selection, not a full sort), volatility and max drawdown of one P&L
+// series for a portfolio worth `value`. Reorders `pnl`.
+RiskReport risk_report(std::vector<double>& pnl, double value, double confidence);
@@ -0,0 +1,143 @@
+// rng.hpp
+#pragma once
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <string_view>
+
+// Counter-based random numbers (Philox4x32-10, Salmon et al. 2011).
+// A draw is a pure function of (seed, stream, index): there is no generator state
+// to seed or advance, so results are reproducible and do not depend on which
+// thread asks for them or in what order.
+class PhiloxRng {
+public:
+    using Counter = std::array<uint32_t, 4>;
+    using Key = std::array<uint32_t, 2>;
+
+private:
+    static constexpr uint32_t M0 = 0xD2511F53;
+    static constexpr uint32_t M1 = 0xCD9E8D57;
+    static constexpr uint32_t W0 = 0x9E3779B9;
+    static constexpr uint32_t W1 = 0xBB67AE85;
+
+    Key key;
+    uint32_t stream_lo;
+    uint32_t stream_hi;
+
+    static uint64_t splitmix64(uint64_t x) {
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    static uint64_t fnv1a(std::string_view text) {
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (char c : text) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+    static double to_unit(uint32_t hi, uint32_t lo) {
+        // 53 random bits -> [0, 1)
+        uint64_t bits = (static_cast<uint64_t>(hi) << 32 | lo) >> 11;
+        return static_cast<double>(bits) * 0x1.0p-53;
+    }
+
+    Counter block(uint64_t index) const {
+        return philox(Counter{static_cast<uint32_t>(index), static_cast<uint32_t>(index >> 32),
+                              stream_lo, stream_hi}, key);
+    }
+
+public:
+    PhiloxRng(uint64_t seed, uint64_t stream)
+        : key{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)},
+          stream_lo(static_cast<uint32_t>(stream)),
+          stream_hi(static_cast<uint32_t>(stream >> 32)) {}
+
+    // Stream keyed by (seed, ticker, date), the unit a stochastic strategy draws for
+    PhiloxRng(uint64_t seed, std::string_view ticker, std::string_view date)
+        : PhiloxRng(seed, stream_id(ticker, date)) {}
+
+    static uint64_t stream_id(std::string_view ticker, std::string_view date) {
+        return splitmix64(fnv1a(ticker) ^ splitmix64(fnv1a(date)));
+    }
+
+    static Counter philox(Counter ctr, Key k) {
+        for (int round = 0; round < 10; ++round) {
+            uint64_t p0 = static_cast<uint64_t>(M0) * ctr[0];
+            uint64_t p1 = static_cast<uint64_t>(M1) * ctr[2];
+            ctr = Counter{
+                static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ k[0],
+                static_cast<uint32_t>(p1),
+                static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ k[1],
+                static_cast<uint32_t>(p0)
+            };
+            k[0] += W0;
+            k[1] += W1;
+        }
+        return ctr;
+    }
+
+    // index-th uniform draw in [0, 1); each Philox block yields two
+    double uniform(uint64_t index) const {
+        Counter r = block(index / 2);
+        return index % 2 == 0 ? to_unit(r[0], r[1]) : to_unit(r[2], r[3]);
+    }
+
+    // index-th standard normal draw (Box-Muller over the same block pairs)
+    double normal(uint64_t index) const {
+        Counter r = block(index / 2);
+        double u1 = 1.0 - to_unit(r[0], r[1]);  // (0, 1], safe for log
+        double u2 = to_unit(r[2], r[3]);
+        double radius = std::sqrt(-2.0 * std::log(u1));
+        double angle = 2.0 * std::numbers::pi * u2;
+        return index % 2 == 0 ? radius * std::cos(angle) : radius * std::sin(angle);
+    }
+
+    // Batch generation of draws [first_index, first_index + n). Blocks are
+    // independent, so the loop carries no dependency and vectorises.
+    void fill_uniform(double* out, size_t n, uint64_t first_index = 0) const {
+        size_t i = 0;
+        if (first_index % 2 == 1 && n > 0) {
+            out[i++] = uniform(first_index);
+        }
+        uint64_t first_block = (first_index + i) / 2;
+        size_t pairs = (n - i) / 2;
+        for (size_t b = 0; b < pairs; ++b) {
+            Counter r = block(first_block + b);
+            out[i + 2 * b] = to_unit(r[0], r[1]);
+            out[i + 2 * b + 1] = to_unit(r[2], r[3]);
+        }
+        i += 2 * pairs;
+        if (i < n) {
+            out[i] = uniform(first_index + i);
+        }
+    }
+
+    void fill_normal(double* out, size_t n, uint64_t first_index = 0) const {
+        size_t i = 0;
+        if (first_index % 2 == 1 && n > 0) {
+            out[i++] = normal(first_index);
+        }
+        uint64_t first_block = (first_index + i) / 2;
+        size_t pairs = (n - i) / 2;
+        for (size_t b = 0; b < pairs; ++b) {
+            Counter r = block(first_block + b);
+            double u1 = 1.0 - to_unit(r[0], r[1]);
+            double u2 = to_unit(r[2], r[3]);
+            double radius = std::sqrt(-2.0 * std::log(u1));
+            double angle = 2.0 * std::numbers::pi * u2;
+            out[i + 2 * b] = radius * std::cos(angle);
+            out[i + 2 * b + 1] = radius * std::sin(angle);
+        }
+        i += 2 * pairs;
+        if (i < n) {
+            out[i] = normal(first_index + i);
+        }
+    }
+};
@@ -0,0 +1,45 @@
+// score_cache.cpp
+#include "score_cache.hpp"
+#include <functional>
+#include <mutex>
+
+ScoreCache::Shard& ScoreCache::shard_for(const std::string& key) {
+    // The top bits, since the shard's own map buckets by the low ones
+    return shards[(std::hash<std::string>{}(key) >> 32) % SHARDS];
+}
+
+const ScoreCache::Shard& ScoreCache::shard_for(const std::string& key) const {
+    return shards[(std::hash<std::string>{}(key) >> 32) % SHARDS];
+}
+
+std::optional<double> ScoreCache::find(const std::string& key) const {
+    const Shard& shard = shard_for(key);
+    std::shared_lock lock(shard.mutex);
+    auto it = shard.scores.find(key);
+    if (it == shard.scores.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+void ScoreCache::insert(const std::string& key, double score) {
+    Shard& shard = shard_for(key);
+    std::unique_lock lock(shard.mutex);
+    shard.scores.emplace(key, score);
+}
+
+void ScoreCache::clear() {
+    for (auto& shard : shards) {
+        std::unique_lock lock(shard.mutex);
+        shard.scores.clear();
+    }
+}
+
+size_t ScoreCache::size() const {
+    size_t total = 0;
+    for (const auto& shard : shards) {
+        std::shared_lock lock(shard.mutex);
+        total += shard.scores.size();
+    }
+    return total;
+}
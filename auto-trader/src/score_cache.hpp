@@ -0,0 +1,40 @@
+// score_cache.hpp
+#pragma once
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+// Speculated ROIs shared by every rebalance in the process, keyed by strategy, ticker,
+// date, holding window and the generation of the market data they were scored from.
+//
+// The map is split into shards picked by the key's hash, each behind its own
+// reader-writer lock. Once a date has been ranked almost every access is a lookup,
+// which takes one shard's lock shared, so readers never wait on each other; threads
+// scoring different dates insert into different shards most of the time.
+class ScoreCache {
+public:
+    static constexpr size_t SHARDS = 64;
+
+private:
+    // A cache line each, so locking one shard does not bounce its neighbours
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, double> scores;
+    };
+    std::array<Shard, SHARDS> shards;
+
+    Shard& shard_for(const std::string& key);
+    const Shard& shard_for(const std::string& key) const;
+
+public:
+    std::optional<double> find(const std::string& key) const;
+
+    // Two threads scoring the same key race harmlessly: the first score stored stays
+    void insert(const std::string& key, double score);
+
+    void clear();
+    size_t size() const;
+};
@@ -1,70 +1,331 @@
 // strategies.hpp
 #pragma once
+#include "forest.hpp"
+#include "indicators.hpp"
+#include "neural_network.hpp"
+#include "parallel.hpp"
+#include "rng.hpp"
 #include <vector>
+#include <span>
 #include <string>
-#include <random>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <ostream>
 #include <cmath>
+#include <mutex>
+#include <limits>
+#include <stdexcept>
+#include <typeinfo>
 
+// A ticker's daily closes up to the date being scored, oldest first. The rebalancer
+// hands out views straight into its market data, so nothing is copied per ticker; a
+// strategy that only looks back n days should slice (prices.last(n)) rather than copy.
+using PriceHistory = std::span<const double>;
+
+// A strategy passed to concurrent PortfolioRebalancer::rebalance calls is scored from
+// several threads at once. The random, indicator, Monte Carlo, forest and neural
+// strategies keep no per-call state and can be shared; the cascade and ensemble
+// strategies record their last batch, so give each thread its own instance.
 class Strategy {
+private:
+    static uint64_t next_instance() {
+        static std::atomic<uint64_t> instances{0};
+        return ++instances;
+    }
+
+    uint64_t instance = next_instance();    // copies score the same, so they keep it
+
+protected:
+    // Scores tickers one at a time with score(i); a ticker that throws gets NaN
+    template <typename Score>
+    static std::vector<double> speculate_each(const std::vector<std::string>& tickers, Score&& score) {
+        std::vector<double> rois(tickers.size(), std::numeric_limits<double>::quiet_NaN());
+        for (size_t i = 0; i < tickers.size(); ++i) {
+            try {
+                rois[i] = score(i);
+            } catch (const std::exception& e) {
+                std::cerr << "Error processing " << tickers[i] << ": " << e.what() << std::endl;
+            }
+        }
+        return rois;
+    }
+
 public:
     virtual ~Strategy() = default;
-    virtual double speculate(const std::vector<double>& prices, 
+    virtual double speculate(PriceHistory prices,
                            const std::string& start_date, 
                            int period) = 0;
+
+    // Ticker-aware entry point used by the rebalancer. Strategies that need to know
+    // which ticker they are scoring (e.g. to key a random stream) override this one.
+    virtual double speculate(const std::string& ticker,
+                           PriceHistory prices,
+                           const std::string& start_date,
+                           int period) {
+        return speculate(prices, start_date, period);
+    }
+
+    // Scores a whole universe at once; histories[i] belongs to tickers[i]. The
+    // default scores ticker by ticker, strategies that can batch or parallelise
+    // across tickers override it. A ticker that cannot be scored gets NaN, so a real
+    // score of 0.0 stays distinct (the rebalancer ranks neither).
+    virtual std::vector<double> speculate_batch(const std::vector<std::string>& tickers,
+                                                std::span<const PriceHistory> histories,
+                                                const std::string& start_date,
+                                                int period) {
+        return speculate_each(tickers, [&](size_t i) {
+            return speculate(tickers[i], histories[i], start_date, period);
+        });
+    }
+
+    // True when a ticker's score does not depend on which other tickers share its
+    // batch, so the universe may be scored in pieces (e.g. as it loads, see
+    // PortfolioRebalancer::load_and_score) and come out the same
+    virtual bool scores_independently() const { return false; }
+
+    // Closes up to and including the scored date that a score can depend on, or 0
+    // when it may depend on the whole history. With RebalanceOptions::history_days
+    // set, the rebalancer loads at least this much history, and the whole file for 0,
+    // so a windowed load scores exactly as a full one.
+    virtual int required_history() const { return 0; }
+
+    // History of a strategy built from others: the longest, or 0 if any is unbounded
+    static int longest_history(std::span<const int> histories) {
+        int longest = 0;
+        for (int days : histories) {
+            if (days <= 0) return 0;
+            longest = std::max(longest, days);
+        }
+        return longest;
+    }
+
+    // Names this strategy's scores in the rebalancer's score cache. The default is
+    // unique to the instance; a strategy whose scores follow from its parameters alone
+    // can spell those out instead, so equally configured instances share scores.
+    virtual std::string cache_key() const {
+        return std::string(typeid(*this).name()) + "#" + std::to_string(instance);
+    }
+
+    // For callers holding whole histories
+    std::vector<double> speculate_batch(const std::vector<std::string>& tickers,
+                                        const std::vector<std::vector<double>>& histories,
+                                        const std::string& start_date,
+                                        int period) {
+        std::vector<PriceHistory> views(histories.begin(), histories.end());
+        return speculate_batch(tickers, std::span<const PriceHistory>(views), start_date, period);
+    }
+};
+
+// Adapter for strategies written against the original std::vector interface: derive
+// from this instead of Strategy and keep overriding the vector overloads. Each call
+// copies the history it is given into a vector first, as every call used to.
+class VectorStrategy : public Strategy {
+public:
+    virtual double speculate(const std::vector<double>& prices,
+                           const std::string& start_date,
+                           int period) = 0;
+
+    virtual double speculate(const std::string& ticker,
+                           const std::vector<double>& prices,
+                           const std::string& start_date,
+                           int period) {
+        return speculate(prices, start_date, period);
+    }
+
+    virtual std::vector<double> speculate_batch(const std::vector<std::string>& tickers,
+                                                const std::vector<std::vector<double>>& histories,
+                                                const std::string& start_date,
+                                                int period) {
+        return speculate_each(tickers, [&](size_t i) {
+            return speculate(tickers[i], histories[i], start_date, period);
+        });
+    }
+
+    double speculate(PriceHistory prices, const std::string& start_date, int period) override {
+        return speculate(std::vector<double>(prices.begin(), prices.end()), start_date, period);
+    }
+
+    double speculate(const std::string& ticker,
+                    PriceHistory prices,
+                    const std::string& start_date,
+                    int period) override {
+        return speculate(ticker, std::vector<double>(prices.begin(), prices.end()), start_date, period);
+    }
+
+    std::vector<double> speculate_batch(const std::vector<std::string>& tickers,
+                                        std::span<const PriceHistory> histories,
+                                        const std::string& start_date,
+                                        int period) override {
+        std::vector<std::vector<double>> copies;
+        copies.reserve(histories.size());
+        for (auto history : histories) {
+            copies.emplace_back(history.begin(), history.end());
+        }
+        return speculate_batch(tickers, copies, start_date, period);
+    }
 };
 
+// Uniform speculation in [-0.1, 0.1). Each draw is keyed by (seed, ticker, date) so
+// a backtest can be rerun and gets the same speculations.
 class RandomStrategy : public Strategy {
+private:
+    uint64_t seed;
+
 public:
-    double speculate(const std::vector<double>& prices, 
+    explicit RandomStrategy(uint64_t seed = 0) : seed(seed) {}
+
+    using Strategy::speculate;
+
+    double speculate(PriceHistory prices, 
                     const std::string& start_date, 
                     int period) override {
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_real_distribution<> dis(-0.1, 0.1);
-        return dis(gen);
+        // Without a ticker the draw is keyed on the date alone
+        return speculate("", prices, start_date, period);
+    }
+
+    double speculate(const std::string& ticker,
+                    PriceHistory prices,
+                    const std::string& start_date,
+                    int period) override {
+        PhiloxRng rng(seed, ticker, start_date);
+        return -0.1 + 0.2 * rng.uniform(0);
+    }
+
+    bool scores_independently() const override { return true; }
+
+    // The draw depends on the ticker and date alone
+    int required_history() const override { return 1; }
+
+    std::string cache_key() const override { return "random(" + std::to_string(seed) + ")"; }
+};
+
+// Strategy that declares the indicators it needs instead of computing them itself.
+// Standalone it evaluates its own graph; inside a SharedIndicatorScorer its inputs
+// are computed once alongside every other strategy's.
+class IndicatorStrategy : public Strategy {
+private:
+    std::once_flag graph_once;
+    IndicatorGraph graph;
+    std::vector<int> input_nodes;
+    int history = 0;
+
+public:
+    using Strategy::speculate;
+
+    virtual std::vector<Indicator> inputs() const = 0;
+
+    // Longest history over the inputs. speculate() only evaluates that many closes,
+    // so a rolling sum sees the same values however much history was loaded.
+    static int required_history(const std::vector<Indicator>& indicators) {
+        std::vector<int> histories;
+        for (const auto& indicator : indicators) {
+            histories.push_back(indicator.required_history());
+        }
+        return longest_history(histories);
+    }
+
+    int required_history() const override { return required_history(inputs()); }
+
+    // input_values[i] is the last value of inputs()[i]
+    virtual double score(const std::vector<double>& input_values, int holding_window) const = 0;
+
+    double speculate(PriceHistory prices,
+                    const std::string& start_date,
+                    int holding_window) override {
+        std::call_once(graph_once, [this] {
+            auto indicators = inputs();
+            for (const auto& indicator : indicators) {
+                input_nodes.push_back(graph.add(indicator));
+            }
+            history = required_history(indicators);
+        });
+
+        if (history > 0) {
+            prices = prices.last(std::min(prices.size(), static_cast<size_t>(history)));
+        }
+        IndicatorEvaluator evaluator(graph);
+        const auto& node_values = evaluator.evaluate(prices);
+
+        std::vector<double> input_values;
+        input_values.reserve(input_nodes.size());
+        for (int node : input_nodes) {
+            input_values.push_back(node_values[node]);
+        }
+        return score(input_values, holding_window);
     }
+
+    bool scores_independently() const override { return true; }
 };
 
-class MovingAverageStrategy : public Strategy {
+// Scores several indicator strategies over the same history with one shared graph,
+// so an indicator declared by more than one strategy is computed once.
+class SharedIndicatorScorer {
+private:
+    std::vector<IndicatorStrategy*> strategies;
+    IndicatorGraph graph;
+    std::vector<std::vector<int>> input_nodes;
+    IndicatorEvaluator evaluator;
+    int history = 0;    // closes evaluated, the longest history any member requires
+
+public:
+    explicit SharedIndicatorScorer(std::vector<IndicatorStrategy*> members)
+        : strategies(std::move(members)), evaluator(graph) {
+        std::vector<Indicator> indicators;
+        for (const auto* strategy : strategies) {
+            std::vector<int> nodes;
+            for (const auto& indicator : strategy->inputs()) {
+                nodes.push_back(graph.add(indicator));
+                indicators.push_back(indicator);
+            }
+            input_nodes.push_back(std::move(nodes));
+        }
+        history = IndicatorStrategy::required_history(indicators);
+    }
+
+    // The evaluator refers to this scorer's own graph
+    SharedIndicatorScorer(const SharedIndicatorScorer&) = delete;
+    SharedIndicatorScorer& operator=(const SharedIndicatorScorer&) = delete;
+
+    size_t node_count() const { return graph.size(); }
+
+    // One score per strategy, NaN for a strategy that could not score this history
+    std::vector<double> speculate(PriceHistory prices, int holding_window) {
+        if (history > 0) {
+            prices = prices.last(std::min(prices.size(), static_cast<size_t>(history)));
+        }
+        const auto& node_values = evaluator.evaluate(prices);
+
+        std::vector<double> scores;
+        scores.reserve(strategies.size());
+        std::vector<double> input_values;
+        for (size_t i = 0; i < strategies.size(); ++i) {
+            input_values.clear();
+            for (int node : input_nodes[i]) {
+                input_values.push_back(node_values[node]);
+            }
+            try {
+                scores.push_back(strategies[i]->score(input_values, holding_window));
+            } catch (const std::exception&) {
+                scores.push_back(std::numeric_limits<double>::quiet_NaN());
+            }
+        }
+        return scores;
+    }
+};
+
+class MovingAverageStrategy : public IndicatorStrategy {
 private:
     int short_window;
     int long_window;
 
-    std::pair<std::vector<double>, std::vector<double>> calculate_moving_averages(
-        const std::vector<double>& prices) {
-        std::vector<double> short_ma(prices.size());
-        std::vector<double> long_ma(prices.size());
-        
-        // Calculate moving averages
-        for (size_t i = 0; i < prices.size(); ++i) {
-            int short_start = std::max(0, static_cast<int>(i) - short_window + 1);
-            int long_start = std::max(0, static_cast<int>(i) - long_window + 1);
-            
-            double short_sum = 0, long_sum = 0;
-            int short_count = 0, long_count = 0;
-            
-            for (int j = short_start; j <= i; ++j) {
-                short_sum += prices[j];
-                ++short_count;
-            }
-            
-            for (int j = long_start; j <= i; ++j) {
-                long_sum += prices[j];
-                ++long_count;
-            }
-            
-            short_ma[i] = short_sum / short_count;
-            long_ma[i] = long_sum / long_count;
-        }
-        
-        return {short_ma, long_ma};
-    }
-
-    double calculate_momentum(const std::vector<double>& short_ma, 
-                            const std::vector<double>& long_ma) {
-        double short_last = short_ma.back();
-        double long_last = long_ma.back();
-        double diff_pct = (short_last - long_last) / long_last;
+    double calculate_momentum(double short_ma, double long_ma) const {
+        double diff_pct = (short_ma - long_ma) / long_ma;
         return std::tanh(diff_pct * 10);  // Scale factor of 10 for better spread
     }
 
@@ -72,33 +333,629 @@ public:
     MovingAverageStrategy(int short_window = 20, int long_window = 50)
         : short_window(short_window), long_window(long_window) {}
 
-    double speculate(const std::vector<double>& prices,
-                    const std::string& start_date,
-                    int holding_window) override {
-        if (prices.size() < static_cast<size_t>(long_window)) {
+    std::string cache_key() const override {
+        return "moving_average(" + std::to_string(short_window) + "," + std::to_string(long_window) + ")";
+    }
+
+    std::vector<Indicator> inputs() const override {
+        return {
+            Indicator::sma(Indicator::close(), short_window),
+            Indicator::sma(Indicator::close(), long_window),
+            Indicator::std_dev(Indicator::returns(), 0)  // historical volatility over all returns
+        };
+    }
+
+    double score(const std::vector<double>& input_values, int holding_window) const override {
+        double short_ma = input_values[0];
+        double long_ma = input_values[1];
+        if (std::isnan(short_ma) || std::isnan(long_ma)) {
             throw std::runtime_error("Not enough historical data for moving average speculation");
         }
 
-        auto [short_ma, long_ma] = calculate_moving_averages(prices);
         double momentum = calculate_momentum(short_ma, long_ma);
+        double volatility = input_values[2] * std::sqrt(252);
+
+        return momentum * volatility * (static_cast<double>(holding_window) / 252);
+    }
+};
+
+enum class PathModel {
+    GBM,        // geometric Brownian motion fitted to the lookback log returns
+    Bootstrap   // resampled historical log returns
+};
+
+struct MonteCarloResult {
+    double expected_roi;
+    double lower_quantile;  // ROI at the `tail` quantile
+    double upper_quantile;  // ROI at the 1 - `tail` quantile
+};
+
+// Simulates `paths` forward price paths over the holding window and speculates the
+// mean ROI across them. Paths are generated in blocks that stay in L1, with the
+// inner loop running across paths so it vectorises, and universes are scored in
+// parallel across tickers. Draws come from PhiloxRng keyed by (seed, ticker, date)
+// and indexed by (step, path), so results do not depend on the thread count.
+class MonteCarloStrategy : public Strategy {
+private:
+    static constexpr int block_size = 256;
 
-        // Calculate historical volatility
-        std::vector<double> returns(prices.size() - 1);
+    int paths;
+    PathModel model;
+    int lookback;
+    double tail;
+    uint64_t seed;
+    unsigned threads;
+
+public:
+    MonteCarloStrategy(int paths = 4096,
+                       PathModel model = PathModel::GBM,
+                       int lookback = 250,
+                       double tail = 0.05,
+                       uint64_t seed = 0,
+                       unsigned threads = 0)
+        : paths(paths), model(model), lookback(lookback), tail(tail), seed(seed), threads(threads) {
+        if (paths <= 0) {
+            throw std::invalid_argument("Monte Carlo speculation needs at least one path");
+        }
+        // Two returns at least, so the sample volatility is defined
+        if (lookback < 2) {
+            throw std::invalid_argument("Monte Carlo lookback must be at least 2 days");
+        }
+        if (!(tail >= 0.0 && tail <= 0.5)) {
+            throw std::invalid_argument("Monte Carlo tail quantile must be between 0 and 0.5");
+        }
+    }
+
+    MonteCarloResult simulate(const std::string& ticker,
+                              PriceHistory prices,
+                              const std::string& start_date,
+                              int holding_window) const {
+        if (prices.size() < 3) {
+            throw std::runtime_error("Not enough historical data for Monte Carlo speculation");
+        }
+
+        prices = prices.last(std::min(prices.size(), static_cast<size_t>(lookback) + 1));
+        std::vector<double> log_returns;
+        log_returns.reserve(prices.size() - 1);
         for (size_t i = 1; i < prices.size(); ++i) {
-            returns[i-1] = (prices[i] - prices[i-1]) / prices[i-1];
+            log_returns.push_back(std::log(prices[i] / prices[i - 1]));
         }
 
-        // Calculate standard deviation
         double mean = 0.0;
-        for (double ret : returns) mean += ret;
-        mean /= returns.size();
-
+        for (double r : log_returns) mean += r;
+        mean /= log_returns.size();
         double sq_sum = 0.0;
-        for (double ret : returns) {
-            sq_sum += (ret - mean) * (ret - mean);
+        for (double r : log_returns) sq_sum += (r - mean) * (r - mean);
+        double sigma = std::sqrt(sq_sum / (log_returns.size() - 1));
+
+        PhiloxRng rng(seed, ticker, start_date);
+        std::vector<double> terminal_rois(paths);
+        double draws[block_size];
+        double log_prices[block_size];
+        double n_returns = static_cast<double>(log_returns.size());
+        size_t last_return = log_returns.size() - 1;
+
+        for (int block_start = 0; block_start < paths; block_start += block_size) {
+            int width = std::min(block_size, paths - block_start);
+            std::fill(log_prices, log_prices + width, 0.0);
+
+            for (int step = 0; step < holding_window; ++step) {
+                uint64_t first_draw = static_cast<uint64_t>(step) * paths + block_start;
+                if (model == PathModel::GBM) {
+                    rng.fill_normal(draws, width, first_draw);
+                    for (int p = 0; p < width; ++p) {
+                        log_prices[p] += mean + sigma * draws[p];
+                    }
+                } else {
+                    rng.fill_uniform(draws, width, first_draw);
+                    for (int p = 0; p < width; ++p) {
+                        size_t pick = std::min(static_cast<size_t>(draws[p] * n_returns), last_return);
+                        log_prices[p] += log_returns[pick];
+                    }
+                }
+            }
+
+            for (int p = 0; p < width; ++p) {
+                terminal_rois[block_start + p] = std::exp(log_prices[p]) - 1.0;
+            }
         }
-        double volatility = std::sqrt(sq_sum / (returns.size() - 1)) * std::sqrt(252);
 
-        return momentum * volatility * (static_cast<double>(holding_window) / 252);
+        double expected_roi = 0.0;
+        for (double roi : terminal_rois) expected_roi += roi;
+        expected_roi /= paths;
+
+        auto quantile = [&](double q) {
+            auto nth = terminal_rois.begin() + static_cast<size_t>(q * (paths - 1));
+            std::nth_element(terminal_rois.begin(), nth, terminal_rois.end());
+            return *nth;
+        };
+        double lower = quantile(tail);
+        double upper = quantile(1.0 - tail);
+
+        return MonteCarloResult{expected_roi, lower, upper};
+    }
+
+    std::vector<MonteCarloResult> simulate_batch(const std::vector<std::string>& tickers,
+                                                 std::span<const PriceHistory> histories,
+                                                 const std::string& start_date,
+                                                 int holding_window) const {
+        constexpr double NaN = std::numeric_limits<double>::quiet_NaN();
+        std::vector<MonteCarloResult> results(tickers.size(), MonteCarloResult{NaN, NaN, NaN});
+        parallel_for(tickers.size(), [&](size_t i) {
+            if (histories[i].size() >= 3) {
+                results[i] = simulate(tickers[i], histories[i], start_date, holding_window);
+            }
+        }, threads, 1);
+        return results;
+    }
+
+    using Strategy::speculate;
+    using Strategy::speculate_batch;
+
+    double speculate(PriceHistory prices,
+                    const std::string& start_date,
+                    int holding_window) override {
+        return simulate("", prices, start_date, holding_window).expected_roi;
+    }
+
+    double speculate(const std::string& ticker,
+                    PriceHistory prices,
+                    const std::string& start_date,
+                    int holding_window) override {
+        return simulate(ticker, prices, start_date, holding_window).expected_roi;
+    }
+
+    std::vector<double> speculate_batch(const std::vector<std::string>& tickers,
+                                        std::span<const PriceHistory> histories,
+                                        const std::string& start_date,
+                                        int holding_window) override {
+        auto results = simulate_batch(tickers, histories, start_date, holding_window);
+        std::vector<double> rois(results.size());
+        for (size_t i = 0; i < results.size(); ++i) {
+            rois[i] = results[i].expected_roi;
+            if (std::isnan(rois[i])) {
+                std::cerr << "Error processing " << tickers[i]
+                          << ": Not enough historical data for Monte Carlo speculation" << std::endl;
+            }
+        }
+        return rois;
+    }
+
+    bool scores_independently() const override { return true; }
+
+    int required_history() const override { return lookback + 1; }
+
+    // The expected ROI does not depend on the tail or the thread count
+    std::string cache_key() const override {
+        return "monte_carlo(" + std::to_string(paths) + "," + std::to_string(static_cast<int>(model)) + "," +
+               std::to_string(lookback) + "," + std::to_string(seed) + ")";
+    }
+};
+
+// Random forest forecaster exported from time-series-forecast/stockpricepredictor.py
+// (see export_forest.py). The model predicts the next close from close-price
+// features; the speculated ROI compounds that one-day move over the holding window.
+// Universes are scored as one feature matrix through FlatForest::predict_batch.
+class ForestStrategy : public Strategy {
+private:
+    FlatForest forest;
+    std::vector<PriceFeature> features;
+
+public:
+    explicit ForestStrategy(const std::string& model_path)
+        : forest(FlatForest::load(model_path)) {
+        for (const auto& name : forest.get_feature_names()) {
+            features.push_back(PriceFeature::parse(name));
+        }
+    }
+
+    using Strategy::speculate_batch;
+
+    double speculate(PriceHistory prices,
+                    const std::string& start_date,
+                    int holding_window) override {
+        std::vector<float> row(features.size());
+        if (!compute_price_features(prices, features, row.data())) {
+            throw std::runtime_error("Not enough historical data for forest speculation");
+        }
+        double predicted_close;
+        forest.predict_batch(row.data(), 1, row.size(), &predicted_close);
+        return std::pow(predicted_close / prices.back(), holding_window) - 1.0;
+    }
+
+    std::vector<double> speculate_batch(const std::vector<std::string>& tickers,
+                                        std::span<const PriceHistory> histories,
+                                        const std::string& start_date,
+                                        int holding_window) override {
+        size_t stride = features.size();
+        std::vector<float> rows(tickers.size() * stride);
+        std::vector<size_t> scored;
+        scored.reserve(tickers.size());
+
+        for (size_t i = 0; i < tickers.size(); ++i) {
+            if (compute_price_features(histories[i], features, rows.data() + scored.size() * stride)) {
+                scored.push_back(i);
+            } else {
+                std::cerr << "Error processing " << tickers[i]
+                          << ": Not enough historical data for forest speculation" << std::endl;
+            }
+        }
+
+        std::vector<double> predicted_closes(scored.size());
+        forest.predict_batch(rows.data(), scored.size(), stride, predicted_closes.data());
+
+        std::vector<double> rois(tickers.size(), std::numeric_limits<double>::quiet_NaN());
+        for (size_t k = 0; k < scored.size(); ++k) {
+            auto prices = histories[scored[k]];
+            rois[scored[k]] = std::pow(predicted_closes[k] / prices.back(), holding_window) - 1.0;
+        }
+        return rois;
+    }
+
+    bool scores_independently() const override { return true; }
+
+    int required_history() const override {
+        size_t history = 1;
+        for (const auto& feature : features) {
+            history = std::max(history, feature.required_history());
+        }
+        return static_cast<int>(history);
+    }
+};
+
+// Small neural network over the last `window` daily log returns (see
+// neural_network.hpp for the weight format). The network's single output is the
+// speculated ROI. A universe is scored as one batch so each layer is one GEMM.
+class NeuralStrategy : public Strategy {
+private:
+    NeuralNetwork network;
+
+    bool fill_inputs(PriceHistory prices, float* out) const {
+        size_t window = network.get_window();
+        if (prices.size() < window + 1) {
+            return false;
+        }
+        size_t first = prices.size() - window;
+        for (size_t i = 0; i < window; ++i) {
+            out[i] = static_cast<float>(std::log(prices[first + i] / prices[first + i - 1]));
+        }
+        return true;
+    }
+
+public:
+    explicit NeuralStrategy(const std::string& weights_path)
+        : network(NeuralNetwork::load(weights_path)) {}
+
+    int required_history() const override { return static_cast<int>(network.get_window()) + 1; }
+
+    using Strategy::speculate_batch;
+
+    double speculate(PriceHistory prices,
+                    const std::string& start_date,
+                    int holding_window) override {
+        std::vector<float> inputs(network.get_window());
+        if (!fill_inputs(prices, inputs.data())) {
+            throw std::runtime_error("Not enough historical data for neural network speculation");
+        }
+        float output;
+        network.forward(inputs.data(), 1, &output);
+        return output;
+    }
+
+    std::vector<double> speculate_batch(const std::vector<std::string>& tickers,
+                                        std::span<const PriceHistory> histories,
+                                        const std::string& start_date,
+                                        int holding_window) override {
+        size_t window = network.get_window();
+        std::vector<float> inputs(tickers.size() * window);
+        std::vector<size_t> scored;
+        scored.reserve(tickers.size());
+
+        for (size_t i = 0; i < tickers.size(); ++i) {
+            if (fill_inputs(histories[i], inputs.data() + scored.size() * window)) {
+                scored.push_back(i);
+            } else {
+                std::cerr << "Error processing " << tickers[i]
+                          << ": Not enough historical data for neural network speculation" << std::endl;
+            }
+        }
+
+        std::vector<float> outputs(scored.size());
+        network.forward(inputs.data(), scored.size(), outputs.data());
+
+        std::vector<double> rois(tickers.size(), std::numeric_limits<double>::quiet_NaN());
+        for (size_t k = 0; k < scored.size(); ++k) {
+            rois[scored[k]] = outputs[k];
+        }
+        return rois;
+    }
+};
+
+struct CascadeOptions {
+    double keep_fraction = 0.2;  // share of the universe re-scored by the expensive model
+    size_t min_keep = 0;         // floor on the shortlist; leave headroom over max_holdings
+                                 // for names the sector filter will reject
+    size_t recall_at = 0;        // if > 0, also score everyone with the model and report
+                                 // how much of its top recall_at survived the prefilter
+};
+
+struct CascadeStats {
+    size_t universe = 0;
+    size_t shortlisted = 0;
+    double prefilter_seconds = 0.0;
+    double model_seconds = 0.0;
+    std::optional<double> recall;
+    double full_model_seconds = 0.0;
+};
+
+// Two-stage ranking: a cheap prefilter scores the whole universe and only its top
+// keep_fraction (at least min_keep) is re-scored by the expensive model. Tickers cut
+// by the prefilter are not scored (NaN), which keeps them out of the rankings. Single
+// tickers (e.g. current holdings) go straight to the model.
+class CascadeStrategy : public Strategy {
+private:
+    std::unique_ptr<Strategy> prefilter;
+    std::unique_ptr<Strategy> model;
+    CascadeOptions options;
+    CascadeStats stats;
+
+    static double seconds_since(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+public:
+    CascadeStrategy(std::unique_ptr<Strategy> prefilter,
+                    std::unique_ptr<Strategy> model,
+                    CascadeOptions options = {})
+        : prefilter(std::move(prefilter)), model(std::move(model)), options(options) {}
+
+    int required_history() const override {
+        int histories[] = {prefilter->required_history(), model->required_history()};
+        return longest_history(histories);
+    }
+
+    const CascadeStats& last_stats() const { return stats; }
+
+    void report(std::ostream& out) const {
+        out << "Cascade: " << stats.shortlisted << " of " << stats.universe << " tickers re-scored\n";
+        out << "  prefilter: " << stats.prefilter_seconds * 1000 << " ms\n";
+        out << "  model:     " << stats.model_seconds * 1000 << " ms\n";
+        if (stats.recall) {
+            out << "  recall@" << options.recall_at << ": " << *stats.recall * 100 << "% (full model scoring: "
+                << stats.full_model_seconds * 1000 << " ms)\n";
+        }
+    }
+
+    using Strategy::speculate;
+    using Strategy::speculate_batch;
+
+    double speculate(PriceHistory prices,
+                    const std::string& start_date,
+                    int holding_window) override {
+        return model->speculate(prices, start_date, holding_window);
+    }
+
+    double speculate(const std::string& ticker,
+                    PriceHistory prices,
+                    const std::string& start_date,
+                    int holding_window) override {
+        return model->speculate(ticker, prices, start_date, holding_window);
+    }
+
+    std::vector<double> speculate_batch(const std::vector<std::string>& tickers,
+                                        std::span<const PriceHistory> histories,
+                                        const std::string& start_date,
+                                        int holding_window) override {
+        stats = CascadeStats{};
+        stats.universe = tickers.size();
+
+        auto start = std::chrono::steady_clock::now();
+        auto cheap_scores = prefilter->speculate_batch(tickers, histories, start_date, holding_window);
+        stats.prefilter_seconds = seconds_since(start);
+
+        // Best prefilter scores first; tickers the prefilter could not score go last
+        std::vector<size_t> order(tickers.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            if (std::isnan(cheap_scores[a]) != std::isnan(cheap_scores[b])) {
+                return std::isnan(cheap_scores[b]);
+            }
+            return cheap_scores[a] > cheap_scores[b];
+        });
+
+        size_t keep = static_cast<size_t>(std::ceil(options.keep_fraction * tickers.size()));
+        keep = std::min(tickers.size(), std::max(keep, options.min_keep));
+        order.resize(keep);
+        stats.shortlisted = keep;
+
+        std::vector<std::string> shortlist_tickers;
+        std::vector<PriceHistory> shortlist_histories;
+        shortlist_tickers.reserve(keep);
+        shortlist_histories.reserve(keep);
+        for (size_t i : order) {
+            shortlist_tickers.push_back(tickers[i]);
+            shortlist_histories.push_back(histories[i]);
+        }
+
+        start = std::chrono::steady_clock::now();
+        auto model_scores = model->speculate_batch(shortlist_tickers, shortlist_histories, start_date, holding_window);
+        stats.model_seconds = seconds_since(start);
+
+        // Tickers left off the shortlist are not scored
+        std::vector<double> rois(tickers.size(), std::numeric_limits<double>::quiet_NaN());
+        std::vector<bool> shortlisted(tickers.size(), false);
+        for (size_t k = 0; k < order.size(); ++k) {
+            rois[order[k]] = model_scores[k];
+            shortlisted[order[k]] = true;
+        }
+
+        if (options.recall_at > 0) {
+            start = std::chrono::steady_clock::now();
+            auto full_scores = model->speculate_batch(tickers, histories, start_date, holding_window);
+            stats.full_model_seconds = seconds_since(start);
+
+            std::vector<size_t> full_order;
+            for (size_t i = 0; i < tickers.size(); ++i) {
+                if (!std::isnan(full_scores[i])) {
+                    full_order.push_back(i);
+                }
+            }
+            size_t k = std::min(options.recall_at, full_order.size());
+            std::partial_sort(full_order.begin(), full_order.begin() + k, full_order.end(),
+                              [&](size_t a, size_t b) { return full_scores[a] > full_scores[b]; });
+
+            size_t found = 0;
+            for (size_t j = 0; j < k; ++j) {
+                if (shortlisted[full_order[j]]) {
+                    ++found;
+                }
+            }
+            stats.recall = k > 0 ? static_cast<double>(found) / k : 1.0;
+        }
+
+        return rois;
+    }
+};
+
+struct EnsembleMember {
+    std::unique_ptr<Strategy> strategy;
+    double weight;
+};
+
+// Weighted blend of several strategies. Indicator-based members score the universe
+// in one pass that shares an indicator graph, so an indicator they have in common is
+// computed once per ticker. Every other member scores the whole universe through its
+// own speculate_batch, keeping whatever batching or parallelism it has, and the
+// scores are blended afterwards. The combined score is the weighted mean of the
+// members that could score the ticker, in batch and single mode alike;
+// last_member_scores() keeps the per-member scores of the last batch for diagnostics
+// (NaN where a member failed).
+class EnsembleStrategy : public Strategy {
+private:
+    std::vector<EnsembleMember> members;
+    std::vector<size_t> indicator_members;
+    std::vector<size_t> other_members;
+    SharedIndicatorScorer indicator_scorer;
+    std::vector<std::string> last_tickers;
+    std::vector<std::vector<double>> member_scores;
+
+    static std::vector<IndicatorStrategy*> indicator_strategies(const std::vector<EnsembleMember>& members) {
+        std::vector<IndicatorStrategy*> strategies;
+        for (const auto& member : members) {
+            if (auto* strategy = dynamic_cast<IndicatorStrategy*>(member.strategy.get())) {
+                strategies.push_back(strategy);
+            }
+        }
+        return strategies;
+    }
+
+    double score_ticker(const std::string& ticker,
+                        PriceHistory prices,
+                        const std::string& start_date,
+                        int holding_window,
+                        std::vector<double>& scores) {
+        scores.assign(members.size(), std::numeric_limits<double>::quiet_NaN());
+
+        if (!indicator_members.empty()) {
+            auto shared_scores = indicator_scorer.speculate(prices, holding_window);
+            for (size_t k = 0; k < indicator_members.size(); ++k) {
+                scores[indicator_members[k]] = shared_scores[k];
+            }
+        }
+        for (size_t m : other_members) {
+            try {
+                scores[m] = members[m].strategy->speculate(ticker, prices, start_date, holding_window);
+            } catch (const std::exception&) {
+            }
+        }
+        return blend(scores);
+    }
+
+    double blend(const std::vector<double>& scores) const {
+        double weighted_sum = 0.0;
+        double total_weight = 0.0;
+        for (size_t m = 0; m < members.size(); ++m) {
+            if (!std::isnan(scores[m])) {
+                weighted_sum += members[m].weight * scores[m];
+                total_weight += members[m].weight;
+            }
+        }
+        if (total_weight == 0.0) {
+            throw std::runtime_error("No ensemble member could speculate");
+        }
+        return weighted_sum / total_weight;
+    }
+
+public:
+    explicit EnsembleStrategy(std::vector<EnsembleMember> ensemble_members)
+        : members(std::move(ensemble_members)), indicator_scorer(indicator_strategies(members)) {
+        for (size_t m = 0; m < members.size(); ++m) {
+            if (dynamic_cast<IndicatorStrategy*>(members[m].strategy.get())) {
+                indicator_members.push_back(m);
+            } else {
+                other_members.push_back(m);
+            }
+        }
+    }
+
+    const std::vector<std::string>& last_tickers_scored() const { return last_tickers; }
+    const std::vector<std::vector<double>>& last_member_scores() const { return member_scores; }
+
+    int required_history() const override {
+        std::vector<int> histories;
+        for (const auto& member : members) {
+            histories.push_back(member.strategy->required_history());
+        }
+        return longest_history(histories);
+    }
+
+    using Strategy::speculate;
+    using Strategy::speculate_batch;
+
+    double speculate(PriceHistory prices,
+                    const std::string& start_date,
+                    int holding_window) override {
+        return speculate("", prices, start_date, holding_window);
+    }
+
+    double speculate(const std::string& ticker,
+                    PriceHistory prices,
+                    const std::string& start_date,
+                    int holding_window) override {
+        std::vector<double> scores;
+        return score_ticker(ticker, prices, start_date, holding_window, scores);
+    }
+
+    std::vector<double> speculate_batch(const std::vector<std::string>& tickers,
+                                        std::span<const PriceHistory> histories,
+                                        const std::string& start_date,
+                                        int holding_window) override {
+        last_tickers = tickers;
+        member_scores.assign(tickers.size(), std::vector<double>(members.size(), std::numeric_limits<double>::quiet_NaN()));
+
+        if (!indicator_members.empty()) {
+            for (size_t i = 0; i < tickers.size(); ++i) {
+                auto shared_scores = indicator_scorer.speculate(histories[i], holding_window);
+                for (size_t k = 0; k < indicator_members.size(); ++k) {
+                    member_scores[i][indicator_members[k]] = shared_scores[k];
+                }
+            }
+        }
+        for (size_t m : other_members) {
+            auto scores = members[m].strategy->speculate_batch(tickers, histories, start_date, holding_window);
+            for (size_t i = 0; i < tickers.size(); ++i) {
+                member_scores[i][m] = scores[i];
+            }
+        }
+
+        std::vector<double> rois(tickers.size(), std::numeric_limits<double>::quiet_NaN());
+        for (size_t i = 0; i < tickers.size(); ++i) {
+            try {
+                rois[i] = blend(member_scores[i]);
+            } catch (const std::exception& e) {
+                std::cerr << "Error processing " << tickers[i] << ": " << e.what() << std::endl;
+            }
+        }
+        return rois;
     }
 };
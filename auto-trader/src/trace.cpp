@@ -0,0 +1,145 @@
+// trace.cpp
+#include "trace.hpp"
+#include <algorithm>
+#include <fmt/format.h>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace {
+    struct Span {
+        const char* name;
+        int64_t start;
+        int64_t end;
+    };
+
+    struct ThreadSpans {
+        uint32_t id;
+        std::vector<Span> spans;
+    };
+
+    // Buffers are owned here rather than by their threads, so spans recorded by pool
+    // workers that have since exited are still written out
+    std::mutex registry_mutex;
+    std::vector<std::unique_ptr<ThreadSpans>> registry;
+    int64_t origin = 0;     // timestamps are written relative to the first enable()
+
+    thread_local ThreadSpans* local_spans = nullptr;
+
+    ThreadSpans& thread_spans() {
+        if (!local_spans) {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            registry.push_back(std::make_unique<ThreadSpans>());
+            registry.back()->id = static_cast<uint32_t>(registry.size());
+            registry.back()->spans.reserve(1024);
+            local_spans = registry.back().get();
+        }
+        return *local_spans;
+    }
+
+    struct PhaseTotals {
+        size_t calls = 0;
+        int64_t total = 0;
+        int64_t self = 0;
+        int64_t max = 0;
+    };
+}
+
+void Tracer::enable(bool on) {
+    if (on) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        if (origin == 0) {
+            origin = now();
+        }
+    }
+    active.store(on, std::memory_order_relaxed);
+}
+
+void Tracer::record(const char* name, int64_t start_ns, int64_t end_ns) {
+    thread_spans().spans.push_back(Span{name, start_ns, end_ns});
+}
+
+void Tracer::clear() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto& thread : registry) {
+        thread->spans.clear();
+    }
+}
+
+void Tracer::write_chrome_trace(const std::string& path) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open trace file for writing: " + path);
+    }
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    fmt::memory_buffer buffer;
+    fmt::format_to(std::back_inserter(buffer), "{{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    bool first = true;
+    for (const auto& thread : registry) {
+        fmt::format_to(std::back_inserter(buffer),
+                       "{}{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+                       first ? "" : ",\n", thread->id,
+                       thread->id == 1 ? std::string("main") : fmt::format("worker {}", thread->id - 1));
+        first = false;
+        for (const auto& span : thread->spans) {
+            // Complete events, microseconds
+            fmt::format_to(std::back_inserter(buffer),
+                           ",\n{{\"name\":\"{}\",\"cat\":\"rebalance\",\"ph\":\"X\",\"pid\":1,\"tid\":{},"
+                           "\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                           span.name, thread->id, (span.start - origin) / 1e3, (span.end - span.start) / 1e3);
+        }
+    }
+    fmt::format_to(std::back_inserter(buffer), "]}}\n");
+    file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+}
+
+void Tracer::write_summary(std::ostream& out) {
+    std::map<std::string_view, PhaseTotals> phases;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (const auto& thread : registry) {
+            // Spans are recorded as they close, children before their parent. In start
+            // order (outermost first on ties) each span's parent is the innermost open
+            // one, and its time is taken out of that parent's self time.
+            std::vector<Span> spans = thread->spans;
+            std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) {
+                return a.start != b.start ? a.start < b.start : a.end > b.end;
+            });
+            std::vector<std::pair<PhaseTotals*, int64_t>> open;     // phase, end
+            for (const auto& span : spans) {
+                while (!open.empty() && open.back().second <= span.start) {
+                    open.pop_back();
+                }
+                int64_t duration = span.end - span.start;
+                if (!open.empty()) {
+                    open.back().first->self -= duration;
+                }
+                PhaseTotals& totals = phases[span.name];
+                totals.calls++;
+                totals.total += duration;
+                totals.self += duration;
+                totals.max = std::max(totals.max, duration);
+                open.emplace_back(&totals, span.end);
+            }
+        }
+    }
+
+    std::vector<std::pair<std::string_view, PhaseTotals>> sorted(phases.begin(), phases.end());
+    std::sort(sorted.begin(), sorted.end(),
+              [](const auto& a, const auto& b) { return a.second.total > b.second.total; });
+
+    out << fmt::format("{:<24} {:>8} {:>12} {:>12} {:>12} {:>12}\n",
+                       "phase", "calls", "total ms", "self ms", "mean ms", "max ms");
+    for (const auto& [name, totals] : sorted) {
+        out << fmt::format("{:<24} {:>8} {:>12.3f} {:>12.3f} {:>12.3f} {:>12.3f}\n",
+                           name, totals.calls, totals.total / 1e6, totals.self / 1e6,
+                           totals.total / 1e6 / totals.calls, totals.max / 1e6);
+    }
+}
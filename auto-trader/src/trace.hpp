@@ -0,0 +1,73 @@
+// trace.hpp
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+// Built with STOCK_ANALYZER_TRACING=0 (the CMake option of the same name), TRACE_SCOPE
+// compiles to nothing
+#ifndef STOCK_ANALYZER_TRACING
+#define STOCK_ANALYZER_TRACING 1
+#endif
+
+// Scoped wall-clock spans for finding out where a rebalance spends its time.
+//
+// TRACE_SCOPE("name") at the top of a block records one span from there to the end of
+// the block, on whichever thread runs it. Nothing is recorded until Tracer::enable();
+// while disabled a span costs one relaxed atomic load. Each thread appends to its own
+// buffer, so worker threads record without locking.
+//
+// The spans can be written as a Chrome trace-event file (chrome://tracing or
+// ui.perfetto.dev) or summarised per phase. Both read every thread's buffer, so call
+// them once the traced work has finished.
+class Tracer {
+private:
+    static inline std::atomic<bool> active{false};
+
+public:
+    static void enable(bool on = true);
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    // `name` must outlive the tracer (TRACE_SCOPE passes string literals)
+    static void record(const char* name, int64_t start_ns, int64_t end_ns);
+
+    // Drops every recorded span
+    static void clear();
+
+    static void write_chrome_trace(const std::string& path);
+
+    // One line per span name: calls, total and self time (total less nested spans on
+    // the same thread), mean and max, heaviest first
+    static void write_summary(std::ostream& out);
+};
+
+class TraceScope {
+private:
+    const char* name;
+    int64_t start;
+
+public:
+    explicit TraceScope(const char* name) : name(name), start(Tracer::enabled() ? Tracer::now() : -1) {}
+    ~TraceScope() {
+        if (start >= 0) {
+            Tracer::record(name, start, Tracer::now());
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#if STOCK_ANALYZER_TRACING
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#endif
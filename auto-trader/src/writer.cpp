@@ -1,6 +1,55 @@
 // writer.cpp
 #include "writer.hpp"
+#include <cmath>
+#include <fmt/format.h>
 #include <fstream>
+#include <iterator>
+
+namespace {
+    void append_string(fmt::memory_buffer& buffer, const std::string& value) {
+        buffer.push_back('"');
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                buffer.push_back('\\');
+                buffer.push_back(c);
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                fmt::format_to(std::back_inserter(buffer), "\\u{:04x}", static_cast<int>(c));
+            } else {
+                buffer.push_back(c);
+            }
+        }
+        buffer.push_back('"');
+    }
+
+    // Like json::dump, non-finite numbers are written as null
+    void append_number(fmt::memory_buffer& buffer, std::optional<double> value) {
+        if (value && std::isfinite(*value)) {
+            fmt::format_to(std::back_inserter(buffer), "{}", *value);
+        } else {
+            fmt::format_to(std::back_inserter(buffer), "null");
+        }
+    }
+
+    void append_key(fmt::memory_buffer& buffer, const char* key) {
+        fmt::format_to(std::back_inserter(buffer), ",\"{}\":", key);
+    }
+
+    void append_risk(fmt::memory_buffer& buffer, const std::optional<RiskReport>& risk) {
+        if (!risk) {
+            fmt::format_to(std::back_inserter(buffer), "null");
+            return;
+        }
+        fmt::format_to(std::back_inserter(buffer), "{{\"volatility\":");
+        append_number(buffer, risk->volatility);
+        append_key(buffer, "value_at_risk");
+        append_number(buffer, risk->value_at_risk);
+        append_key(buffer, "conditional_value_at_risk");
+        append_number(buffer, risk->conditional_value_at_risk);
+        append_key(buffer, "max_drawdown");
+        append_number(buffer, risk->max_drawdown);
+        buffer.push_back('}');
+    }
+}
 
 void Writer::make_portfolio(const Portfolio& portfolio, const std::string& output_path) {
     std::ofstream file(output_path);
@@ -10,4 +59,96 @@ void Writer::make_portfolio(const Portfolio& portfolio, const std::string& outpu
     
     json j = portfolio.to_dict();
     file << j.dump(4);
-}
\ No newline at end of file
+}
+
+// Batch lines are formatted directly rather than built as json objects: a json tree
+// per action cost more than the allocation that produced it
+void Writer::write_rebalance_line(std::ostream& out, const std::string& portfolio_id,
+                                  const RebalanceResult& result) {
+    const auto& [actions, summary, new_portfolio] = result;
+    fmt::memory_buffer buffer;
+
+    fmt::format_to(std::back_inserter(buffer), "{{\"id\":");
+    append_string(buffer, portfolio_id);
+    append_key(buffer, "date");
+    append_string(buffer, new_portfolio.date);
+    append_key(buffer, "cash");
+    append_number(buffer, new_portfolio.cash);
+    fmt::format_to(std::back_inserter(buffer), ",\"actions\":[");
+
+    for (size_t i = 0; i < actions.size(); ++i) {
+        const auto& action = actions[i];
+        fmt::format_to(std::back_inserter(buffer), "{}{{\"action_type\":", i ? "," : "");
+        append_string(buffer, action.action_type);
+        append_key(buffer, "ticker");
+        append_string(buffer, action.ticker);
+        fmt::format_to(std::back_inserter(buffer), ",\"traded_shares\":{},\"outstanding_shares\":{}",
+                       action.traded_shares, action.outstanding_shares);
+        append_key(buffer, "speculated_roi");
+        append_number(buffer, action.speculated_roi);
+        append_key(buffer, "speculated_net_capital");
+        append_number(buffer, action.speculated_net_capital);
+        append_key(buffer, "new_holding_value");
+        append_number(buffer, action.new_holding_value);
+        append_key(buffer, "actual_roi");
+        append_number(buffer, action.actual_roi);
+        append_key(buffer, "actual_net_capital");
+        append_number(buffer, action.actual_net_capital);
+        buffer.push_back('}');
+    }
+
+    fmt::format_to(std::back_inserter(buffer), "],\"summary\":{{\"total_portfolio_value\":");
+    append_number(buffer, summary.total_portfolio_value);
+    append_key(buffer, "remaining_cash");
+    append_number(buffer, summary.remaining_cash);
+    append_key(buffer, "average_speculated_roi");
+    append_number(buffer, summary.average_speculated_roi);
+    append_key(buffer, "total_speculated_net_capital");
+    append_number(buffer, summary.total_speculated_net_capital);
+    append_key(buffer, "average_actual_roi");
+    append_number(buffer, summary.average_actual_roi);
+    append_key(buffer, "total_actual_net_capital");
+    append_number(buffer, summary.total_actual_net_capital);
+    append_key(buffer, "old_risk");
+    append_risk(buffer, summary.old_risk);
+    append_key(buffer, "new_risk");
+    append_risk(buffer, summary.new_risk);
+    fmt::format_to(std::back_inserter(buffer), "}}}}\n");
+
+    out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+}
+
+void Writer::write_rebalance_error_line(std::ostream& out, const std::string& portfolio_id,
+                                        const std::string& error) {
+    json j;
+    j["id"] = portfolio_id;
+    j["error"] = error;
+    out << j.dump() << '\n';
+}
+
+void Writer::write_block_orders(std::ostream& out, const NettingResult& result) {
+    fmt::memory_buffer buffer;
+    for (const auto& block : result.block_orders) {
+        buffer.clear();
+        int64_t net = block.net_shares();
+        fmt::format_to(std::back_inserter(buffer), "{{\"ticker\":");
+        append_string(buffer, result.tickers[block.ticker]);
+        fmt::format_to(std::back_inserter(buffer),
+                       ",\"action_type\":\"{}\",\"shares\":{},\"bought\":{},\"sold\":{},\"allocations\":[",
+                       net > 0 ? "BUY" : net < 0 ? "SELL" : "NONE", net > 0 ? net : -net,
+                       block.bought, block.sold);
+
+        for (size_t i = 0; i < block.allocation_count; ++i) {
+            const auto& allocation = result.allocations[block.first_allocation + i];
+            fmt::format_to(std::back_inserter(buffer), "{}{{\"id\":", i ? "," : "");
+            append_string(buffer, result.accounts[allocation.account]);
+            fmt::format_to(std::back_inserter(buffer),
+                           ",\"action_type\":\"{}\",\"shares\":{},\"crossed\":{},\"market\":{}}}",
+                           allocation.requested > 0 ? "BUY" : "SELL",
+                           allocation.requested > 0 ? allocation.requested : -allocation.requested,
+                           allocation.crossed, allocation.market);
+        }
+        fmt::format_to(std::back_inserter(buffer), "]}}\n");
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    }
+}
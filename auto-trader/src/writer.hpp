@@ -1,9 +1,18 @@
 // writer.hpp
 #pragma once
 #include "models.hpp"
+#include "netting.hpp"
+#include <ostream>
 #include <string>
 
 class Writer {
 public:
     static void make_portfolio(const Portfolio& portfolio, const std::string& output_path);
+    // One JSON line per rebalanced portfolio (id, new date and cash, actions, summary)
+    static void write_rebalance_line(std::ostream& out, const std::string& portfolio_id,
+                                     const RebalanceResult& result);
+    static void write_rebalance_error_line(std::ostream& out, const std::string& portfolio_id,
+                                           const std::string& error);
+    // One JSON line per block order, with its per-account allocations
+    static void write_block_orders(std::ostream& out, const NettingResult& result);
 };
\ No newline at end of file
@@ -0,0 +1,128 @@
+"""
+Export the random forest forecaster to the flat tree-array format read by the C++
+ForestStrategy (auto-trader/src/forest.hpp), so the rebalancer can score with it
+in-process without Python at rebalance time.
+
+The C++ strategy only sees close prices, so the model is trained on the close-price
+features from StockPricePredictor.create_features (close lags, moving averages,
+volatility and daily return). The OHLV lags and the ticker/sector one-hot columns
+are left out.
+
+Usage:
+    python export_forest.py stock_data.csv forest.rfst [--trees 100] [--max-depth 12]
+"""
+import argparse
+import struct
+from array import array
+
+from sklearn.ensemble import RandomForestRegressor
+
+from stockpricepredictor import StockPricePredictor
+
+MAGIC = b'RFST'
+VERSION = 1
+
+
+def is_close_feature(column):
+    return (column.startswith('close_lag_') or column.startswith('ma_') or
+            column.startswith('volatility_') or column == 'daily_return')
+
+
+def train_close_model(predictor, n_estimators, max_depth, random_state):
+    """Train a forest on the close-price feature subset, returning (model, columns)"""
+    X, y, _ = predictor.create_features()
+    columns = [column for column in X.columns if is_close_feature(column)]
+    X_scaled = predictor.scaler.fit_transform(X[columns])
+
+    model = RandomForestRegressor(n_estimators=n_estimators, max_depth=max_depth,
+                                  random_state=random_state, n_jobs=-1)
+    model.fit(X_scaled, y)
+    predictor.model = model
+    return model, columns
+
+
+def flatten_tree(tree, mean, scale, base):
+    """
+    Renumber one sklearn tree breadth-first so siblings are adjacent and return its
+    (feature, threshold, left) arrays. Node indices are offset by `base`.
+
+    sklearn sends x_scaled <= t left; with x_scaled = (x - mean) / scale that is
+    x <= t * scale + mean, so the scaler is folded into the thresholds.
+    """
+    node_count = len(tree.children_left)
+    feature = [-1] * node_count
+    threshold = [0.0] * node_count
+    left = [-1] * node_count
+
+    position = {0: 0}
+    next_free = 1
+    queue = [0]
+    for node in queue:
+        slot = position[node]
+        child_left = tree.children_left[node]
+        if child_left == -1:
+            threshold[slot] = float(tree.value[node][0][0])
+            continue
+
+        f = int(tree.feature[node])
+        feature[slot] = f
+        threshold[slot] = float(tree.threshold[node]) * scale[f] + mean[f]
+        left[slot] = base + next_free
+        position[child_left] = next_free
+        position[tree.children_right[node]] = next_free + 1
+        next_free += 2
+        queue.append(child_left)
+        queue.append(tree.children_right[node])
+
+    return feature, threshold, left
+
+
+def write_forest(path, trees, feature_names, mean, scale):
+    roots = array('I')
+    feature = array('i')
+    threshold = array('f')
+    left = array('i')
+
+    for tree in trees:
+        roots.append(len(feature))
+        tree_feature, tree_threshold, tree_left = flatten_tree(tree, mean, scale, len(feature))
+        feature.extend(tree_feature)
+        threshold.extend(tree_threshold)
+        left.extend(tree_left)
+
+    with open(path, 'wb') as f:
+        f.write(MAGIC)
+        f.write(struct.pack('<IIII', VERSION, len(feature_names), len(roots), len(feature)))
+        for name in feature_names:
+            encoded = name.encode('utf-8')
+            f.write(struct.pack('<I', len(encoded)))
+            f.write(encoded)
+        for values in (roots, feature, threshold, left):
+            if struct.pack('=I', 1) != struct.pack('<I', 1):
+                values.byteswap()
+            values.tofile(f)
+
+    print(f"Exported {len(roots)} trees ({len(feature)} nodes, {len(feature_names)} features) to {path}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('csv_file')
+    parser.add_argument('output')
+    parser.add_argument('--trees', type=int, default=100)
+    parser.add_argument('--max-depth', type=int, default=12)
+    parser.add_argument('--prediction-days', type=int, default=30)
+    parser.add_argument('--random-state', type=int, default=42)
+    args = parser.parse_args()
+
+    predictor = StockPricePredictor(args.csv_file, prediction_days=args.prediction_days)
+    model, columns = train_close_model(predictor, args.trees, args.max_depth, args.random_state)
+    write_forest(args.output,
+                 [estimator.tree_ for estimator in model.estimators_],
+                 columns,
+                 [float(m) for m in predictor.scaler.mean_],
+                 [float(s) for s in predictor.scaler.scale_])
+
+
+if __name__ == "__main__":
+    main()